@@ -0,0 +1,142 @@
+//
+// Bitbench: time the superstl bit scan and population count
+// primitives with the baseline k8 code and with whatever the
+// host supports (POPCNT, TZCNT, LZCNT, PEXT), as selected by
+// detect_host_cpu_features() at startup.
+//
+// Copyright 2000-2008 Matt T. Yourst <yourst@yourst.com>
+//
+
+#include <globals.h>
+#include <superstl.h>
+#include <logic.h>
+
+static const int datasize = 4096;
+static const int passes = 4096;
+
+static W64 data[datasize];
+
+typedef W64 (*bitbench_func_t)();
+
+static W64 bench_popcount64() {
+  W64 sum = 0;
+  foreach (i, datasize) sum += popcount64(data[i]);
+  return sum;
+}
+
+static W64 bench_lsbindex64() {
+  W64 sum = 0;
+  foreach (i, datasize) sum += lsbindex64(data[i]);
+  return sum;
+}
+
+static W64 bench_msbindex64() {
+  W64 sum = 0;
+  foreach (i, datasize) sum += msbindex64(data[i]);
+  return sum;
+}
+
+static W64 bench_bitvec_popcount() {
+  W64 sum = 0;
+  const bitvec<256>* v = (const bitvec<256>*)data;
+  foreach (i, datasize / 4) sum += v[i].popcount();
+  return sum;
+}
+
+static W64 bench_bitvec_iterate() {
+  W64 sum = 0;
+  const bitvec<128>* v = (const bitvec<128>*)data;
+  foreach (i, datasize / 2) {
+    bitvec<128> b = v[i];
+    while (*b) {
+      int idx = b.lsb();
+      sum += idx;
+      b[idx] = 0;
+    }
+  }
+  return sum;
+}
+
+static W64 bench_compress_even_bits() {
+  W64 sum = 0;
+  foreach (i, datasize) sum += compress_even_bits32(LO32(data[i]));
+  return sum;
+}
+
+struct BitBenchmark {
+  const char* name;
+  bitbench_func_t func;
+  int opsperpass; // 0 = one per set bit in data, counted at startup
+};
+
+static BitBenchmark benchmarks[] = {
+  {"popcount64",         bench_popcount64,         datasize},
+  {"lsbindex64",         bench_lsbindex64,         datasize},
+  {"msbindex64",         bench_msbindex64,         datasize},
+  {"bitvec<256>::popcount", bench_bitvec_popcount, datasize / 4},
+  {"bitvec<128> iterate", bench_bitvec_iterate,    0},
+  {"compress_even_bits32", bench_compress_even_bits, datasize},
+};
+
+static double time_benchmark(const BitBenchmark& b, W64& checksum) {
+  W64 best = limits<W64>::max;
+
+  foreach (pass, passes) {
+    W64 t0 = rdtsc();
+    checksum += b.func();
+    W64 t = rdtsc() - t0;
+    best = min(best, t);
+  }
+
+  return (double)best / (double)b.opsperpass;
+}
+
+int main(int argc, char* argv[]) {
+  W64 seed = 0x9e3779b97f4a7c15ULL;
+
+  // xorshift, with each word pruned to about a quarter of its bits so bitvec iteration stays reasonable:
+  foreach (i, datasize) {
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    W64 v = seed;
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    data[i] = (v & seed) | 1;
+  }
+
+  // Iteration visits every set bit, so time it per bit visited:
+  int setbits = 0;
+  foreach (i, datasize) setbits += popcount64(data[i]);
+  foreach (i, lengthof(benchmarks)) {
+    if (!benchmarks[i].opsperpass) benchmarks[i].opsperpass = setbits;
+  }
+
+  detect_host_cpu_features();
+  HostCPUFeatures detected = host_cpu;
+
+  cout << "Host features: ",
+    (detected.popcnt ? "popcnt " : ""), (detected.lzcnt ? "lzcnt " : ""),
+    (detected.bmi1 ? "bmi1 " : ""), (detected.bmi2 ? "bmi2 " : ""), (detected.fastpext ? "fastpext " : ""),
+    (detected.avx2 ? "avx2 " : ""), (detected.avx512bw ? "avx512bw " : ""), endl, endl;
+
+  cout << "  ", padstring("Operation", -24), "  ", padstring("k8", 10), "  ", padstring("host", 10), "  ", padstring("speedup", 8), endl;
+
+  foreach (i, lengthof(benchmarks)) {
+    const BitBenchmark& b = benchmarks[i];
+    W64 basesum = 0;
+    W64 hostsum = 0;
+
+    setzero(host_cpu);
+    double basecycles = time_benchmark(b, basesum);
+
+    host_cpu = detected;
+    double hostcycles = time_benchmark(b, hostsum);
+
+    cout << "  ", padstring(b.name, -24), "  ",
+      floatstring(basecycles, 10, 3), "  ", floatstring(hostcycles, 10, 3), "  ",
+      floatstring(basecycles / hostcycles, 7, 2), "x",
+      ((basesum != hostsum) ? "  (MISMATCH)" : ""), endl;
+  }
+
+  cout << endl, "(cycles per operation, best of ", passes, " passes)", endl;
+
+  return 0;
+}
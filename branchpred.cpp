@@ -426,6 +426,19 @@ void BranchPredictorInterface::annulras(const PredictorUpdate& predinfo) {
 
 void BranchPredictorInterface::flush() { }
 
+size_t BranchPredictorInterface::state_size() {
+  return sizeof(BranchPredictorImplementation);
+}
+
+void BranchPredictorInterface::save(odstream& os) const {
+  os.write(impl, sizeof(BranchPredictorImplementation));
+}
+
+bool BranchPredictorInterface::restore(idstream& is) {
+  if (!impl) init();
+  return (is.read(impl, sizeof(BranchPredictorImplementation)) == sizeof(BranchPredictorImplementation));
+}
+
 ostream& operator <<(ostream& os, const BranchPredictorInterface& branchpred) {
   os << branchpred.impl->ras;
   return os;
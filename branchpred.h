@@ -71,6 +71,10 @@ struct BranchPredictorInterface {
   void updateras(PredictorUpdate& predinfo, W64 branchaddr);
   void annulras(const PredictorUpdate& predinfo);
   void flush();
+  // Raw predictor tables for checkpoints:
+  static size_t state_size();
+  void save(odstream& os) const;
+  bool restore(idstream& is);
 };
 
 ostream& operator <<(ostream& os, const BranchPredictorInterface& branchpred);
@@ -1029,6 +1029,34 @@ DataStoreNodeTemplate::DataStoreNodeTemplate(idstream& is) {
   }
 }
 
+DataStoreNodeTemplate::DataStoreNodeTemplate(const byte*& p) {
+  memcpy((DataStoreNodeTemplateBase*)this, p, sizeof(DataStoreNodeTemplateBase));
+  p += sizeof(DataStoreNodeTemplateBase);
+  assert(magic == DataStoreNodeTemplateBase::MAGIC);
+  assert(length == sizeof(DataStoreNodeTemplateBase));
+
+  parent = null;
+
+  W16 n;
+  memcpy(&n, p, sizeof(n)); p += sizeof(n);
+  name = new char[n+1]; memcpy(name, p, n); name[n] = 0; p += n;
+
+  labels = null;
+  if (labeled_histogram) {
+    labels = new char*[count];
+    foreach (i, count) {
+      memcpy(&n, p, sizeof(n)); p += sizeof(n);
+      labels[i] = new char[n+1]; memcpy(labels[i], p, n); labels[i][n] = 0; p += n;
+    }
+  }
+
+  subnodes.resize(subcount);
+
+  foreach (i, subcount) {
+    subnodes[i] = new DataStoreNodeTemplate(p);
+  }
+}
+
 //
 // Reconstruct a stats tree from its template and an array of words
 // representing the tree in depth first traversal order, in a format
@@ -1105,6 +1133,58 @@ DataStoreNode* DataStoreNodeTemplate::reconstruct(const W64*& p) const {
   return ds;
 }
 
+W64 DataStoreNodeTemplate::words() const {
+  switch (type) {
+  case DS_NODE_TYPE_NULL: {
+    W64 n = 0;
+    foreach (i, subnodes.length) n += subnodes[i]->words();
+    return n;
+  }
+  case DS_NODE_TYPE_INT:
+  case DS_NODE_TYPE_FLOAT:
+    return count;
+  case DS_NODE_TYPE_STRING:
+    return (limit / 8) * count;
+  default:
+    assert(false);
+  }
+
+  return 0;
+}
+
+const DataStoreNodeTemplate* DataStoreNodeTemplate::searchpath(const char* path, W64& offset) const {
+  dynarray<char*> tokens;
+
+  if (path[0] == '/') path++;
+
+  char* pbase = strdup(path);
+  tokens.tokenize(pbase, "/.");
+
+  const DataStoreNodeTemplate* dst = this;
+  offset = 0;
+
+  foreach (i, tokens.count()) {
+    const DataStoreNodeTemplate* found = null;
+
+    foreach (j, dst->subnodes.length) {
+      const DataStoreNodeTemplate* sub = dst->subnodes[j];
+      if (strequal(sub->name, tokens[i])) { found = sub; break; }
+      offset += sub->words();
+    }
+
+    if (!found) {
+      free(pbase);
+      return null;
+    }
+
+    dst = found;
+  }
+
+  free(pbase);
+
+  return dst;
+}
+
 //
 // Subtract two arrays of words representing the tree in depth first
 // traversal order, in a format identical to the C struct generated
@@ -1144,16 +1224,148 @@ void DataStoreNodeTemplate::subtract(W64*& p, W64*& psub) const {
   }
 }
 
+void DataStoreNodeTemplate::addscaled(W64*& p, const W64*& pa, const W64*& pb, double scale) const {
+  switch (type) {
+  case DS_NODE_TYPE_NULL: {
+    foreach (i, subnodes.length) {
+      subnodes[i]->addscaled(p, pa, pb, scale);
+    }
+    break;
+  }
+  case DS_NODE_TYPE_INT: {
+    foreach (i, count) p[i] += (W64s)math::round((double)(W64s)(pa[i] - pb[i]) * scale);
+    p += count;
+    pa += count;
+    pb += count;
+    break;
+  }
+  case DS_NODE_TYPE_FLOAT: {
+    foreach (i, count) ((double*)p)[i] += (((const double*)pa)[i] - ((const double*)pb)[i]) * scale;
+    p += count;
+    pa += count;
+    pb += count;
+    break;
+  }
+  case DS_NODE_TYPE_STRING: {
+    assert(count == 1);
+    assert((limit % 8) == 0);
+    memcpy(p, pa, limit);
+    p += (limit / 8);
+    pa += (limit / 8);
+    pb += (limit / 8);
+    break;
+  }
+  default:
+    assert(false);
+  }
+}
+
+void DataStoreNodeTemplate::addrepeated(W64*& p, const W64*& pbase, W64 repeat) const {
+  switch (type) {
+  case DS_NODE_TYPE_NULL: {
+    foreach (i, subnodes.length) {
+      subnodes[i]->addrepeated(p, pbase, repeat);
+    }
+    break;
+  }
+  case DS_NODE_TYPE_INT: {
+    foreach (i, count) p[i] += (p[i] - pbase[i]) * repeat;
+    p += count;
+    pbase += count;
+    break;
+  }
+  case DS_NODE_TYPE_FLOAT: {
+    p += count;
+    pbase += count;
+    break;
+  }
+  case DS_NODE_TYPE_STRING: {
+    p += (limit / 8) * count;
+    pbase += (limit / 8) * count;
+    break;
+  }
+  default:
+    assert(false);
+  }
+}
+
 //
 // StatsFileWriter
 //
-void StatsFileWriter::open(const char* filename, const void* dst, size_t dstsize, int record_size) {
+//
+// Delta record encoding for PTLdst03 (see datastore.h)
+//
+static inline byte* put_varint(byte* p, W64 v) {
+  while (v >= 0x80) {
+    *p++ = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+static inline const byte* get_varint(const byte* p, const byte* end, W64& v) {
+  v = 0;
+  int shift = 0;
+  while (p < end) {
+    byte b = *p++;
+    v |= ((W64)(b & 0x7f)) << shift;
+    if (!(b & 0x80)) return p;
+    shift += 7;
+    if unlikely (shift >= 64) break;
+  }
+  return null;
+}
+
+// Worst case: every word changes, with a one byte skip and a ten byte difference
+static inline size_t max_delta_record_bytes(size_t words) {
+  return words * 11;
+}
+
+static int encode_delta_record(byte* out, const W64* record, const W64* base, size_t words) {
+  byte* p = out;
+  W64 skip = 0;
+
+  foreach (i, words) {
+    W64 d = record[i] - ((base) ? base[i] : 0);
+    if likely (!d) { skip++; continue; }
+    p = put_varint(p, skip);
+    p = put_varint(p, (d << 1) ^ (W64)(((W64s)d) >> 63));
+    skip = 0;
+  }
+
+  return p - out;
+}
+
+// Adds the encoded differences into record, which must hold the previous record (or zeros for a keyframe)
+static bool decode_delta_record(W64* record, size_t words, const byte* p, const byte* end) {
+  size_t i = 0;
+
+  while (p < end) {
+    W64 skip;
+    W64 zz;
+    p = get_varint(p, end, skip);
+    if unlikely (!p) return false;
+    p = get_varint(p, end, zz);
+    if unlikely (!p) return false;
+    i += skip;
+    if unlikely (i >= words) return false;
+    record[i++] += (zz >> 1) ^ (-(zz & 1));
+  }
+
+  return true;
+}
+
+void StatsFileWriter::open(const char* filename, const void* dst, size_t dstsize, int record_size, int keyframe_interval) {
   close();
   os.open(filename);
 
   namelist = null;
 
-  header.magic = StatsFileHeader::MAGIC;
+  // Delta encoding works on whole 64-bit words:
+  if (record_size % sizeof(W64)) keyframe_interval = 0;
+
+  header.magic = (keyframe_interval) ? StatsFileHeader::MAGIC_DELTA : StatsFileHeader::MAGIC;
   header.template_offset = sizeof(StatsFileHeader);
   header.template_size = dstsize;
   header.record_offset = ceil(header.template_offset + header.template_size, PAGE_SIZE);
@@ -1161,15 +1373,25 @@ void StatsFileWriter::open(const char* filename, const void* dst, size_t dstsize
   header.record_count = 0; // filled in later
   header.index_offset = 0; // filled in later
   header.index_count = 0; // filled in later
+  header.snapshot_table_offset = 0; // filled in later
+  header.keyframe_interval = keyframe_interval;
   os << header;
 
   os.seek(header.template_offset);
   os.write(dst, dstsize);
 
   os.seek(header.record_offset);
+
+  record_end = header.record_offset;
+  snapshots.clear();
+
+  if (keyframe_interval) {
+    prevrecord = new byte[record_size];
+    packbuf = new byte[max_delta_record_bytes(record_size / sizeof(W64))];
+  }
 }
 
-void StatsFileWriter::write(const void* record, const char* name) {
+void StatsFileWriter::write(const void* record, const char* name, W64 cycle, W64 insns) {
   if (!os.ok()) return;
 
   if (name) {
@@ -1178,15 +1400,35 @@ void StatsFileWriter::write(const void* record, const char* name) {
     header.index_count++;
   }
 
-  os.write(record, header.record_size);
+  StatsSnapshotIndexEntry entry;
+  entry.offset = record_end;
+  entry.cycle = cycle;
+  entry.insns = insns;
+  snapshots.push(entry);
+
+  if (header.keyframe_interval) {
+    bool keyframe = ((header.record_count % header.keyframe_interval) == 0);
+    int n = encode_delta_record(packbuf, (const W64*)record, (keyframe) ? null : (const W64*)prevrecord, header.record_size / sizeof(W64));
+    memcpy(prevrecord, record, header.record_size);
+    os.write(packbuf, n);
+    record_end += n;
+  } else {
+    os.write(record, header.record_size);
+    record_end += header.record_size;
+  }
+
   header.record_count++;
 }
 
 void StatsFileWriter::flush() {
   if (!os.ok()) return;
 
+  header.snapshot_table_offset = record_end;
+  os.seek(record_end);
+  os.write(snapshots.data, snapshots.count() * sizeof(StatsSnapshotIndexEntry));
+
   header.index_offset = os.where();
-  assert(header.index_offset == (header.record_offset + (header.record_count * header.record_size)));
+  assert(header.index_offset == (record_end + (header.record_count * sizeof(StatsSnapshotIndexEntry))));
 
   StatsIndexRecordLink* namelink = namelist;
   int n = 0;
@@ -1205,7 +1447,7 @@ void StatsFileWriter::flush() {
   os.seek(0);
   os << header;
 
-  os.seek(header.record_offset + (header.record_count * header.record_size));
+  os.seek(record_end);
 }
 
 void StatsFileWriter::close() {
@@ -1228,6 +1470,10 @@ void StatsFileWriter::close() {
   assert(n == header.index_count);
   namelist = null;
 
+  if (prevrecord) { delete[] prevrecord; prevrecord = null; }
+  if (packbuf) { delete[] packbuf; packbuf = null; }
+  snapshots.clear();
+
   os.flush();
   os.close();
 }
@@ -1253,15 +1499,78 @@ bool StatsFileReader::open(const char* filename) {
     return false;
   }
 
-  if (header.magic != StatsFileHeader::MAGIC) {
+  if ((header.magic != StatsFileHeader::MAGIC) && (header.magic != StatsFileHeader::MAGIC_DELTA)) {
     cerr << "StatsFileReader: header magic or version mismatch", endl;
     close();
     return false;
   }
 
+  //
+  // Map the whole file: PTLdst01 records are reconstructed in place
+  // and the snapshot table is used where it lies.
+  //
+  mapsize = is.size();
+  map = (byte*)is.mmap(mapsize);
+
+  if unlikely (!map) {
+    cerr << "StatsFileReader: cannot map ", filename, endl;
+    close();
+    return false;
+  }
+
+  if ((header.record_offset + (delta_encoded() ? 0 : (header.record_count * header.record_size))) > mapsize) {
+    cerr << "StatsFileReader: file is truncated", endl;
+    close();
+    return false;
+  }
+
   buf = new byte[header.record_size];
   bufsub = new byte[header.record_size];
 
+  // Files from before the snapshot table was added have a shorter header:
+  bool has_table = (header.template_offset >= sizeof(StatsFileHeader)) && (header.snapshot_table_offset != 0);
+
+  if (has_table) {
+    if unlikely ((header.snapshot_table_offset + (header.record_count * sizeof(StatsSnapshotIndexEntry))) > mapsize) {
+      cerr << "StatsFileReader: error reading snapshot table", endl;
+      close();
+      return false;
+    }
+    snapshots = (const StatsSnapshotIndexEntry*)(map + header.snapshot_table_offset);
+  } else if (!delta_encoded()) {
+    // No cycle or instruction counts are known, so only lookups by uuid and name work:
+    oldsnapshots = new StatsSnapshotIndexEntry[header.record_count];
+    foreach (i, header.record_count) {
+      oldsnapshots[i].offset = header.record_offset + (i * header.record_size);
+      oldsnapshots[i].cycle = 0;
+      oldsnapshots[i].insns = 0;
+    }
+    snapshots = oldsnapshots;
+  } else {
+    cerr << "StatsFileReader: delta coded file has no snapshot table", endl;
+    close();
+    return false;
+  }
+
+  // The totals can go backwards (e.g. after a stats reset), which rules out a binary search:
+  cycles_monotonic = 1;
+  insns_monotonic = 1;
+  foreach (i, header.record_count) {
+    if (!i) continue;
+    cycles_monotonic &= (snapshots[i].cycle >= snapshots[i-1].cycle);
+    insns_monotonic &= (snapshots[i].insns >= snapshots[i-1].insns);
+  }
+
+  if (delta_encoded()) {
+    if unlikely (!header.keyframe_interval) {
+      cerr << "StatsFileReader: delta coded file has no keyframes", endl;
+      close();
+      return false;
+    }
+    recbuf = new byte[header.record_size];
+    recbuf_uuid = limits<W64>::max;
+  }
+
   is.seek(header.template_offset);
   dst = new DataStoreNodeTemplate(is);
 
@@ -1296,31 +1605,56 @@ bool StatsFileReader::open(const char* filename) {
   return true;
 }
 
-DataStoreNode* StatsFileReader::get(W64 uuid) {
+const W64* StatsFileReader::record(W64 uuid) {
   if unlikely (uuid >= header.record_count) return null;
-  W64 offset = header.record_offset + (header.record_size * uuid);
 
-  is.seek(offset);
+  if (!delta_encoded()) return (const W64*)(map + snapshots[uuid].offset);
 
-  if unlikely (is.read(buf, header.record_size) != header.record_size) return null;
+  //
+  // Continue from the cached record if it is in the same run since the
+  // last keyframe; otherwise decode forward from that keyframe.
+  //
+  W64 keyframe = uuid - (uuid % header.keyframe_interval);
+  W64 first;
+
+  if ((recbuf_uuid != limits<W64>::max) && inrange(recbuf_uuid, keyframe, uuid)) {
+    first = recbuf_uuid + 1;
+  } else {
+    memset(recbuf, 0, header.record_size);
+    first = keyframe;
+  }
+
+  for (W64 i = first; i <= uuid; i++) {
+    // The last record ends where the snapshot table starts:
+    W64 start = snapshots[i].offset;
+    W64 end = (i == (header.record_count-1)) ? header.snapshot_table_offset : snapshots[i+1].offset;
+    recbuf_uuid = limits<W64>::max;
+    if unlikely ((start > end) || (end > mapsize)) return null;
+    if unlikely (!decode_delta_record((W64*)recbuf, header.record_size / sizeof(W64), map + start, map + end)) return null;
+    recbuf_uuid = i;
+  }
+
+  return (const W64*)recbuf;
+}
+
+DataStoreNode* StatsFileReader::get(W64 uuid) {
+  const W64* p = record(uuid);
+  if unlikely (!p) return null;
 
-  const W64* p = (const W64*)buf;
   DataStoreNode* dsn = dst->reconstruct(p);
 
   return dsn;
 }
 
 DataStoreNode* StatsFileReader::getdelta(W64 uuid, W64 uuidsub) {
-  if unlikely (uuid >= header.record_count) return null;
-  if unlikely (uuidsub >= header.record_count) return null;
-  W64 offset = header.record_offset + (header.record_size * uuid);
-  W64 offsetsub = header.record_offset + (header.record_size * uuidsub);
-
-  is.seek(offset);
-  if unlikely (is.read(buf, header.record_size) != header.record_size) return null;
+  // Decode the older snapshot first so delta coded files usually decode forward:
+  const W64* rec = record(uuidsub);
+  if unlikely (!rec) return null;
+  memcpy(bufsub, rec, header.record_size);
 
-  is.seek(offsetsub);
-  if unlikely (is.read(bufsub, header.record_size) != header.record_size) return null;
+  rec = record(uuid);
+  if unlikely (!rec) return null;
+  memcpy(buf, rec, header.record_size);
 
   const W64* p = (const W64*)buf;
   W64* porig = (W64*)p;
@@ -1333,7 +1667,57 @@ DataStoreNode* StatsFileReader::getdelta(W64 uuid, W64 uuidsub) {
   return dsn;
 }
 
+//
+// Find the last snapshot taken at or before the given cycle or
+// instruction count. If the totals never decrease, this is a binary
+// search of the snapshot table; otherwise it is the snapshot with
+// the highest count not past the target (the latest one on a tie).
+//
+static inline W64 snapshot_time(const StatsSnapshotIndexEntry& entry, bool insns) {
+  return (insns) ? entry.insns : entry.cycle;
+}
+
+static W64s find_snapshot_at(const StatsSnapshotIndexEntry* snapshots, W64 count, W64 target, bool insns, bool monotonic) {
+  if (!monotonic) {
+    W64s best = -1;
+    foreach (i, count) {
+      W64 t = snapshot_time(snapshots[i], insns);
+      if ((t <= target) && ((best < 0) || (t >= snapshot_time(snapshots[best], insns)))) best = i;
+    }
+    return best;
+  }
+
+  if unlikely ((!count) || (snapshot_time(snapshots[0], insns) > target)) return -1;
+
+  W64 lo = 0;
+  W64 hi = count;
+
+  while ((hi - lo) > 1) {
+    W64 mid = (lo + hi) / 2;
+    if (snapshot_time(snapshots[mid], insns) <= target) lo = mid; else hi = mid;
+  }
+
+  return lo;
+}
+
+W64s StatsFileReader::uuid_of_cycle(W64 cycle) const {
+  if unlikely (!timed()) return -1;
+  return find_snapshot_at(snapshots, header.record_count, cycle, false, cycles_monotonic);
+}
+
+W64s StatsFileReader::uuid_of_insns(W64 insns) const {
+  if unlikely (!timed()) return -1;
+  return find_snapshot_at(snapshots, header.record_count, insns, true, insns_monotonic);
+}
+
+//
+// Snapshots are named by uuid, by name, or by time as "cycle:<n>"
+// or "insns:<n>" (the last snapshot at or before that point).
+//
 W64s StatsFileReader::uuid_of_name(const char* name) {
+  if (!strncmp(name, "cycle:", 6)) return uuid_of_cycle(strtoll(name + 6, (char**)null, 10));
+  if (!strncmp(name, "insns:", 6)) return uuid_of_insns(strtoll(name + 6, (char**)null, 10));
+
   bool all_nums = 1;
   W64 id = 0;
   foreach (i, strlen(name)) {
@@ -1366,10 +1750,86 @@ DataStoreNode* StatsFileReader::getdelta(const char* name, const char* namesub)
   return getdelta(uuid, uuidsub);
 }
 
+//
+// Look up the subtree in the template first, so only its part of the
+// record is subtracted and reconstructed. Paths the template cannot
+// resolve (e.g. histogram labels) fall back to the whole tree.
+//
+DataStoreNode* StatsFileReader::get(const char* name, const char* path) {
+  W64s uuid = uuid_of_name(name);
+  if unlikely (uuid < 0) return null;
+
+  W64 offset;
+  const DataStoreNodeTemplate* sub = dst->searchpath(path, offset);
+
+  if (sub) {
+    const W64* p = record(uuid);
+    if unlikely (!p) return null;
+    p += offset;
+    return sub->reconstruct(p);
+  }
+
+  DataStoreNode* root = get(uuid);
+  if unlikely (!root) return null;
+
+  DataStoreNode* ds = root->searchpath(path);
+  if (ds && ds->parent) {
+    ds->parent->remove(ds->name);
+    ds->parent = null;
+  }
+
+  if (ds != root) delete root;
+  return ds;
+}
+
+DataStoreNode* StatsFileReader::getdelta(const char* name, const char* namesub, const char* path) {
+  W64s uuid = uuid_of_name(name);
+  W64s uuidsub = uuid_of_name(namesub);
+  if unlikely ((uuid < 0) || (uuidsub < 0)) return null;
+
+  W64 offset;
+  const DataStoreNodeTemplate* sub = dst->searchpath(path, offset);
+
+  if (sub) {
+    W64 bytes = sub->words() * sizeof(W64);
+
+    const W64* rec = record(uuidsub);
+    if unlikely (!rec) return null;
+    memcpy(bufsub, rec + offset, bytes);
+
+    rec = record(uuid);
+    if unlikely (!rec) return null;
+    memcpy(buf, rec + offset, bytes);
+
+    W64* porig = (W64*)buf;
+    W64* psub = (W64*)bufsub;
+    sub->subtract(porig, psub);
+
+    const W64* p = (const W64*)buf;
+    return sub->reconstruct(p);
+  }
+
+  DataStoreNode* root = getdelta(uuid, uuidsub);
+  if unlikely (!root) return null;
+
+  DataStoreNode* ds = root->searchpath(path);
+  if (ds && ds->parent) {
+    ds->parent->remove(ds->name);
+    ds->parent = null;
+  }
+
+  if (ds != root) delete root;
+  return ds;
+}
+
 void StatsFileReader::close() {
   if (dst) { delete dst; dst = null; }
   if (buf) { delete[] buf; buf = null; }
   if (bufsub) { delete[] bufsub; bufsub = null; }
+  if (recbuf) { delete[] recbuf; recbuf = null; }
+  if (oldsnapshots) { delete[] oldsnapshots; oldsnapshots = null; }
+  snapshots = null;
+  if (map) { sys_munmap(map, mapsize); map = null; mapsize = 0; }
 
   name_to_uuid.clear();
 
@@ -1389,6 +1849,12 @@ ostream& StatsFileReader::print(ostream& os) const {
   os << "Data store header version '", magic, "'", endl;
   os << "  Template at:  ", intstring(header.template_offset, 16), ", ", intstring(header.template_size, 16), " bytes", endl;
   os << "  Records at:   ", intstring(header.record_offset, 16), ", ", intstring(header.record_size, 16), " bytes", endl;
+  if (delta_encoded()) {
+    os << "  Delta coded:  ", intstring(header.snapshot_table_offset - header.record_offset, 16), " bytes, keyframe every ", header.keyframe_interval, " records", endl;
+  }
+  if (timed()) {
+    os << "  Snapshots at: ", intstring(header.snapshot_table_offset, 16), ", cycles ", snapshots[0].cycle, " to ", snapshots[header.record_count-1].cycle, endl;
+  }
   os << "  Index at:     ", intstring(header.index_offset, 16), ", ", intstring(header.index_count, 16), " entries", endl;
   os << "  Record count: ", intstring(header.record_count, 16), " records", endl;
   os << endl;
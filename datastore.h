@@ -575,6 +575,12 @@ struct DataStoreNodeTemplate: public DataStoreNodeTemplateBase {
   //
   DataStoreNodeTemplate(idstream& is);
 
+  //
+  // Same, from a copy of the binary format in memory (e.g. linked into
+  // the simulator); p is advanced past the tree
+  //
+  DataStoreNodeTemplate(const byte*& p);
+
   //
   // Reconstruct a stats tree from its template and an array of words
   // representing the tree in depth first traversal order, in a format
@@ -582,6 +588,17 @@ struct DataStoreNodeTemplate: public DataStoreNodeTemplateBase {
   //
   DataStoreNode* reconstruct(const W64*& p) const;
 
+  //
+  // Number of words in the array representing this subtree
+  //
+  W64 words() const;
+
+  //
+  // Find the subtree at <path> (as in DataStoreNode::searchpath()) and
+  // the word offset of its data within the array for this tree
+  //
+  const DataStoreNodeTemplate* searchpath(const char* path, W64& offset) const;
+
   //
   // Subtract two arrays of words representing the tree in depth first
   // traversal order, in a format identical to the C struct generated
@@ -590,6 +607,22 @@ struct DataStoreNodeTemplate: public DataStoreNodeTemplateBase {
   // the raw data. Subtraction is only done on W64 and double types.
   //
   void subtract(W64*& p, W64*& psub) const;
+
+  //
+  // Add the difference of two raw arrays of words (pa - pb), scaled
+  // by <scale>, into the raw array p, using the same walk as subtract().
+  // Integers are rounded to the nearest count after scaling. Strings
+  // are copied from pa.
+  //
+  void addscaled(W64*& p, const W64*& pa, const W64*& pb, double scale) const;
+
+  //
+  // Add the difference of two raw arrays of words (p - pbase) into p
+  // another <repeat> times, using the same walk as subtract(). Only
+  // integer counters are repeated: floating point and string fields
+  // are left alone.
+  //
+  void addrepeated(W64*& p, const W64*& pbase, W64 repeat) const;
 };
 
 static inline odstream& operator <<(odstream& os, const DataStoreNodeTemplate& node) {
@@ -609,8 +642,33 @@ struct StatsFileHeader {
   W64 record_count;
   W64 index_offset;
   W64 index_count;
+  W64 snapshot_table_offset;
+  // MAGIC_DELTA files only:
+  W64 keyframe_interval;
 
   static const W64 MAGIC = 0x31307473644c5450ULL; // 'PTLdst01'
+  static const W64 MAGIC_DELTA = 0x33307473644c5450ULL; // 'PTLdst03'
+};
+
+//
+// In PTLdst03 files, each record is stored as the difference between
+// its 64-bit words and those of the previous record: pairs of varints
+// giving the number of unchanged words to skip and the zigzag encoded
+// difference of the next word. Every <keyframe_interval>th record is
+// a keyframe, encoded against an all-zero record, so reading any
+// record decodes at most one run of records since its keyframe.
+//
+// In both formats, the snapshot table follows the records: one entry
+// per snapshot uuid, giving its record offset and the cycle and
+// instruction counts it was taken at, so snapshots can be found by
+// time without reading any records. Files written before the table
+// existed have snapshot_table_offset = 0 (or a shorter header).
+//
+
+struct StatsSnapshotIndexEntry {
+  W64 offset;
+  W64 cycle;
+  W64 insns;
 };
 
 struct StatsIndexRecordLink: public selflistlink {
@@ -629,34 +687,59 @@ struct StatsFileWriter {
   odstream os;
   StatsFileHeader header;
   StatsIndexRecordLink* namelist;
+  byte* prevrecord;
+  byte* packbuf;
+  dynarray<StatsSnapshotIndexEntry> snapshots;
+  W64 record_end;
 
-  StatsFileWriter() { }
+  StatsFileWriter() { prevrecord = null; packbuf = null; }
 
-  void open(const char* filename, const void* dst, size_t dstsize, int record_size);
+  void open(const char* filename, const void* dst, size_t dstsize, int record_size, int keyframe_interval = 0);
 
   operator bool() const { return os.ok(); }
   W64 next_uuid() const { return header.record_count; }
 
-  void write(const void* record, const char* name = null);
+  void write(const void* record, const char* name = null, W64 cycle = 0, W64 insns = 0);
   void flush();
   void close();
 };
 
+//
+// The reader maps the whole file and reconstructs PTLdst01 records
+// directly from the mapping; only getdelta() copies a record.
+//
 struct StatsFileReader {
   idstream is;
   StatsFileHeader header;
+  byte* map;
+  W64 mapsize;
   byte* buf;
   byte* bufsub;
   DataStoreNodeTemplate* dst;
   Hashtable<const char*, W64, 256> name_to_uuid;
-
-  StatsFileReader() { dst = null; buf = null; bufsub = null; }
+  // Points into the mapping, or to a synthesized table for older files:
+  const StatsSnapshotIndexEntry* snapshots;
+  StatsSnapshotIndexEntry* oldsnapshots;
+  // Set if the cycle and instruction totals never decrease from one snapshot to the next
+  bool cycles_monotonic;
+  bool insns_monotonic;
+  // PTLdst03 files only: the most recently decoded record is kept for sequential access
+  byte* recbuf;
+  W64 recbuf_uuid;
+
+  StatsFileReader() { map = null; mapsize = 0; dst = null; buf = null; bufsub = null; snapshots = null; oldsnapshots = null; cycles_monotonic = 1; insns_monotonic = 1; recbuf = null; }
 
   bool open(const char* filename);
 
   void close();
 
+  bool delta_encoded() const { return (header.magic == StatsFileHeader::MAGIC_DELTA); }
+  bool timed() const { return (!oldsnapshots); }
+  const W64* record(W64 uuid);
+
   W64s uuid_of_name(const char* name);
+  W64s uuid_of_cycle(W64 cycle) const;
+  W64s uuid_of_insns(W64 insns) const;
 
   DataStoreNode* get(W64 uuid);
   DataStoreNode* getdelta(W64 uuid, W64 uuidsub);
@@ -664,6 +747,10 @@ struct StatsFileReader {
   DataStoreNode* get(const char* name);
   DataStoreNode* getdelta(const char* name, const char* namesub);
 
+  // Reconstruct only the subtree at <path>; the caller owns the result
+  DataStoreNode* get(const char* name, const char* path);
+  DataStoreNode* getdelta(const char* name, const char* namesub, const char* path);
+
   ostream& print(ostream& os) const;
 };
 
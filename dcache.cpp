@@ -219,6 +219,33 @@ void MissBuffer<SIZE>::reset() {
   }
   freemap.setall();
   count = 0;
+  clocks = 0;
+  foreach (i, MISSBUF_WHEEL_SIZE) wheel[i] = 0;
+  wheelmap = 0;
+}
+
+//
+// Move miss buffer entry <idx> into <state>, and schedule
+// it to be clocked again <cycles> from now.
+//
+template <int SIZE>
+void MissBuffer<SIZE>::schedule(int idx, int state, int cycles) {
+  assert(inrange(cycles, 1, MISSBUF_WHEEL_SIZE-1));
+  Entry& mb = missbufs[idx];
+  mb.state = state;
+  mb.due = clocks + cycles;
+  int slot = wheelslot(mb.due);
+  wheel[slot][idx] = 1;
+  wheelmap[slot] = 1;
+}
+
+template <int SIZE>
+void MissBuffer<SIZE>::unschedule(int idx) {
+  Entry& mb = missbufs[idx];
+  if unlikely (mb.state == STATE_IDLE) return;
+  int slot = wheelslot(mb.due);
+  wheel[slot][idx] = 0;
+  if (!wheel[slot]) wheelmap[slot] = 0;
 }
 
 
@@ -270,6 +297,7 @@ void MissBuffer<SIZE>::reset(int threadid) {
       // Drop empty MBEs that had only wakeups for the flushed thread
       if (logable(6)) logfile << "[vcpu ", threadid, "] reset missbuf slot ", i, ": for rob", mb.rob, endl;
       assert(!freemap[i]);
+      unschedule(i);
       mb.reset();
       freemap[i] = 1;
       count--;
@@ -348,32 +376,28 @@ int MissBuffer<SIZE>::initiate_miss(W64 addr, bool hit_in_L2, bool icache, int r
 
   if likely (hit_in_L2) {
     if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", idx, ": enter state deliver to L1 on ", (void*)(Waddr)addr, " (iter ", iterations, ")", endl;
-    mb.state = STATE_DELIVER_TO_L1;
-    mb.cycles = L2_LATENCY;
+    schedule(idx, STATE_DELIVER_TO_L1, L2_LATENCY);
 
-    if unlikely (icache) per_context_dcache_stats_update(mb.threadid, fetch.hit.L2++); else per_context_dcache_stats_update(mb.threadid, load.hit.L2++);
+    if unlikely (icache) per_context_dcache_stats_update(hierarchy.vcpuof(mb.threadid), fetch.hit.L2++); else per_context_dcache_stats_update(hierarchy.vcpuof(mb.threadid), load.hit.L2++);
     return idx;
   }
 #ifdef ENABLE_L3_CACHE
   bool L3hit = hierarchy.L3.probe(addr);
   if likely (L3hit) {
     if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", idx, ": enter state deliver to L2 on ", (void*)(Waddr)addr, " (iter ", iterations, ")", endl;
-    mb.state = STATE_DELIVER_TO_L2;
-    mb.cycles = L3_LATENCY;
-    if (icache) per_context_dcache_stats_update(mb.threadid, fetch.hit.L3++); else per_context_dcache_stats_update(mb.threadid, load.hit.L3++);
+    schedule(idx, STATE_DELIVER_TO_L2, L3_LATENCY);
+    if (icache) per_context_dcache_stats_update(hierarchy.vcpuof(mb.threadid), fetch.hit.L3++); else per_context_dcache_stats_update(hierarchy.vcpuof(mb.threadid), load.hit.L3++);
     return idx;
   }
 
   if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", idx, ": enter state deliver to L3 on ", (void*)(Waddr)addr, " (iter ", iterations, ")", endl;
-  mb.state = STATE_DELIVER_TO_L3;
-  mb.cycles = MAIN_MEM_LATENCY;
+  schedule(idx, STATE_DELIVER_TO_L3, MAIN_MEM_LATENCY);
 #else
   // L3 cache disabled
   if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", idx, ": enter state deliver to L2 on ", (void*)(Waddr)addr, " (iter ", iterations, ")", endl;
-  mb.state = STATE_DELIVER_TO_L2;
-  mb.cycles = MAIN_MEM_LATENCY;
+  schedule(idx, STATE_DELIVER_TO_L2, MAIN_MEM_LATENCY);
 #endif
-  if unlikely (icache) per_context_dcache_stats_update(mb.threadid, fetch.hit.mem++); else per_context_dcache_stats_update(mb.threadid, load.hit.mem++);
+  if unlikely (icache) per_context_dcache_stats_update(hierarchy.vcpuof(mb.threadid), fetch.hit.mem++); else per_context_dcache_stats_update(hierarchy.vcpuof(mb.threadid), load.hit.mem++);
 
   return idx;
 }
@@ -406,75 +430,97 @@ void MissBuffer<SIZE>::clock() {
 
   bool DEBUG = logable(6);
 
-  foreach (i, SIZE) {
+  clocks++;
+  int slot = wheelslot(clocks);
+  if likely (!wheelmap[slot]) return;
+
+  bitvec<SIZE> due = wheel[slot];
+  wheel[slot] = 0;
+  wheelmap[slot] = 0;
+
+  for (int i = due.lsb(-1); i >= 0; i = due.nextlsb(i, -1)) {
     Entry& mb = missbufs[i];
+    assert(mb.due == clocks);
+
     switch (mb.state) {
-    case STATE_IDLE:
-      break;
 #ifdef ENABLE_L3_CACHE
     case STATE_DELIVER_TO_L3: {
-      if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": deliver ", (void*)(Waddr)mb.addr, " to L3 (", mb.cycles, " cycles left) (iter ", iterations, ")", endl;
-      mb.cycles--;
-      if unlikely (!mb.cycles) {
-        hierarchy.L3.validate(mb.addr);
-        mb.cycles = L3_LATENCY;
-        mb.state = STATE_DELIVER_TO_L2;
-        stats.dcache.missbuf.deliver.mem_to_L3++;
-      }
+      if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered ", (void*)(Waddr)mb.addr, " to L3 (iter ", iterations, ")", endl;
+      hierarchy.L3.validate(mb.addr);
+      schedule(i, STATE_DELIVER_TO_L2, L3_LATENCY);
+      stats.dcache.missbuf.deliver.mem_to_L3++;
       break;
     }
 #endif
     case STATE_DELIVER_TO_L2: {
-      if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": deliver ", (void*)(Waddr)mb.addr, " to L2 (", mb.cycles, " cycles left) (iter ", iterations, ")", endl;
-      mb.cycles--;
-      if unlikely (!mb.cycles) {
-        if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered to L2 (map ", mb.lfrqmap, ")", endl;
-        hierarchy.L2.validate(mb.addr);
-        mb.cycles = L2_LATENCY;
-        mb.state = STATE_DELIVER_TO_L1;
-        stats.dcache.missbuf.deliver.L3_to_L2++;
-      }
+      if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered to L2 (map ", mb.lfrqmap, ")", endl;
+      hierarchy.L2.validate(mb.addr);
+      schedule(i, STATE_DELIVER_TO_L1, L2_LATENCY);
+      stats.dcache.missbuf.deliver.L3_to_L2++;
       break;
     }
     case STATE_DELIVER_TO_L1: {
-      if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": deliver ", (void*)(Waddr)mb.addr, " to L1 (", mb.cycles, " cycles left) (iter ", iterations, ")", endl;
-      mb.cycles--;
-      if unlikely (!mb.cycles) {
-        if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered to L1 switch (map ", mb.lfrqmap, ")", endl;
-
-        if likely (mb.dcache) {
-          if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered ", (void*)(Waddr)mb.addr, " to L1 dcache (map ", mb.lfrqmap, ")", endl;
-          // If the L2 line size is bigger than the L1 line size, this will validate multiple lines in the L1 when an L2 line arrives:
-          // foreach (i, L2_LINE_SIZE / L1_LINE_SIZE) L1.validate(mb.addr + i*L1_LINE_SIZE, bitvec<L1_LINE_SIZE>().setall());
-          hierarchy.L1.validate(mb.addr, bitvec<L1_LINE_SIZE>().setall());
-          stats.dcache.missbuf.deliver.L2_to_L1D++;
-          hierarchy.lfrq.wakeup(mb.addr, mb.lfrqmap);
-        }
-        if unlikely (mb.icache) {
-          // Sometimes we can initiate an icache miss on an existing dcache line in the missbuf
-          if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered ", (void*)(Waddr)mb.addr, " to L1 icache", endl;
-          // If the L2 line size is bigger than the L1 line size, this will validate multiple lines in the L1 when an L2 line arrives:
-          // foreach (i, L2_LINE_SIZE / L1I_LINE_SIZE) L1I.validate(mb.addr + i*L1I_LINE_SIZE, bitvec<L1I_LINE_SIZE>().setall());
-          hierarchy.L1I.validate(mb.addr, bitvec<L1I_LINE_SIZE>().setall());
-          stats.dcache.missbuf.deliver.L2_to_L1I++;
-          LoadStoreInfo lsi = 0;
-          lsi.rob = mb.rob;
-          lsi.threadid = mb.threadid;
-          if likely (hierarchy.callback) hierarchy.callback->icache_wakeup(lsi, mb.addr);
-        }
-
-        assert(!freemap[i]);
-        freemap[i] = 1;
-        mb.reset();
-        count--;
-        assert(count >= 0);
+      if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered to L1 switch (map ", mb.lfrqmap, ")", endl;
+
+      if likely (mb.dcache) {
+        if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered ", (void*)(Waddr)mb.addr, " to L1 dcache (map ", mb.lfrqmap, ")", endl;
+        // If the L2 line size is bigger than the L1 line size, this will validate multiple lines in the L1 when an L2 line arrives:
+        // foreach (i, L2_LINE_SIZE / L1_LINE_SIZE) L1.validate(mb.addr + i*L1_LINE_SIZE, bitvec<L1_LINE_SIZE>().setall());
+        hierarchy.L1.validate(mb.addr, bitvec<L1_LINE_SIZE>().setall());
+        stats.dcache.missbuf.deliver.L2_to_L1D++;
+        hierarchy.lfrq.wakeup(mb.addr, mb.lfrqmap);
       }
+      if unlikely (mb.icache) {
+        // Sometimes we can initiate an icache miss on an existing dcache line in the missbuf
+        if (DEBUG) logfile << "[vcpu ", mb.threadid, "] mb", i, ": delivered ", (void*)(Waddr)mb.addr, " to L1 icache", endl;
+        // If the L2 line size is bigger than the L1 line size, this will validate multiple lines in the L1 when an L2 line arrives:
+        // foreach (i, L2_LINE_SIZE / L1I_LINE_SIZE) L1I.validate(mb.addr + i*L1I_LINE_SIZE, bitvec<L1I_LINE_SIZE>().setall());
+        hierarchy.L1I.validate(mb.addr, bitvec<L1I_LINE_SIZE>().setall());
+        stats.dcache.missbuf.deliver.L2_to_L1I++;
+        LoadStoreInfo lsi = 0;
+        lsi.rob = mb.rob;
+        lsi.threadid = mb.threadid;
+        if likely (hierarchy.callback) hierarchy.callback->icache_wakeup(lsi, mb.addr);
+      }
+
+      assert(!freemap[i]);
+      freemap[i] = 1;
+      mb.reset();
+      count--;
+      assert(count >= 0);
       break;
     }
     }
   }
 }
 
+//
+// Number of clock() calls until the first miss buffer entry
+// changes state, or limits<int>::max if no misses are outstanding.
+//
+template <int SIZE>
+int MissBuffer<SIZE>::cycles_to_next_event() const {
+  if likely (!wheelmap) return limits<int>::max;
+
+  int slot = wheelslot(clocks);
+  int next = wheelmap.nextlsb(slot, -1);
+  if (next < 0) next = wheelmap.lsb();
+
+  int cycles = wheelslot(next - slot);
+  return (cycles) ? cycles : MISSBUF_WHEEL_SIZE;
+}
+
+//
+// Advance the miss buffer clock by <delta> cycles without
+// delivering anything: the caller must ensure delta is less
+// than cycles_to_next_event().
+//
+template <int SIZE>
+void MissBuffer<SIZE>::skip_cycles(int delta) {
+  assert(delta < cycles_to_next_event());
+  clocks += delta;
+}
+
 template <int SIZE>
 void MissBuffer<SIZE>::annul_lfrq(int slot) {
   foreach (i, SIZE) {
@@ -492,7 +538,7 @@ ostream& MissBuffer<SIZE>::print(ostream& os) const {
     const Entry& mb = missbufs[i];
     os << "slot ", intstring(i, 2), ": vcpu ", mb.threadid, ", addr ", (void*)(Waddr)mb.addr, " state ", 
       padstring(missbuf_state_names[mb.state], -8), " ", (mb.dcache ? "dcache" : "      "),
-      " ", (mb.icache ? "icache" : "      "), " on ", mb.cycles, " cycles -> lfrq ", mb.lfrqmap, endl;
+      " ", (mb.icache ? "icache" : "      "), " on ", (mb.due - clocks), " cycles -> lfrq ", mb.lfrqmap, endl;
   }
   return os;
 }
@@ -740,7 +786,7 @@ W64 CacheHierarchy::commitstore(const SFR& sfr, int threadid, bool perform_actua
   L2line->valid |= ((W64)sfr.bytemask << lowbits(addr, 6));
 
   if unlikely (!L1line->valid.allset()) {
-    per_context_dcache_stats_update(threadid, store.prefetches++);
+    per_context_dcache_stats_update(vcpuof(threadid), store.prefetches++);
     missbuf.initiate_miss(addr, L2line->valid.allset(), false, 0xffff, threadid);
   }
 
@@ -774,6 +820,24 @@ void CacheHierarchy::clock() {
   missbuf.clock();
 }
 
+//
+// Number of cycles until the cache hierarchy will next do
+// something visible to the core: 0 if any LFRQ entries are
+// waiting to wake up their loads on the next clock().
+//
+int CacheHierarchy::cycles_to_next_event() const {
+  if unlikely (lfrq.ready.nonzero()) return 0;
+  return missbuf.cycles_to_next_event();
+}
+
+//
+// Skip <delta> cycles in which nothing will be delivered
+// (see cycles_to_next_event()).
+//
+void CacheHierarchy::skip_cycles(int delta) {
+  missbuf.skip_cycles(delta);
+}
+
 void CacheHierarchy::complete() {
   lfrq.restart();
   missbuf.restart();
@@ -784,9 +848,69 @@ void CacheHierarchy::complete(int threadid) {
   missbuf.reset(threadid);
 }
 
-void CacheHierarchy::reset() {
+//
+// Functional warming
+//
+// Bring the line into each level of the hierarchy the way the miss
+// buffer would (L3, then L2, then L1), but immediately and without
+// touching the LFRQ, miss buffer or statistics. A hit in an upper
+// level stops the fill, so the lower levels only see misses.
+//
+void CacheHierarchy::warm_data(Waddr virtaddr, W64 physaddr, int threadid) {
+  dtlb.insert(virtaddr, threadid);
+
+  if likely (L1.probe(physaddr)) return;
+
+  if unlikely (!L2.probe(physaddr)) {
+#ifdef ENABLE_L3_CACHE
+    L3.validate(physaddr);
+#endif
+    L2.validate(physaddr);
+  }
+
+  L1.validate(physaddr, bitvec<L1_LINE_SIZE>().setall());
+}
+
+void CacheHierarchy::warm_insn(Waddr virtaddr, W64 physaddr, int threadid) {
+  itlb.insert(virtaddr, threadid);
+
+  if likely (L1I.probe(physaddr)) return;
+
+  if unlikely (!L2.probe(physaddr)) {
+#ifdef ENABLE_L3_CACHE
+    L3.validate(physaddr);
+#endif
+    L2.validate(physaddr);
+  }
+
+  L1I.validate(physaddr, bitvec<L1I_LINE_SIZE>().setall());
+}
+
+//
+// Write-invalidate coherence between the private per-core hierarchies.
+// Only the tags are modeled, so the next access from this core simply
+// misses and refetches the line; fills already in the miss buffer are
+// left to complete.
+//
+void CacheHierarchy::invalidate_line(W64 physaddr) {
+  L1.invalidate(physaddr);
+  L1I.invalidate(physaddr);
+  L2.invalidate(physaddr);
+#ifdef ENABLE_L3_CACHE
+  L3.invalidate(physaddr);
+#endif
+}
+
+//
+// Drop all outstanding fills but keep the cache and TLB contents
+//
+void CacheHierarchy::reset_pending() {
   lfrq.reset();
   missbuf.reset();
+}
+
+void CacheHierarchy::reset() {
+  reset_pending();
 #ifdef ENABLE_L3_CACHE
   L3.reset();
 #endif
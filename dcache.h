@@ -76,6 +76,9 @@ namespace CacheSubsystem {
   // Main memory latency
   const int MAIN_MEM_LATENCY = 140; // Core 2 Duo 2.4 GHz has 160 cycle total L2 latency
 
+  // Miss buffer timing wheel slots (power of two, must exceed the longest latency above)
+  const int MISSBUF_WHEEL_SIZE = 256;
+
   // TLBs
 #ifdef PTLSIM_HYPERVISOR
 #define USE_TLB
@@ -558,7 +561,7 @@ namespace CacheSubsystem {
       W64 addr;     // physical line address we are waiting for
       W16 state;
       W16 dcache:1, icache:1;    // L1I vs L1D
-      W32 cycles;
+      W64 due;      // miss buffer clock tick at which this entry moves to the next state
       W16 rob;
       W8 threadid;
 
@@ -567,7 +570,7 @@ namespace CacheSubsystem {
         lfrqmap = 0;
         addr = 0xffffffffffffffffULL;
         state = STATE_IDLE;
-        cycles = 0;
+        due = 0;
         icache = 0;
         dcache = 0;
         rob = 0xffff;
@@ -583,6 +586,19 @@ namespace CacheSubsystem {
     bitvec<SIZE> freemap;
     int count;
 
+    //
+    // Timing wheel: entries due to change state on clock tick t
+    // are in wheel[t % MISSBUF_WHEEL_SIZE], so each clock() only
+    // visits the entries that actually complete in that cycle.
+    //
+    W64 clocks;
+    bitvec<SIZE> wheel[MISSBUF_WHEEL_SIZE];
+    bitvec<MISSBUF_WHEEL_SIZE> wheelmap;  // wheel slots with at least one entry
+
+    static int wheelslot(W64 tick) { return tick & (MISSBUF_WHEEL_SIZE-1); }
+    void schedule(int idx, int state, int cycles);
+    void unschedule(int idx);
+
     void reset();
     void reset(int threadid);
     void restart();
@@ -594,6 +610,8 @@ namespace CacheSubsystem {
     void annul_lfrq(int slot);
     void annul_lfrq(int slot, int threadid);
     void clock();
+    int cycles_to_next_event() const;
+    void skip_cycles(int delta);
 
     ostream& print(ostream& os) const;
   };
@@ -622,7 +640,11 @@ namespace CacheSubsystem {
 
     PerCoreCacheCallbacks* callback;
 
-    CacheHierarchy(): lfrq(*this), missbuf(*this) { callback = null; }
+    // Thread ids are numbered per core: this maps them back to VCPUs for the statistics
+    W8 vcpuids[MAX_CONTEXTS];
+    int vcpuof(int threadid) const { return (threadid < MAX_CONTEXTS) ? vcpuids[threadid] : 0; }
+
+    CacheHierarchy(): lfrq(*this), missbuf(*this) { callback = null; setzero(vcpuids); }
 
     bool probe_cache_and_sfr(W64 addr, const SFR* sfra, int sizeshift);
     bool covered_by_sfr(W64 addr, SFR* sfr, int sizeshift);
@@ -646,8 +668,18 @@ namespace CacheSubsystem {
     bool probe_icache(Waddr virtaddr, Waddr physaddr);
     int initiate_icache_miss(W64 addr, int rob = 0xffff, int threadid = 0xff);
 
+    // Functional warming: fill tags and LRU state as if the access had completed
+    void warm_data(Waddr virtaddr, W64 physaddr, int threadid);
+    void warm_insn(Waddr virtaddr, W64 physaddr, int threadid);
+
+    // Another core wrote this physical line: drop our copies of it
+    void invalidate_line(W64 physaddr);
+
     void reset();
+    void reset_pending();
     void clock();
+    int cycles_to_next_event() const;
+    void skip_cycles(int delta);
     void complete();
     void complete(int threadid);
     ostream& print(ostream& os);
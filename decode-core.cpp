@@ -448,6 +448,7 @@ void TraceDecoder::reset() {
   split_invalid_basic_blocks = 0;
   no_partial_flag_updates_per_insn = 0;
   fast_length_decode_only = 0;
+  prefixmap_bytes = 0;
   join_with_prev_insn = 0;
   outcome = DECODE_OUTCOME_OK;
   stop_at_rip = limits<W64>::max;
@@ -1320,10 +1321,60 @@ void TraceDecoder::microcode_assist(int assistid, Waddr selfrip, Waddr nextrip)
 //
 // Core Decoder
 //
+//
+// Mark every prefix byte in the fetched instruction bytes, 16 bytes
+// at a time. The prefix bytes are:
+//
+//   26 2e 36 3e     (b & 0xe7) == 0x26   segment overrides
+//   64 65 66 67     (b & 0xfc) == 0x64   fs, gs, data and address size
+//   f0, f2 f3       b == 0xf0, (b & 0xfe) == 0xf2
+//   9b              fwait
+//   40-4f           (b & 0xf0) == 0x40   REX, in 64-bit mode only
+//
+// This must agree with prefix_map_x86_64 and prefix_map_x86 above.
+//
+void TraceDecoder::predecode_prefixes() {
+  int n = min(min(valid_byte_count, insnbytes_bufsize), (int)(sizeof(prefixmap) * 8));
+  n = max(n, 0);
+
+  prefixmap[0] = 0;
+  prefixmap[1] = 0;
+
+  const W16* map = (use64) ? prefix_map_x86_64 : prefix_map_x86;
+  int i = 0;
+
+  vec16b rexmask = x86_sse_dupb((use64) ? 0xf0 : 0x00);
+  vec16b rexmatch = x86_sse_dupb((use64) ? 0x40 : 0xff);
+
+  // Whole 16 byte chunks within the buffer:
+  while ((i + 16) <= n) {
+    vec16b b = x86_sse_ldvbu((const vec16b*)(insnbytes + i));
+    vec16b m = x86_sse_pcmpeqb(x86_sse_pandb(b, x86_sse_dupb(0xe7)), x86_sse_dupb(0x26));
+    m = x86_sse_porb(m, x86_sse_pcmpeqb(x86_sse_pandb(b, x86_sse_dupb(0xfc)), x86_sse_dupb(0x64)));
+    m = x86_sse_porb(m, x86_sse_pcmpeqb(b, x86_sse_dupb(0xf0)));
+    m = x86_sse_porb(m, x86_sse_pcmpeqb(x86_sse_pandb(b, x86_sse_dupb(0xfe)), x86_sse_dupb(0xf2)));
+    m = x86_sse_porb(m, x86_sse_pcmpeqb(b, x86_sse_dupb(0x9b)));
+    m = x86_sse_porb(m, x86_sse_pcmpeqb(x86_sse_pandb(b, rexmask), rexmatch));
+    prefixmap[i >> 6] |= ((W64)x86_sse_pmovmskb(m)) << lowbits(i, 6);
+    i += 16;
+  }
+
+  // Leftover bytes at the end:
+  while (i < n) {
+    if (map[insnbytes[i]]) prefixmap[i >> 6] |= (1ULL << lowbits(i, 6));
+    i++;
+  }
+
+  prefixmap_bytes = n;
+}
+
 void TraceDecoder::decode_prefixes() {
   prefixes = 0;
   rex = 0;
 
+  // Most instructions have no prefixes at all:
+  if likely ((byteoffset < prefixmap_bytes) && (!bit(prefixmap[byteoffset >> 6], lowbits(byteoffset, 6)))) return;
+
   for (;;) {
     byte b = insnbytes[byteoffset];
     W32 prefix = (use64) ? prefix_map_x86_64[b] : prefix_map_x86[b];
@@ -1388,6 +1439,149 @@ void assist_invalid_opcode(Context& ctx) {
 
 static const bool log_code_page_ops = 0;
 
+BasicBlock* BasicBlockCache::probe(const RIPVirtPhys& rvp, int& probes) {
+  probes = 0;
+  if unlikely (!count) return null;
+
+  int mask = capacity - 1;
+  int slot = hash(rvp) & mask;
+
+  for (;;) {
+    const BasicBlockCacheSlot& s = slots[slot];
+    probes++;
+    if (!s.bb) return null;
+    if likely ((s.rip == rvp.rip) && (s.bb->rip == rvp)) return s.bb;
+    slot = (slot + 1) & mask;
+  }
+}
+
+//
+// Look up <rvp> through the calling thread's lookaside first
+//
+BasicBlock* BasicBlockCache::lookup(const RIPVirtPhys& rvp, BasicBlockLookaside& lookaside) {
+  if unlikely (lookaside.epoch != link_epoch) {
+    lookaside.reset();
+    lookaside.epoch = link_epoch;
+  }
+
+  BasicBlockCacheSlot& entry = lookaside.entries[foldbits<log2(BasicBlockLookaside::SIZE)>(rvp.rip)];
+
+  if likely (entry.bb && (entry.rip == rvp.rip) && (entry.bb->rip == rvp)) {
+    stats.decoder.bbcache.lookaside.hits++;
+    return entry.bb;
+  }
+
+  stats.decoder.bbcache.lookaside.misses++;
+
+  int probes;
+  BasicBlock* bb = probe(rvp, probes);
+  stats.decoder.bbcache.probes += probes;
+
+  if unlikely (!bb) {
+    stats.decoder.bbcache.misses++;
+    return null;
+  }
+
+  stats.decoder.bbcache.hits++;
+  entry.rip = rvp.rip;
+  entry.bb = bb;
+
+  return bb;
+}
+
+BasicBlock* BasicBlockCache::add(BasicBlock* bb) {
+  BasicBlock* oldbb = get(bb->rip);
+  if unlikely (oldbb == bb) return bb;
+  if unlikely (oldbb) remove(oldbb);
+
+  if unlikely (((count + 1) * 2) > capacity) resize((capacity) ? (capacity * 2) : BB_CACHE_SIZE);
+
+  int mask = capacity - 1;
+  int slot = hash(bb->rip) & mask;
+  while (slots[slot].bb) slot = (slot + 1) & mask;
+
+  slots[slot].rip = bb->rip.rip;
+  slots[slot].bb = bb;
+  count++;
+
+  return bb;
+}
+
+bool BasicBlockCache::remove(BasicBlock* bb) {
+  if unlikely (!count) return false;
+
+  int mask = capacity - 1;
+  int slot = hash(bb->rip) & mask;
+
+  for (;;) {
+    if unlikely (!slots[slot].bb) return false;
+    if (slots[slot].bb == bb) break;
+    slot = (slot + 1) & mask;
+  }
+
+  //
+  // Shift back any later entries in the cluster that would
+  // no longer be reachable from their home slot.
+  //
+  int hole = slot;
+  int i = slot;
+
+  for (;;) {
+    i = (i + 1) & mask;
+    BasicBlock* other = slots[i].bb;
+    if (!other) break;
+
+    int home = hash(other->rip) & mask;
+    bool reachable = (hole <= i) ? ((hole < home) & (home <= i)) : ((hole < home) | (home <= i));
+    if (reachable) continue;
+
+    slots[hole] = slots[i];
+    hole = i;
+  }
+
+  slots[hole].rip = 0;
+  slots[hole].bb = null;
+  count--;
+
+  return true;
+}
+
+//
+// The new table is allocated before rehashing, since the allocation
+// itself may reclaim (and remove) blocks from the old table.
+//
+void BasicBlockCache::resize(int newcapacity) {
+  BasicBlockCacheSlot* newslots = ptl_mm_alloc_and_zero_private_pages_for_objects<BasicBlockCacheSlot>(newcapacity);
+  assert(newslots);
+
+  int mask = newcapacity - 1;
+
+  foreach (i, capacity) {
+    BasicBlock* bb = slots[i].bb;
+    if (!bb) continue;
+    int slot = hash(bb->rip) & mask;
+    while (newslots[slot].bb) slot = (slot + 1) & mask;
+    newslots[slot] = slots[i];
+  }
+
+  if (slots) ptl_mm_free_private_pages(slots, capacity * sizeof(BasicBlockCacheSlot));
+
+  slots = newslots;
+  capacity = newcapacity;
+}
+
+dynarray<BasicBlock*>& BasicBlockCache::getentries(dynarray<BasicBlock*>& a) {
+  a.resize(count);
+  int n = 0;
+  foreach (i, capacity) {
+    BasicBlock* bb = slots[i].bb;
+    if (!bb) continue;
+    assert(n < count);
+    a[n++] = bb;
+  }
+  return a;
+}
+
 bool BasicBlockCache::invalidate(BasicBlock* bb, int reason) {
   BasicBlockChunkList* pagelist;
   if unlikely (bb->refcount) {
@@ -1414,6 +1608,7 @@ bool BasicBlockCache::invalidate(BasicBlock* bb, int reason) {
   }
 
   remove(bb);
+  link_epoch++;
   stats.decoder.bbcache.count = bbcache.count;
   stats.decoder.bbcache.invalidates[reason]++;
 
@@ -1831,6 +2026,7 @@ int TraceDecoder::fillbuf(Context& ctx, byte* insnbytes, int insnbytes_bufsize)
   pfec = 0;
   invalid = 0;
   valid_byte_count = ctx.copy_from_user(insnbytes, bb.rip, insnbytes_bufsize, pfec, faultaddr, true, ptelo, ptehi);
+  predecode_prefixes();
   return valid_byte_count;
 }
 
@@ -1845,6 +2041,7 @@ int TraceDecoder::fillbuf_phys_prechecked(byte* insnbytes, int insnbytes_bufsize
   this->ptelo = ptelo;
   this->ptehi = ptehi;
   valid_byte_count = copy_from_user_phys_prechecked(insnbytes, bb.rip, insnbytes_bufsize, ptelo, ptehi, faultaddr);
+  predecode_prefixes();
   return valid_byte_count;
 }
 #endif
@@ -1998,6 +2195,247 @@ ostream& printflags(ostream& os, W64 flags) {
   return os;
 }
 
+#ifndef PTLSIM_HYPERVISOR
+//
+// Persistent basic block store
+//
+// The file is a header followed by variable length records. Each
+// record holds the BasicBlockBase fields as translated (pointers
+// and reference counts are reset on load), then the x86 code bytes
+// the block was decoded from, padded to 8 bytes, then the uops.
+//
+// Translations depend on the exact decoder, which is spread over
+// several files, so the header carries a CRC of PTLsim's whole text
+// segment and the structure sizes: a store written by any other
+// build is ignored and rewritten.
+//
+// The store is read into PTLsim's own memory rather than mapped:
+// a file mapping would look like user memory to the address space
+// resync and to checkpoints.
+//
+struct BasicBlockStoreHeader {
+  W64 magic;
+  W32 basic_block_size;
+  W32 transop_size;
+  W32 text_size;
+  W32 text_crc;
+
+  static const W64 MAGIC = 0x32545342424c5450ULL; // "PTLBBST2"
+};
+
+struct BasicBlockStoreRecord {
+  W64 rip;
+  W16 bytes;
+  W16 count;
+  byte use64, kernel, df, pad;
+  BasicBlockBase bb;
+
+  const byte* code() const { return (const byte*)(this + 1); }
+  const TransOp* transops() const { return (const TransOp*)(code() + ceil(bytes, 8)); }
+
+  static size_t size(int bytes, int count) {
+    return sizeof(BasicBlockStoreRecord) + ceil(bytes, 8) + (count * sizeof(TransOp));
+  }
+
+  bool matches(const RIPVirtPhys& rvp) const {
+    return ((rip == rvp.rip) & (use64 == rvp.use64) & (kernel == rvp.kernel) & (df == rvp.df));
+  }
+};
+
+BasicBlockStore bbstore;
+
+static const int MAX_X86_INSN_BYTES = 15;
+
+extern "C" byte __executable_start;
+extern "C" byte etext;
+
+static inline int bbstore_hash(W64 rip, int indexsize) {
+  return (int)(((rip ^ (rip >> 17)) * 0x9e3779b97f4a7c15ULL) >> 32) & (indexsize - 1);
+}
+
+//
+// The decoder saw the whole block, plus enough bytes after it that
+// the block did not end early because the next page was unmapped.
+//
+static inline bool bbstore_window_complete(int bytes, int valid_byte_count) {
+  return ((valid_byte_count == MAX_BB_BYTES) | ((bytes + MAX_X86_INSN_BYTES) <= valid_byte_count));
+}
+
+void BasicBlockStore::insert(const BasicBlockStoreRecord* rec) {
+  if unlikely ((count + 1) * 2 > indexsize) {
+    int newsize = max(indexsize * 2, 4096);
+    const BasicBlockStoreRecord** newindex = new const BasicBlockStoreRecord*[newsize];
+    foreach (i, newsize) newindex[i] = null;
+
+    foreach (i, indexsize) {
+      const BasicBlockStoreRecord* r = index[i];
+      if (!r) continue;
+      int slot = bbstore_hash(r->rip, newsize);
+      while (newindex[slot]) slot = (slot + 1) & (newsize - 1);
+      newindex[slot] = r;
+    }
+
+    if (index) delete[] index;
+    index = newindex;
+    indexsize = newsize;
+  }
+
+  int slot = bbstore_hash(rec->rip, indexsize);
+  while (index[slot]) slot = (slot + 1) & (indexsize - 1);
+  index[slot] = rec;
+  count++;
+}
+
+bool BasicBlockStore::open(const char* filename) {
+  close();
+
+  BasicBlockStoreHeader expected;
+  setzero(expected);
+  expected.magic = BasicBlockStoreHeader::MAGIC;
+  expected.basic_block_size = sizeof(BasicBlockBase);
+  expected.transop_size = sizeof(TransOp);
+  expected.text_size = &etext - &__executable_start;
+  CRC32 crc;
+  expected.text_crc = crc.update(&__executable_start, expected.text_size);
+
+  bool reuse = false;
+
+  idstream is;
+  if (is.open(filename)) {
+    W64 filesize = is.size();
+    BasicBlockStoreHeader header;
+
+    if ((filesize >= sizeof(header)) && (is.read(&header, sizeof(header)) == sizeof(header)) && (!memcmp(&header, &expected, sizeof(header)))) {
+      W64 datasize = filesize - sizeof(header);
+      byte* data = (datasize) ? (byte*)ptl_mm_alloc_private_pages(datasize, PROT_READ|PROT_WRITE) : null;
+      W64 done = 0;
+
+      while (data && (done < datasize)) {
+        int n = is.read(data + done, (int)min(datasize - done, (W64)(1024*1024)));
+        if (n <= 0) break;
+        done += n;
+      }
+
+      //
+      // Index every complete record. A run that was killed while
+      // writing may leave a partial record at the end: drop it.
+      //
+      W64 offset = 0;
+      while ((offset + sizeof(BasicBlockStoreRecord)) <= done) {
+        const BasicBlockStoreRecord* rec = (const BasicBlockStoreRecord*)(data + offset);
+        W64 recsize = BasicBlockStoreRecord::size(rec->bytes, rec->count);
+        if unlikely (((offset + recsize) > done) | (rec->bytes > MAX_BB_BYTES) | (rec->count > (MAX_BB_UOPS*2))) break;
+        insert(rec);
+        offset += recsize;
+      }
+
+      reuse = (offset == datasize);
+      logfile << "Basic block store ", filename, ": loaded ", count, " basic blocks (", offset, " bytes)", endl;
+    } else {
+      logfile << "Basic block store ", filename, " was written by another PTLsim build; starting over", endl;
+    }
+
+    is.close();
+  }
+
+  //
+  // Append new blocks to a valid store with no partial record at the
+  // end; otherwise rewrite it from scratch (the blocks already loaded
+  // stay in memory and are written out again).
+  //
+  if (!os.open(filename, reuse)) {
+    logfile << "Basic block store ", filename, ": cannot open for writing", endl;
+    return false;
+  }
+
+  if (!reuse) {
+    os.write(&expected, sizeof(expected));
+
+    foreach (i, indexsize) {
+      const BasicBlockStoreRecord* rec = index[i];
+      if (rec) os.write(rec, BasicBlockStoreRecord::size(rec->bytes, rec->count));
+    }
+  }
+
+  return os.ok();
+}
+
+//
+// Fill in a freshly reset <bb> from the store if a block with the same
+// RIP and mode bits was stored from the same code bytes.
+//
+bool BasicBlockStore::load(BasicBlock& bb, const byte* insnbuf, int valid_byte_count) {
+  if unlikely (!indexsize) return false;
+
+  int slot = bbstore_hash(bb.rip.rip, indexsize);
+
+  while (index[slot]) {
+    const BasicBlockStoreRecord* rec = index[slot];
+    slot = (slot + 1) & (indexsize - 1);
+
+    if likely (!rec->matches(bb.rip)) continue;
+    if unlikely ((rec->bytes > valid_byte_count) || (!bbstore_window_complete(rec->bytes, valid_byte_count))) continue;
+    if unlikely (memcmp(rec->code(), insnbuf, rec->bytes)) continue;
+
+    RIPVirtPhys rvp = bb.rip;
+    memcpy((BasicBlockBase*)&bb, &rec->bb, sizeof(BasicBlockBase));
+    bb.rip = rvp;
+    bb.mfnlo_loc.reset();
+    bb.mfnhi_loc.reset();
+    bb.synthops = null;
+    bb.fusedops = null;
+    bb.taken_link = null;
+    bb.not_taken_link = null;
+    bb.jitcode = null;
+    bb.refcount = 0;
+    bb.lastused = 0;
+    memcpy(bb.transops, rec->transops(), rec->count * sizeof(TransOp));
+
+    stats.decoder.bbstore.hits++;
+    return true;
+  }
+
+  stats.decoder.bbstore.misses++;
+  return false;
+}
+
+void BasicBlockStore::store(const BasicBlock& bb, const byte* insnbuf, int valid_byte_count) {
+  if unlikely (!os) return;
+  if unlikely (bb.invalidblock | (bb.rip.mfnlo == RIPVirtPhys::INVALID)) return;
+  if unlikely ((bb.bytes > valid_byte_count) || (!bbstore_window_complete(bb.bytes, valid_byte_count))) return;
+
+  size_t recsize = BasicBlockStoreRecord::size(bb.bytes, bb.count);
+  byte* p = (byte*)malloc(recsize);
+  BasicBlockStoreRecord* rec = new(p) BasicBlockStoreRecord();
+  memset(p + sizeof(BasicBlockStoreRecord), 0, recsize - sizeof(BasicBlockStoreRecord));
+
+  rec->rip = bb.rip.rip;
+  rec->bytes = bb.bytes;
+  rec->count = bb.count;
+  rec->use64 = bb.rip.use64;
+  rec->kernel = bb.rip.kernel;
+  rec->df = bb.rip.df;
+  memcpy(&rec->bb, (const BasicBlockBase*)&bb, sizeof(BasicBlockBase));
+  memcpy((byte*)rec->code(), insnbuf, bb.bytes);
+  memcpy((TransOp*)rec->transops(), bb.transops, bb.count * sizeof(TransOp));
+
+  os.write(rec, recsize);
+
+  // Keep it in the index so a block reclaimed later in this run is not written twice
+  insert(rec);
+  stats.decoder.bbstore.writes++;
+}
+
+void BasicBlockStore::close() {
+  if (os) os.close();
+  // Records themselves stay allocated: they may still be referenced by the old index
+  if (index) delete[] index;
+  index = null;
+  indexsize = 0;
+  count = 0;
+}
+#endif
+
 //
 // Translate one basic block. This function always returns
 // a BasicBlock, except in the very rare case where one or
@@ -2041,10 +2479,17 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
     assert(trans.valid_byte_count == 0);
   }
 
-  for (;;) {
-    // if (DEBUG) logfile << "rip ", (void*)trans.rip, ", relrip = ", (void*)(trans.rip - trans.bb.rip), endl;
-    if (!trans.translate()) break;
+#ifndef PTLSIM_HYPERVISOR
+  if (!bbstore.load(trans.bb, insnbuf, trans.valid_byte_count)) {
+#endif
+    for (;;) {
+      // if (DEBUG) logfile << "rip ", (void*)trans.rip, ", relrip = ", (void*)(trans.rip - trans.bb.rip), endl;
+      if (!trans.translate()) break;
+    }
+#ifndef PTLSIM_HYPERVISOR
+    bbstore.store(trans.bb, insnbuf, trans.valid_byte_count);
   }
+#endif
 
   trans.bb.hitcount = 0;
   trans.bb.predcount = 0;
@@ -2234,4 +2679,7 @@ void init_decode() {
 void shutdown_decode() {
   bbcache.flush();
   if (bbcache_dump_file) bbcache_dump_file.close();
+#ifndef PTLSIM_HYPERVISOR
+  bbstore.close();
+#endif
 }
@@ -158,6 +158,9 @@ struct TraceDecoder {
   byte dirflag;
   byte* insnbytes;
   int insnbytes_bufsize;
+  // Bit i is set if insnbytes[i] is a prefix byte (valid below prefixmap_bytes)
+  W64 prefixmap[2];
+  int prefixmap_bytes;
   Waddr rip;
   Waddr ripstart;
   int byteoffset;
@@ -198,6 +201,7 @@ struct TraceDecoder {
 
   void reset();
   void decode_prefixes();
+  void predecode_prefixes();
   void immediate(int rdreg, int sizeshift, W64s imm, bool issigned = true);
   void abs_code_addr_immediate(int rdreg, int sizeshift, W64 imm);
   int bias_by_segreg(int basereg);
@@ -492,40 +496,9 @@ void assist_ioport_out(Context& ctx);
 void init_decode();
 void shutdown_decode();
 
+// Initial number of slots in the basic block cache
 static const int BB_CACHE_SIZE = 16384;
 
-namespace superstl {
-  template <int setcount>
-  struct HashtableKeyManager<RIPVirtPhys, setcount> {
-    static inline int hash(const RIPVirtPhys& key) {
-      W64 rip = key.rip;
-      W64 slot = foldbits<log2(setcount)>(rip);
-#ifdef PTLSIM_HYPERVISOR
-      slot ^= key.mfnlo;
-#endif
-      return slot;
-    }
-
-    static inline bool equal(const RIPVirtPhys& a, const RIPVirtPhys& b) { return (a == b); }
-    static inline RIPVirtPhys dup(const RIPVirtPhys& key) { return key; }
-    static inline void free(RIPVirtPhys& key) { }
-  };
-};
-
-struct BasicBlockHashtableLinkManager {
-  static inline BasicBlock* objof(selflistlink* link) {
-    return baseof(BasicBlock, hashlink, link);
-  }
-
-  static inline RIPVirtPhys& keyof(BasicBlock* obj) {
-    return obj->rip;
-  }
-
-  static inline selflistlink* linkof(BasicBlock* obj) {
-    return &obj->hashlink;
-  }
-};
-
 enum {
   INVALIDATE_REASON_SMC = 0,
   INVALIDATE_REASON_DMA,
@@ -536,8 +509,91 @@ enum {
   INVALIDATE_REASON_COUNT
 };
 
-struct BasicBlockCache: public SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager> {
-  BasicBlockCache(): SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager>() { }
+struct BasicBlockCacheSlot {
+  W64 rip;
+  BasicBlock* bb;
+};
+
+//
+// Small direct mapped cache of recent lookups, kept by each thread
+// in front of the shared basic block cache. Any invalidation bumps
+// bbcache.link_epoch, which empties every lookaside on its next use.
+//
+struct BasicBlockLookaside {
+  static const int SIZE = 64;
+
+  BasicBlockCacheSlot entries[SIZE];
+  W64 epoch;
+
+  BasicBlockLookaside() { reset(); }
+
+  void reset() {
+    foreach (i, SIZE) { entries[i].rip = 0; entries[i].bb = null; }
+    epoch = 0;
+  }
+};
+
+//
+// The basic block cache is open addressed with linear probing. Each
+// slot keeps the block's RIP next to the pointer, so most lookups
+// touch one cache line of slots before the block itself. Removal
+// shifts the rest of the cluster back instead of leaving tombstones,
+// and the table doubles in size whenever it becomes half full.
+//
+struct BasicBlockCache {
+  BasicBlockCacheSlot* slots;
+  int capacity;
+  int count;
+  // Bumped whenever a block is freed, which breaks every successor link
+  W64 link_epoch;
+
+  BasicBlockCache() { slots = null; capacity = 0; count = 0; link_epoch = 0; }
+
+  static inline W64 hash(const RIPVirtPhys& rvp) {
+    W64 key = rvp.rip;
+#ifdef PTLSIM_HYPERVISOR
+    key ^= ((W64)rvp.mfnlo) << 40;
+#endif
+    return (key * 0x9e3779b97f4a7c15ULL) >> 32;
+  }
+
+  BasicBlock* get(const RIPVirtPhys& rvp) { int probes; return probe(rvp, probes); }
+  BasicBlock* operator ()(const RIPVirtPhys& rvp) { return get(rvp); }
+  BasicBlock* probe(const RIPVirtPhys& rvp, int& probes);
+  BasicBlock* lookup(const RIPVirtPhys& rvp, BasicBlockLookaside& lookaside);
+  BasicBlock* add(BasicBlock* bb);
+  bool remove(BasicBlock* bb);
+  dynarray<BasicBlock*>& getentries(dynarray<BasicBlock*>& a);
+
+  //
+  // Blocks may be removed while iterating: when the block returned
+  // last is gone, the entry shifted back into its slot is visited next.
+  //
+  struct Iterator {
+    BasicBlockCache* cache;
+    BasicBlock* last;
+    int slot;
+
+    Iterator() { }
+    Iterator(BasicBlockCache* cache) { reset(cache); }
+
+    void reset(BasicBlockCache* cache) {
+      this->cache = cache;
+      last = null;
+      slot = 0;
+    }
+
+    BasicBlock* next() {
+      if (last && (cache->slots[slot].bb == last)) slot++;
+      while (slot < cache->capacity) {
+        BasicBlock* bb = cache->slots[slot].bb;
+        if (bb) { last = bb; return bb; }
+        slot++;
+      }
+      last = null;
+      return null;
+    }
+  };
 
   BasicBlock* translate(Context& ctx, const RIPVirtPhys& rvp);
   void translate_in_place(BasicBlock& targetbb, Context& ctx, Waddr rip);
@@ -550,10 +606,44 @@ struct BasicBlockCache: public SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_S
   void flush();
 
   ostream& print(ostream& os);
+
+protected:
+  void resize(int newcapacity);
 };
 
 extern BasicBlockCache bbcache;
 
+#ifndef PTLSIM_HYPERVISOR
+//
+// Persistent store of translated basic blocks (-bbstore)
+//
+// Every basic block translated in one run is appended to the store
+// file along with its x86 code bytes; later runs of the same PTLsim
+// build load the whole file at startup and reuse a stored block
+// whenever its RIP, mode bits and code bytes all match.
+//
+struct BasicBlockStoreRecord;
+
+struct BasicBlockStore {
+  odstream os;
+  const BasicBlockStoreRecord** index;
+  int indexsize;
+  int count;
+
+  BasicBlockStore() { index = null; indexsize = 0; count = 0; }
+
+  bool open(const char* filename);
+  bool load(BasicBlock& bb, const byte* insnbuf, int valid_byte_count);
+  void store(const BasicBlock& bb, const byte* insnbuf, int valid_byte_count);
+  void close();
+
+protected:
+  void insert(const BasicBlockStoreRecord* rec);
+};
+
+extern BasicBlockStore bbstore;
+#endif
+
 extern odstream bbcache_dump_file;
 
 //
@@ -210,6 +210,7 @@ inline vec4i x86_sse_pcmpeqd(vec4i a, vec4i b) { asm("pcmpeqd %[b],%[a]" : [a] "
 inline vec16b x86_sse_psubusb(vec16b a, vec16b b) { asm("psubusb %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
 inline vec16b x86_sse_paddusb(vec16b a, vec16b b) { asm("paddusb %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
 inline vec16b x86_sse_pandb(vec16b a, vec16b b) { asm("pand %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
+inline vec16b x86_sse_porb(vec16b a, vec16b b) { asm("por %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
 inline vec8w x86_sse_psubusw(vec8w a, vec8w b) { asm("psubusb %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
 inline vec8w x86_sse_paddusw(vec8w a, vec8w b) { asm("paddsub %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
 inline vec8w x86_sse_pandw(vec8w a, vec8w b) { asm("pand %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
@@ -266,6 +267,17 @@ inline W64 x86_bsf64(W64 b) { W64 r = 0; asm("bsf %[b],%[r]" : [r] "+r" (r) : [b
 inline W32 x86_bsr32(W32 b) { W32 r = 0; asm("bsr %[b],%[r]" : [r] "+r" (r) : [b] "r" (b)); return r; }
 inline W64 x86_bsr64(W64 b) { W64 r = 0; asm("bsr %[b],%[r]" : [r] "+r" (r) : [b] "r" (b)); return r; }
 
+// These require POPCNT, BMI1, LZCNT (ABM) or BMI2 respectively: only use them when host_cpu says so
+inline W32 x86_popcnt32(W32 b) { W32 r; asm("popcnt %[b],%[r]" : [r] "=r" (r) : [b] "r" (b)); return r; }
+inline W32 x86_tzcnt32(W32 b) { W32 r; asm("tzcnt %[b],%[r]" : [r] "=r" (r) : [b] "r" (b)); return r; }
+inline W32 x86_lzcnt32(W32 b) { W32 r; asm("lzcnt %[b],%[r]" : [r] "=r" (r) : [b] "r" (b)); return r; }
+inline W32 x86_pext32(W32 b, W32 mask) { W32 r; asm("pext %[mask],%[b],%[r]" : [r] "=r" (r) : [b] "r" (b), [mask] "r" (mask)); return r; }
+#ifdef __x86_64__
+inline W64 x86_popcnt64(W64 b) { W64 r; asm("popcnt %[b],%[r]" : [r] "=r" (r) : [b] "r" (b)); return r; }
+inline W64 x86_tzcnt64(W64 b) { W64 r; asm("tzcnt %[b],%[r]" : [r] "=r" (r) : [b] "r" (b)); return r; }
+inline W64 x86_lzcnt64(W64 b) { W64 r; asm("lzcnt %[b],%[r]" : [r] "=r" (r) : [b] "r" (b)); return r; }
+#endif
+
 template <typename T> inline bool x86_bt(T r, T b) { byte c; asm("bt %[b],%[r]; setc %[c]" : [c] "=q" (c) : [r] "r" (r), [b] "r" (b)); return c; }
 template <typename T> inline bool x86_btn(T r, T b) { byte c; asm("bt %[b],%[r]; setnc %[c]" : [c] "=r" (c) : [r] "r" (r), [b] "r" (b)); return c; }
 
@@ -357,6 +369,25 @@ static inline void cpuid(int op, W32& eax, W32& ebx, W32& ecx, W32& edx) {
 	asm("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "0" (op));
 }
 
+//
+// Host CPU features used to pick vector kernels and bit scan
+// instructions at runtime; filled in once at startup by
+// detect_host_cpu_features(). Everything stays false (and the
+// baseline k8 code is used) until then.
+//
+struct HostCPUFeatures {
+  bool popcnt;
+  bool lzcnt;
+  bool bmi1;
+  bool bmi2;
+  bool fastpext; // bmi2, and PEXT/PDEP are not microcoded (as they are on AMD before Zen 3)
+  bool avx2;
+  bool avx512bw;
+};
+
+extern HostCPUFeatures host_cpu;
+void detect_host_cpu_features();
+
 static inline W64 rdtsc() {
   W32 lo, hi;
   asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
@@ -636,10 +667,14 @@ static inline int lsbindex8bit(byte x) {
 }
 
 static inline int popcount(W32 x) {
+  if likely (host_cpu.popcnt) return x86_popcnt32(x);
   return (popcount8bit(x >> 0) + popcount8bit(x >> 8) + popcount8bit(x >> 16) + popcount8bit(x >> 24));
 }
 
 static inline int popcount64(W64 x) {
+#ifdef __x86_64__
+  if likely (host_cpu.popcnt) return x86_popcnt64(x);
+#endif
   return popcount(LO32(x)) + popcount(HI32(x));
 }
 
@@ -649,7 +684,7 @@ extern const W64 expand_8bit_to_64bit_lut[256];
 // LSB index:
 
 // Operand must be non-zero or result is undefined:
-inline unsigned int lsbindex32(W32 n) { return x86_bsf32(n); }
+inline unsigned int lsbindex32(W32 n) { return (host_cpu.bmi1) ? x86_tzcnt32(n) : x86_bsf32(n); }
 
 inline int lsbindexi32(W32 n) {
   int r = lsbindex32(n);
@@ -657,7 +692,7 @@ inline int lsbindexi32(W32 n) {
 }
 
 #ifdef __x86_64__
-inline unsigned int lsbindex64(W64 n) { return x86_bsf64(n); }
+inline unsigned int lsbindex64(W64 n) { return (host_cpu.bmi1) ? x86_tzcnt64(n) : x86_bsf64(n); }
 #else
 inline unsigned int lsbindex64(W64 n) {
   W32 lo = LO32(n);
@@ -681,7 +716,7 @@ inline unsigned int lsbindex(W64 n) { return lsbindex64(n); }
 // MSB index:
 
 // Operand must be non-zero or result is undefined:
-inline unsigned int msbindex32(W32 n) { return x86_bsr32(n); }
+inline unsigned int msbindex32(W32 n) { return (host_cpu.lzcnt) ? (31 - x86_lzcnt32(n)) : x86_bsr32(n); }
 
 inline int msbindexi32(W32 n) {
   int r = msbindex32(n);
@@ -689,7 +724,7 @@ inline int msbindexi32(W32 n) {
 }
 
 #ifdef __x86_64__
-inline unsigned int msbindex64(W64 n) { return x86_bsr64(n); }
+inline unsigned int msbindex64(W64 n) { return (host_cpu.lzcnt) ? (63 - x86_lzcnt64(n)) : x86_bsr64(n); }
 #else
 inline unsigned int msbindex64(W64 n) {
   W32 lo = LO32(n);
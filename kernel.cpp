@@ -1088,10 +1088,12 @@ void handle_syscall_64bit() {
     break;
   }
   case __NR_64bit_exit: {
+    if unlikely (in_sample_child) end_sample_child();
     logfile << "handle_syscall at iteration ", iterations, ": exit(): exiting with arg ", (W64s)arg1, "...", endl, flush;
     user_process_terminated((int)arg1);
   }
   case __NR_64bit_exit_group: {
+    if unlikely (in_sample_child) end_sample_child();
     logfile << "handle_syscall at iteration ", iterations, ": exit_group(): exiting with arg ", (W64s)arg1, "...", endl, flush;
     user_process_terminated((int)arg1);
   }
@@ -1117,6 +1119,7 @@ void handle_syscall_64bit() {
     break;
   }
   default:
+    if unlikely (in_sample_child) end_sample_child();
     ctx.commitarf[REG_rax] = do_syscall_64bit(syscallid, arg1, arg2, arg3, arg4, arg5, arg6);
     break;
   }
@@ -1281,10 +1284,12 @@ void handle_syscall_32bit(int semantics) {
     ctx.commitarf[REG_rax] = (Waddr)asp.mremap((void*)(Waddr)arg1, arg2, arg3, arg4);
     break;
   case __NR_32bit_exit: {
+    if unlikely (in_sample_child) end_sample_child();
     logfile << "handle_syscall at iteration ", iterations, ": exit(): exiting with arg ", (W64s)arg1, "...", endl, flush;
     user_process_terminated((int)arg1);
   }
   case __NR_32bit_exit_group: {
+    if unlikely (in_sample_child) end_sample_child();
     logfile << "handle_syscall at iteration ", iterations, ": exit_group(): exiting with arg ", (W64s)arg1, "...", endl, flush;
     user_process_terminated((int)arg1);
   }
@@ -1326,6 +1331,7 @@ void handle_syscall_32bit(int semantics) {
     break;
   }
   default:
+    if unlikely (in_sample_child) end_sample_child();
     ctx.commitarf[REG_rax] = do_syscall_32bit(syscallid, arg1, arg2, arg3, arg4, arg5, arg6);
     break;
   }
@@ -2230,6 +2236,371 @@ extern "C" void* ptlsim_preinit(void* origrsp, void* nextinit) {
   return sp;
 }
 
+//
+// Checkpoints
+//
+// A checkpoint holds the architectural context, the contents and
+// layout of every user memory mapping and, when warming is enabled,
+// the out of order core's warmed caches and predictors. Memory images
+// start on page boundaries in the file so they can be mapped back in
+// with MAP_PRIVATE when restoring: pages are only read from the file
+// when first touched, so restoring costs time in proportion to the
+// memory the program actually uses after the checkpoint.
+//
+// Open files, signal handlers and other kernel state are not saved;
+// the program must be started the same way (same binary and args)
+// when the checkpoint is restored, and with address space layout
+// randomization disabled so the heap starts at the same address.
+//
+struct CheckpointHeader {
+  W64 magic;
+  W64 insns;                // total_user_insns_committed when saved
+  W64 brkbase;
+  W64 brk;
+  W64 extent_count;
+  W64 extent_offset;
+  W64 machine_state_offset; // out of order core state (0 if none)
+  W64 machine_state_size;
+
+  static const W64 MAGIC = 0x3154504b434c5450ULL; // "PTLCKPT1"
+};
+
+struct CheckpointExtent {
+  W64 start;
+  W64 length;
+  W32 prot;
+  W32 flags;
+  W64 offset;               // page aligned file offset of the image (0 if not saved)
+};
+
+//
+// PTLsim itself lives in its image region, the thunk page and in
+// shared /dev/zero mappings; everything else belongs to the user.
+//
+static bool is_user_extent(const MemoryMapExtent& map) {
+  Waddr start = (Waddr)map.start;
+  Waddr end = start + map.length;
+
+  if (map.flags & (MAP_ZERO|MAP_VDSO)) return false;
+  if ((start < (Waddr)(PTL_IMAGE_BASE + PTL_IMAGE_SIZE)) && (end > (Waddr)PTL_IMAGE_BASE)) return false;
+  if (start == PTLSIM_THUNK_PAGE) return false;
+#ifdef __x86_64__
+  // vsyscall page
+  if (start >= 0x800000000000ULL) return false;
+#endif
+  return true;
+}
+
+bool save_checkpoint(const char* filename) {
+  odstream os(filename);
+
+  if (!os) {
+    logfile << "Checkpoint: cannot create ", filename, endl;
+    return false;
+  }
+
+  MemoryMapExtent* mapstart = (MemoryMapExtent*)ptl_mm_alloc_private_pages(MAX_MAPS_PER_PROCESS * sizeof(MemoryMapExtent));
+  int n = mqueryall(mapstart, MAX_MAPS_PER_PROCESS);
+
+  dynarray<CheckpointExtent> extents;
+
+  foreach (i, n) {
+    const MemoryMapExtent& map = mapstart[i];
+    if (!is_user_extent(map)) continue;
+
+    CheckpointExtent extent;
+    extent.start = (Waddr)map.start;
+    extent.length = map.length;
+    extent.prot = map.prot;
+    extent.flags = map.flags;
+    extent.offset = 0;
+    extents.push(extent);
+  }
+
+  ptl_mm_free_private_pages(mapstart, MAX_MAPS_PER_PROCESS * sizeof(MemoryMapExtent));
+
+  CheckpointHeader header;
+  setzero(header);
+  header.magic = CheckpointHeader::MAGIC;
+  header.insns = total_user_insns_committed;
+  header.brkbase = (Waddr)asp.brkbase;
+  header.brk = (Waddr)asp.brk;
+  header.extent_count = extents.length;
+
+  os << header;
+  os.write(&ctx, sizeof(Context));
+  header.extent_offset = os.where();
+  os.write(extents.data, extents.length * sizeof(CheckpointExtent));
+
+  PTLsimMachine* machine = PTLsimMachine::getmachine("ooo");
+
+  if (config.functional_warming && machine && machine->initialized) {
+    header.machine_state_offset = os.where();
+    if (machine->save_checkpoint(os)) {
+      header.machine_state_size = os.where() - header.machine_state_offset;
+    } else {
+      header.machine_state_offset = 0;
+    }
+  }
+
+  W64 offset = ceil(os.where(), PAGE_SIZE);
+
+  foreach (i, extents.length) {
+    CheckpointExtent& extent = extents[i];
+    // Unreadable regions (guard pages and the like) are restored empty
+    if (!(extent.prot & PROT_READ)) continue;
+
+    extent.offset = offset;
+    os.seek(offset);
+
+    static const W64 CHUNK_SIZE = 1024*1024;
+    for (W64 done = 0; done < extent.length; done += CHUNK_SIZE) {
+      os.write((const byte*)(Waddr)extent.start + done, min(extent.length - done, CHUNK_SIZE));
+    }
+
+    offset += ceil(extent.length, PAGE_SIZE);
+  }
+
+  os.seek(header.extent_offset);
+  os.write(extents.data, extents.length * sizeof(CheckpointExtent));
+  os.seek(0);
+  os << header;
+
+  bool ok = os.ok();
+  os.close();
+
+  logfile << "Checkpoint: saved ", extents.length, " memory extents (", (offset >> 20), " MB) at ", total_user_insns_committed, " commits to ", filename, endl, flush;
+
+  return ok;
+}
+
+//
+// Replace the user address space and context with those saved in the
+// checkpoint, then start simulating at the saved rip. Only returns if
+// the checkpoint cannot be used.
+//
+bool load_checkpoint(const char* filename) {
+  idstream is(filename);
+
+  if (!is) {
+    logfile << "Checkpoint: cannot open ", filename, endl;
+    return false;
+  }
+
+  CheckpointHeader header;
+  is >> header;
+
+  if ((!is) | (header.magic != CheckpointHeader::MAGIC)) {
+    logfile << "Checkpoint: ", filename, " is not a PTLsim checkpoint", endl;
+    return false;
+  }
+
+  Context* savedctx = new Context();
+  is.read(savedctx, sizeof(Context));
+
+  CheckpointExtent* extents = new CheckpointExtent[header.extent_count];
+  is.seek(header.extent_offset);
+  is.read(extents, header.extent_count * sizeof(CheckpointExtent));
+
+  if (!is) {
+    logfile << "Checkpoint: ", filename, " is truncated", endl;
+    delete savedctx;
+    delete[] extents;
+    return false;
+  }
+
+  //
+  // Make sure none of the saved extents would land on top of PTLsim's
+  // own memory in this process before anything is changed.
+  //
+  MemoryMapExtent* mapstart = (MemoryMapExtent*)ptl_mm_alloc_private_pages(MAX_MAPS_PER_PROCESS * sizeof(MemoryMapExtent));
+  int n = mqueryall(mapstart, MAX_MAPS_PER_PROCESS);
+
+  bool conflict = false;
+
+  foreach (i, n) {
+    const MemoryMapExtent& map = mapstart[i];
+    if (is_user_extent(map)) continue;
+
+    foreach (j, header.extent_count) {
+      const CheckpointExtent& extent = extents[j];
+      if (((Waddr)map.start < (extent.start + extent.length)) && (((Waddr)map.start + map.length) > extent.start)) {
+        logfile << "Checkpoint: saved extent ", (void*)(Waddr)extent.start, " (", extent.length, " bytes) overlaps PTLsim memory at ", map, endl;
+        conflict = true;
+      }
+    }
+  }
+
+  if (conflict) {
+    ptl_mm_free_private_pages(mapstart, MAX_MAPS_PER_PROCESS * sizeof(MemoryMapExtent));
+    delete savedctx;
+    delete[] extents;
+    return false;
+  }
+
+  //
+  // Grow the heap the kernel knows about to the saved brk, so later
+  // brk calls by the program extend it from the right place.
+  //
+  void* brkbase = sys_brk(0);
+  if ((Waddr)brkbase != header.brkbase) {
+    logfile << "Checkpoint: warning: heap starts at ", brkbase, " but was at ", (void*)(Waddr)header.brkbase, " when saved (is address space randomization enabled?)", endl;
+  }
+  sys_brk((void*)(Waddr)header.brk);
+
+  // Drop the freshly loaded program so nothing stale stays accessible
+  foreach (i, n) {
+    const MemoryMapExtent& map = mapstart[i];
+    if (is_user_extent(map)) sys_munmap(map.start, map.length);
+  }
+
+  ptl_mm_free_private_pages(mapstart, MAX_MAPS_PER_PROCESS * sizeof(MemoryMapExtent));
+
+  W64 mapped_bytes = 0;
+
+  foreach (i, header.extent_count) {
+    const CheckpointExtent& extent = extents[i];
+    void* p;
+
+    if (extent.offset) {
+      p = sys_mmap((void*)(Waddr)extent.start, extent.length, extent.prot, MAP_PRIVATE|MAP_FIXED, is.filehandle(), extent.offset);
+      mapped_bytes += extent.length;
+    } else {
+      p = sys_mmap((void*)(Waddr)extent.start, extent.length, extent.prot, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, 0, 0);
+    }
+
+    if (mmap_invalid(p)) {
+      logfile << "Checkpoint: cannot map extent ", (void*)(Waddr)extent.start, " (", extent.length, " bytes)", endl, flush;
+      assert(false);
+    }
+  }
+
+  delete[] extents;
+
+  //
+  // The machine state is only useful if the restored run also warms
+  // (otherwise the out of order core resets it on every run anyway).
+  //
+  if (header.machine_state_offset) {
+    PTLsimMachine* machine = PTLsimMachine::getmachine("ooo");
+
+    if (!config.functional_warming) {
+      logfile << "Checkpoint: ignoring saved cache and predictor state (use -warm to restore it)", endl;
+    } else if (machine) {
+      if (!machine->initialized) machine->initialized = machine->init(config);
+      is.seek(header.machine_state_offset);
+      if (machine->initialized && machine->load_checkpoint(is, header.machine_state_size)) {
+        logfile << "Checkpoint: restored warmed cache and predictor state", endl;
+      }
+    }
+  }
+
+  // The mappings stay valid after the file is closed
+  is.close();
+
+  ctx = *savedctx;
+  delete savedctx;
+
+  ctx.vcpuid = 0;
+  ctx.running = 1;
+  ctx.commitarf[REG_ctx] = (Waddr)&ctx;
+  ctx.commitarf[REG_fpstack] = (Waddr)&ctx.fpstack;
+  ctx.update_shadow_segment_descriptors();
+
+#ifdef __x86_64__
+  // The thread pointer lives in the kernel, not in the saved context:
+  if (ctx.use64) {
+    sys_arch_prctl(ARCH_SET_FS, (void*)(Waddr)ctx.seg[SEGID_FS].base);
+    sys_arch_prctl(ARCH_SET_GS, (void*)(Waddr)ctx.seg[SEGID_GS].base);
+  }
+#endif
+
+  total_user_insns_committed = header.insns;
+
+  logfile << "Checkpoint: restored ", header.extent_count, " memory extents (", (mapped_bytes >> 20), " MB mapped on demand) at ", total_user_insns_committed, " commits from ", filename, endl, flush;
+
+  asp.resync_with_process_maps();
+
+  PTLsimThunkPagePrivate* thunkpage = (PTLsimThunkPagePrivate*)PTLSIM_THUNK_PAGE;
+  thunkpage->call_code_addr = (Waddr)&thunkpage->call_within_sim_thunk;
+  thunkpage->simulated = 1;
+
+  logfile << endl, "=== Switching to simulation mode at checkpoint rip ", (void*)(Waddr)ctx.commitarf[REG_rip], " ===", endl, endl, flush;
+
+  switch_to_sim();
+  return true;
+}
+
+//
+// PTLsim's own pages are shared anonymous mappings (this is how
+// resync_with_process_maps() tells them apart from user memory),
+// so a forked child would write straight into its parent's
+// simulator state, including the stack both are running on.
+// Before forking, turn every such mapping into a private one with
+// the same contents, so the child gets copy-on-write copies.
+//
+// Each mapping is copied and then moved over the original with
+// mremap in one asm block, so even the stack we are running on
+// can be replaced: nothing touches the stack between the copy and
+// the switch.
+//
+#ifdef __x86_64__
+static W64 copy_and_replace_mapping(void* start, void* copy, Waddr length) {
+  register W64 flags asm("r10") = MREMAP_MAYMOVE|MREMAP_FIXED;
+  register W64 target asm("r8") = (W64)start;
+  W64 rc;
+
+  asm volatile("mov %[copy],%%rdi\n"
+               "mov %[start],%%rsi\n"
+               "mov %[length],%%rcx\n"
+               "rep movsb\n"
+               "mov %[copy],%%rdi\n"
+               "mov %[length],%%rsi\n"
+               "mov %[length],%%rdx\n"
+               "mov %[nr],%%eax\n"
+               "syscall\n"
+               : "=a" (rc)
+               : [copy] "r" (copy), [start] "r" (start), [length] "r" (length), [nr] "i" (__NR_mremap), "r" (flags), "r" (target)
+               : "rdi", "rsi", "rcx", "rdx", "r11", "memory");
+
+  return rc;
+}
+#endif
+
+bool privatize_ptlsim_memory() {
+#ifdef __x86_64__
+  MemoryMapExtent* mapstart = (MemoryMapExtent*)sys_mmap(null, MAX_MAPS_PER_PROCESS * sizeof(MemoryMapExtent), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+  if (mmap_invalid(mapstart)) return false;
+
+  int n = mqueryall(mapstart, MAX_MAPS_PER_PROCESS);
+  bool ok = true;
+
+  foreach (i, n) {
+    const MemoryMapExtent& map = mapstart[i];
+    if (!((map.flags & MAP_ZERO) && (map.flags & MAP_SHARED))) continue;
+
+    // Skip anything unmapped since the maps were read (e.g. mqueryall's own buffer)
+    if (sys_mprotect(map.start, map.length, map.prot | PROT_READ)) continue;
+
+    void* copy = sys_mmap(null, map.length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, 0, 0);
+    if (mmap_invalid(copy)) { ok = false; continue; }
+
+    if (mmap_invalid((void*)(Waddr)copy_and_replace_mapping(map.start, copy, map.length))) {
+      sys_munmap(copy, map.length);
+      ok = false;
+      continue;
+    }
+
+    sys_mprotect(map.start, map.length, map.prot);
+  }
+
+  sys_munmap(mapstart, MAX_MAPS_PER_PROCESS * sizeof(MemoryMapExtent));
+  return ok;
+#else
+  return false;
+#endif
+}
+
 void user_process_terminated(int rc) {
   x86_set_mxcsr(MXCSR_DEFAULT);
   logfile << "user_process_terminated(rc = ", rc, "): initiating shutdown at ", sim_cycle, " cycles, ", total_user_insns_committed, " commits...", endl, flush;
@@ -2264,6 +2635,12 @@ void switch_to_sim() {
   capture_stats_snapshot("final");
   flush_stats();
 
+  if (config.save_checkpoint_filename.set()) {
+    if (!save_checkpoint(config.save_checkpoint_filename)) {
+      cerr << "ptlsim: cannot save checkpoint to ", config.save_checkpoint_filename, endl, flush;
+    }
+  }
+
   done |= (config.dump_at_end | config.overshoot_and_dump);
 
   // Sanitize flags (AMD and Intel CPUs also use bits 1 and 3 for reserved bits, but not for INV and WAIT like we do).
@@ -2342,6 +2719,7 @@ int main(int argc, char** argv) {
     logfile << "ptlsim: Continuing...", endl, flush;
   }
 
+  detect_host_cpu_features();
   init_uops();
   init_decode();
 
@@ -2350,6 +2728,17 @@ int main(int argc, char** argv) {
 
   logfile << "loader: interp_entry ", interp_entry, ", program_entry ", program_entry, endl, flush;
 
+  if (config.load_checkpoint_filename.set()) {
+    if (config.save_checkpoint_filename.set() && strequal(config.save_checkpoint_filename, config.load_checkpoint_filename)) {
+      cerr << "ptlsim: cannot save a checkpoint over the one being restored", endl, flush;
+      sys_exit(1);
+    }
+
+    load_checkpoint(config.load_checkpoint_filename);
+    cerr << "ptlsim: cannot restore checkpoint ", config.load_checkpoint_filename, " (see log)", endl, flush;
+    sys_exit(1);
+  }
+
   if (!config.trigger_mode) {
     if (config.start_at_rip != INVALIDRIP)
       set_switch_to_sim_breakpoint((void*)(Waddr)config.start_at_rip);
@@ -418,4 +418,13 @@ extern bool inside_ptlsim;
 
 extern bool requested_switch_to_native;
 
+//
+// Checkpoints of the user process (see kernel.cpp)
+//
+bool save_checkpoint(const char* filename);
+bool load_checkpoint(const char* filename);
+
+// Make PTLsim's own memory private before forking
+bool privatize_ptlsim_memory();
+
 #endif // _KERNEL_H_
@@ -1526,6 +1526,76 @@ struct CommitRollbackCache: public LockableCommitRollbackAssociativeArray<T, V,
   void complete() { }
 };
 
+#ifdef __x86_64__
+//
+// Wide versions of the SSE tag compares used below, for hosts with
+// AVX2 or AVX-512BW (see host_cpu). Each compares 32 or 64 bytes of
+// tags at p against the byte or word replicated in target and returns
+// one bit per tag; with <any> set, a bit means (tag & target) == 0.
+//
+static inline W32 compress_even_bits32(W32 x) {
+  if likely (host_cpu.fastpext) return x86_pext32(x, 0x55555555);
+  x &= 0x55555555;
+  x = (x | (x >> 1)) & 0x33333333;
+  x = (x | (x >> 2)) & 0x0f0f0f0f;
+  x = (x | (x >> 4)) & 0x00ff00ff;
+  x = (x | (x >> 8)) & 0x0000ffff;
+  return x;
+}
+
+template <bool any>
+static inline W32 x86_avx2_match_bytes(const void* p, vec16b target) {
+  W32 mask;
+  if (any) {
+    asm("vpbroadcastb %[t],%%ymm1; vpand %[p],%%ymm1,%%ymm0; vpxor %%ymm1,%%ymm1,%%ymm1; vpcmpeqb %%ymm1,%%ymm0,%%ymm0; vpmovmskb %%ymm0,%[mask]; vzeroupper"
+        : [mask] "=r" (mask) : [p] "m" (*(const byte (*)[32])p), [t] "x" (target) : "xmm0", "xmm1");
+  } else {
+    asm("vpbroadcastb %[t],%%ymm1; vpcmpeqb %[p],%%ymm1,%%ymm0; vpmovmskb %%ymm0,%[mask]; vzeroupper"
+        : [mask] "=r" (mask) : [p] "m" (*(const byte (*)[32])p), [t] "x" (target) : "xmm0", "xmm1");
+  }
+  return mask;
+}
+
+template <bool any>
+static inline W32 x86_avx2_match_words(const void* p, vec8w target) {
+  W32 mask;
+  if (any) {
+    asm("vpbroadcastw %[t],%%ymm1; vpand %[p],%%ymm1,%%ymm0; vpxor %%ymm1,%%ymm1,%%ymm1; vpcmpeqw %%ymm1,%%ymm0,%%ymm0; vpmovmskb %%ymm0,%[mask]; vzeroupper"
+        : [mask] "=r" (mask) : [p] "m" (*(const byte (*)[32])p), [t] "x" (target) : "xmm0", "xmm1");
+  } else {
+    asm("vpbroadcastw %[t],%%ymm1; vpcmpeqw %[p],%%ymm1,%%ymm0; vpmovmskb %%ymm0,%[mask]; vzeroupper"
+        : [mask] "=r" (mask) : [p] "m" (*(const byte (*)[32])p), [t] "x" (target) : "xmm0", "xmm1");
+  }
+  return compress_even_bits32(mask);
+}
+
+template <bool any>
+static inline W64 x86_avx512_match_bytes(const void* p, vec16b target) {
+  W64 mask;
+  if (any) {
+    asm("vpbroadcastb %[t],%%zmm1; vptestnmb %[p],%%zmm1,%%k1; kmovq %%k1,%[mask]; vzeroupper"
+        : [mask] "=r" (mask) : [p] "m" (*(const byte (*)[64])p), [t] "x" (target) : "xmm1", "k1");
+  } else {
+    asm("vpbroadcastb %[t],%%zmm1; vpcmpeqb %[p],%%zmm1,%%k1; kmovq %%k1,%[mask]; vzeroupper"
+        : [mask] "=r" (mask) : [p] "m" (*(const byte (*)[64])p), [t] "x" (target) : "xmm1", "k1");
+  }
+  return mask;
+}
+
+template <bool any>
+static inline W32 x86_avx512_match_words(const void* p, vec8w target) {
+  W32 mask;
+  if (any) {
+    asm("vpbroadcastw %[t],%%zmm1; vptestnmw %[p],%%zmm1,%%k1; kmovd %%k1,%[mask]; vzeroupper"
+        : [mask] "=r" (mask) : [p] "m" (*(const byte (*)[64])p), [t] "x" (target) : "xmm1", "k1");
+  } else {
+    asm("vpbroadcastw %[t],%%zmm1; vpcmpeqw %[p],%%zmm1,%%k1; kmovd %%k1,%[mask]; vzeroupper"
+        : [mask] "=r" (mask) : [p] "m" (*(const byte (*)[64])p), [t] "x" (target) : "xmm1", "k1");
+  }
+  return mask;
+}
+#endif
+
 template <int size, int padsize = 0>
 struct FullyAssociativeTags8bit {
   typedef vec16b vec_t;
@@ -1579,8 +1649,17 @@ struct FullyAssociativeTags8bit {
 
   bitvec<size> match(const vec_t target) const {
     bitvec<size> m = 0;
+    int i = 0;
 
-    foreach (i, chunkcount) {
+#ifdef __x86_64__
+    if ((chunkcount >= 4) && host_cpu.avx512bw) {
+      for (; (i+4) <= chunkcount; i += 4) m = m.accum(i*16, 64, x86_avx512_match_bytes<0>(&tags[i], target));
+    } else if ((chunkcount >= 2) && host_cpu.avx2) {
+      for (; (i+2) <= chunkcount; i += 2) m = m.accum(i*16, 32, x86_avx2_match_bytes<0>(&tags[i], target));
+    }
+#endif
+
+    for (; i < chunkcount; i++) {
       m = m.accum(i*16, 16, x86_sse_pmovmskb(x86_sse_pcmpeqb(target, tags[i])));
     }
 
@@ -1595,8 +1674,17 @@ struct FullyAssociativeTags8bit {
     bitvec<size> m = 0;
 
     vec_t zero = prep(0);
+    int i = 0;
 
-    foreach (i, chunkcount) {
+#ifdef __x86_64__
+    if ((chunkcount >= 4) && host_cpu.avx512bw) {
+      for (; (i+4) <= chunkcount; i += 4) m = m.accum(i*16, 64, x86_avx512_match_bytes<1>(&tags[i], target));
+    } else if ((chunkcount >= 2) && host_cpu.avx2) {
+      for (; (i+2) <= chunkcount; i += 2) m = m.accum(i*16, 32, x86_avx2_match_bytes<1>(&tags[i], target));
+    }
+#endif
+
+    for (; i < chunkcount; i++) {
       m = m.accum(i*16, 16, x86_sse_pmovmskb(x86_sse_pcmpeqb(x86_sse_pandb(tags[i], target), zero)));
     }
 
@@ -1741,8 +1829,17 @@ struct FullyAssociativeTags16bit {
 
   bitvec<size> match(const vec_t target) const {
     bitvec<size> m = 0;
+    int i = 0;
 
-    foreach (i, chunkcount) {
+#ifdef __x86_64__
+    if ((chunkcount >= 4) && host_cpu.avx512bw) {
+      for (; (i+4) <= chunkcount; i += 4) m = m.accum(i*8, 32, x86_avx512_match_words<0>(&tags[i], target));
+    } else if ((chunkcount >= 2) && host_cpu.avx2) {
+      for (; (i+2) <= chunkcount; i += 2) m = m.accum(i*8, 16, x86_avx2_match_words<0>(&tags[i], target));
+    }
+#endif
+
+    for (; i < chunkcount; i++) {
       m = m.accum(i*8, 8, x86_sse_pmovmskw(x86_sse_pcmpeqw(target, tags[i])));
     }
 
@@ -1757,8 +1854,17 @@ struct FullyAssociativeTags16bit {
     bitvec<size> m = 0;
 
     vec_t zero = prep(0);
+    int i = 0;
 
-    foreach (i, chunkcount) {
+#ifdef __x86_64__
+    if ((chunkcount >= 4) && host_cpu.avx512bw) {
+      for (; (i+4) <= chunkcount; i += 4) m = m.accum(i*8, 32, x86_avx512_match_words<1>(&tags[i], target));
+    } else if ((chunkcount >= 2) && host_cpu.avx2) {
+      for (; (i+2) <= chunkcount; i += 2) m = m.accum(i*8, 16, x86_avx2_match_words<1>(&tags[i], target));
+    }
+#endif
+
+    for (; i < chunkcount; i++) {
       m = m.accum(i*8, 8, x86_sse_pmovmskw(x86_sse_pcmpeqw(x86_sse_pandw(tags[i], target), zero)));
     }
 
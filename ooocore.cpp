@@ -17,6 +17,7 @@
 
 #define INSIDE_OOOCORE
 #define DECLARE_STRUCTURES
+#include <decode.h>
 #include <ooocore.h>
 #include <stats.h>
 
@@ -47,6 +48,7 @@ void StateList::init(const char* name, ListOfStateLists& lol, W32 flags) {
 void StateList::reset() {
   selfqueuelink::reset();
   count = 0;
+  robmask = 0;
   dispatch_source_counter = 0;
   issue_source_counter = 0;
 }
@@ -120,7 +122,8 @@ void ThreadContext::reset() {
   dispatch_deadlock_countdown = 0;    
   issueq_count = 0;
   queued_mem_lock_release_count = 0;
-  branchpred.init();
+  // Keep any predictor state warmed up by the sequential core
+  if (!(config.functional_warming && branchpred.impl)) branchpred.init();
 }
 
 void ThreadContext::init() {
@@ -149,7 +152,8 @@ void ThreadContext::init() {
 void OutOfOrderCore::reset() {
   round_robin_tid = 0;
   round_robin_reg_file_offset = 0;
-  caches.reset();
+  // Keep any cache and TLB contents warmed up by the sequential core
+  if (config.functional_warming) caches.reset_pending(); else caches.reset();
   caches.callback = &cache_callbacks;
   setzero(robs_on_fu);
   foreach_issueq(reset(coreid));
@@ -166,6 +170,7 @@ void OutOfOrderCore::reset() {
 }
 
 void OutOfOrderCore::init_generic() {
+  caches.reset();
   reset();
 }
 
@@ -313,6 +318,60 @@ int ThreadContext::get_priority() const {
   return priority;
 }
 
+//
+// A thread is quiescent when none of its uops can make any
+// progress until the cache hierarchy delivers an outstanding
+// miss: fetch is stalled, nothing is moving through the
+// frontend or the execution pipelines, and the uop at the
+// head of the ROB cannot commit.
+//
+bool ThreadContext::quiescent() {
+  if unlikely (!ctx.running) return true;
+
+#ifdef PTLSIM_HYPERVISOR
+  if unlikely (ctx.check_events()) return false;
+#endif
+
+  if (!(stall_frontend | waiting_for_icache_fill | (!fetchq.remaining()))) return false;
+  if (!rob_frontend_list.empty()) return false;
+  if (!rob_tlb_miss_list.empty()) return false;
+
+  for_each_cluster (cluster) {
+    if (!rob_ready_to_issue_list[cluster].empty()) return false;
+    if (!rob_ready_to_store_list[cluster].empty()) return false;
+    if (!rob_ready_to_load_list[cluster].empty()) return false;
+    if (!rob_issued_list[cluster].empty()) return false;
+    if (!rob_completed_list[cluster].empty()) return false;
+    if (!rob_ready_to_writeback_list[cluster].empty()) return false;
+  }
+
+  if ((!ROB.empty()) && ROB.peekhead()->ready_to_commit()) return false;
+
+  //
+  // Uops stuck in dispatch (because the issue queues are full) count
+  // down towards redispatch_deadlock_recovery(); this only stays
+  // periodic (see skip_idle_cycles()) while loads are missing.
+  //
+  if ((!rob_ready_to_dispatch_list.empty()) && rob_cache_miss_list.empty()) return false;
+
+  return true;
+}
+
+//
+// Account for <delta> idle cycles skipped by the core
+//
+void ThreadContext::skip_idle_cycles(W64 delta) {
+  if likely (rob_ready_to_dispatch_list.empty()) return;
+
+  //
+  // dispatch() decrements the countdown once per idle cycle and
+  // reloads it when it reaches zero with cache misses outstanding:
+  //
+  W64 countdown = dispatch_deadlock_countdown - 1;
+  countdown = (countdown + DISPATCH_DEADLOCK_COUNTDOWN_CYCLES - (delta % DISPATCH_DEADLOCK_COUNTDOWN_CYCLES)) % DISPATCH_DEADLOCK_COUNTDOWN_CYCLES;
+  dispatch_deadlock_countdown = countdown + 1;
+}
+
 //
 // Execute one cycle of the entire core state machine
 //
@@ -395,7 +454,8 @@ bool OutOfOrderCore::runcycle() {
   //
   // Issue whatever is ready
   //
-  for_each_cluster(i) { issue(i); }
+  issuecount = 0;
+  for_each_cluster(i) { issuecount += issue(i); }
 
   //
   // Most of the frontend (except fetch!) also works with round robin priority
@@ -568,7 +628,7 @@ bool OutOfOrderCore::runcycle() {
       //
       logfile << "VCPU ", vctx.vcpuid, " context was dirty: update core model internal state", endl;
 
-      ThreadContext* tc = threads[vctx.vcpuid];
+      ThreadContext* tc = machine.threadof(vctx);
       assert(tc);
       assert(&tc->ctx == &vctx);
       tc->flush_pipeline();
@@ -595,6 +655,33 @@ bool OutOfOrderCore::runcycle() {
   return exiting;
 }
 
+//
+// If the cycle just simulated did no work and every thread is
+// quiescent, the core will keep repeating that cycle until the
+// cache hierarchy delivers the next outstanding miss. Return the
+// number of such repeat cycles, or 0 if the core is not idle.
+//
+W64 OutOfOrderCore::idle_cycles_to_skip() {
+  if unlikely (config.event_log_enabled) return 0;
+  if likely (commitcount | writecount | dispatchcount | issuecount) return 0;
+
+  foreach (i, threadcount) {
+    if likely (!threads[i]->quiescent()) return 0;
+  }
+
+  int cycles = caches.cycles_to_next_event();
+
+  // Nothing outstanding: the core is stuck, and the deadlock detector will take care of it
+  if unlikely (cycles == limits<int>::max) return 0;
+
+  return max(cycles - 1, 0);
+}
+
+void OutOfOrderCore::skip_idle_cycles(W64 delta) {
+  caches.skip_cycles(delta);
+  foreach (i, threadcount) threads[i]->skip_idle_cycles(delta);
+}
+
 //
 // ReorderBufferEntry
 //
@@ -881,15 +968,18 @@ void OutOfOrderCore::check_rob() {
     foreach (i, rob_states.count) {
       StateList& list = *(thread->rob_states[i]);
       ReorderBufferEntry* rob;
+      bitvec<ROB_SIZE> listmask = 0;
       foreach_list_mutable(list, rob, entry, nextentry) {
         assert(inrange(rob->index(), 0, ROB_SIZE-1));
         assert(rob->current_state_list == &list);
+        listmask[rob->index()] = 1;
         if (!((rob->current_state_list != &thread->rob_free_list) ? rob->entry_valid : (!rob->entry_valid))) {
           logfile << "ROB ", rob->index(), " list = ", rob->current_state_list->name, " entry_valid ", rob->entry_valid, endl, flush;
           dump_smt_state(logfile);
         assert(false);
         }
       }
+      assert(listmask == list.robmask);
     }
   }
 }
@@ -1128,6 +1218,36 @@ bool EventLog::init(size_t bufsize) {
   return true;
 }
 
+void EventLog::setup_filters() {
+  riplo = config.event_log_rip_start;
+  riphi = config.event_log_rip_end;
+  uuidlo = config.event_log_uuid_start;
+  uuidhi = config.event_log_uuid_end;
+  threadid = config.event_log_thread;
+
+  if (config.event_log_types.set()) {
+    typemask = 0;
+    dynarray<char*> prefixes;
+    char* types = strdup(config.event_log_types);
+    prefixes.tokenize(types, ",");
+    foreach (i, prefixes.count()) {
+      int n = strlen(prefixes[i]);
+      foreach (type, EVENT_TYPE_COUNT) {
+        if (strncmp(event_type_names[type], prefixes[i], n) == 0) typemask[type] = 1;
+      }
+    }
+    free(types);
+  } else {
+    typemask.setall();
+  }
+
+  filtered = ((~typemask).nonzero() | (riplo != 0) | (riphi != infinity) |
+              (uuidlo != 0) | (uuidhi != infinity) | (threadid != infinity));
+
+  if (filtered) ::logfile << "Event log filters: ", typemask.popcount(), " of ", (int)EVENT_TYPE_COUNT, " event types, rips ",
+                  (void*)(Waddr)riplo, " to ", (void*)(Waddr)riphi, ", uuids ", uuidlo, " to ", uuidhi, ", thread ", (W64s)threadid, endl;
+}
+
 void EventLog::reset() {
   if (!start) return;
 
@@ -1138,7 +1258,66 @@ void EventLog::reset() {
   tail = null;
 }
 
+//
+// All cores share one trace file and one compression buffer; chunks
+// are written synchronously, since the PTLsim runtime has no host
+// threads to hand them off to.
+//
+static odstream eventtrace;
+static byte* eventtrace_buf = null;
+static size_t eventtrace_buf_bytes = 0;
+
+static bool open_event_trace(const char* filename, size_t ringsize) {
+  if (eventtrace.ok()) return true;
+
+  eventtrace_buf_bytes = ceil(delta_rle_max_bytes(ringsize * sizeof(OutOfOrderCoreEvent)), PAGE_SIZE);
+  eventtrace_buf = (byte*)ptl_mm_alloc_private_pages(eventtrace_buf_bytes);
+  if unlikely (!eventtrace_buf) return false;
+
+  eventtrace.open(filename, false, 1048576);
+  if unlikely (!eventtrace.ok()) {
+    logfile << "Warning: cannot open event trace file '", filename, "'", endl;
+    ptl_mm_free_private_pages(eventtrace_buf, eventtrace_buf_bytes);
+    eventtrace_buf = null;
+    return false;
+  }
+
+  EventTraceHeader header;
+  setzero(header);
+  header.magic = EVENT_TRACE_MAGIC;
+  header.version = EVENT_TRACE_VERSION;
+  header.eventsize = sizeof(OutOfOrderCoreEvent);
+  eventtrace.write(&header, sizeof(header));
+
+  return true;
+}
+
+bool EventLog::write_trace(const OutOfOrderCoreEvent* first, int count) {
+  if unlikely (!count) return true;
+
+  EventTraceChunk chunk;
+  setzero(chunk);
+  chunk.magic = EVENT_TRACE_CHUNK_MAGIC;
+  chunk.coreid = coreid;
+  chunk.count = count;
+  chunk.bytes = delta_rle_compress(eventtrace_buf, first, sizeof(OutOfOrderCoreEvent), count);
+  chunk.firstcycle = first[0].cycle;
+  chunk.lastcycle = first[count-1].cycle;
+
+  tracefile->write(&chunk, sizeof(chunk));
+  tracefile->write(eventtrace_buf, chunk.bytes);
+  return tracefile->ok();
+}
+
 void EventLog::flush(bool only_to_tail) {
+  if unlikely (tracefile) {
+    // When the ring wraps, add() rewinds tail before calling us with the whole buffer full.
+    // Otherwise a ring filled exactly to the end has tail == end, so count before rewinding:
+    write_trace(start, (only_to_tail ? (tail - start) : (end - start)));
+    tail = start;
+    return;
+  }
+
   if likely (!logable(6)) return;
   if unlikely (!logfile) return;
   if unlikely (!logfile->ok()) return;
@@ -1147,6 +1326,7 @@ void EventLog::flush(bool only_to_tail) {
 }
 
 ostream& EventLog::print(ostream& os, bool only_to_tail) {
+  size_t tailcount = (tail > start) ? (tail - start) : 0;
   if (tail >= end) tail = start;
   if (tail < start) tail = end;
 
@@ -1157,7 +1337,7 @@ ostream& EventLog::print(ostream& os, bool only_to_tail) {
 
   if (!config.flush_event_log_every_cycle) os << "#-------- Start of event log --------", endl;
 
-  foreach (i, (only_to_tail ? (tail - start) : bufsize)) {
+  foreach (i, (only_to_tail ? tailcount : bufsize)) {
     if unlikely (p >= end) p = start;
     if unlikely (p < start) p = end-1;
     if unlikely (p->type == EVENT_INVALID) {
@@ -1672,38 +1852,121 @@ OutOfOrderMachine::OutOfOrderMachine(const char* name) {
 //
 
 bool OutOfOrderMachine::init(PTLsimConfig& config) {
-  // Note: we only create a single core for all contexts for now.
-  cores[0] = new OutOfOrderCore(0, *this);
+  int mincores = (contextcount + MAX_THREADS_PER_CORE - 1) / MAX_THREADS_PER_CORE;
+  corecount = clipto((int)config.ooo_core_count, mincores, min(contextcount, MAX_SMT_CORES));
+
+  if unlikely (corecount != config.ooo_core_count) {
+    logfile << "Out of order core: ", contextcount, " VCPUs with up to ", MAX_THREADS_PER_CORE, " threads per core need ",
+      mincores, " to ", contextcount, " cores; using ", corecount, " cores", endl;
+  }
 
+  foreach (i, corecount) cores[i] = new OutOfOrderCore(i, *this);
+
+  //
+  // VCPUs are dealt out round robin, so each core gets
+  // at most one more thread than any other core.
+  //
   foreach (i, contextcount) {
-    OutOfOrderCore& core = *cores[0];
-    core.threadcount++;
-    ThreadContext* thread = new ThreadContext(core, i, contextof(i));
-    core.threads[i] = thread;
+    OutOfOrderCore& core = *cores[i % corecount];
+    int threadid = core.threadcount++;
+    ThreadContext* thread = new ThreadContext(core, threadid, contextof(i));
+    core.threads[threadid] = thread;
+    core.caches.vcpuids[threadid] = i;
+    vcputhreads[i] = thread;
     thread->init();
-
-    //
-    // Note: in a multi-processor model, config may
-    // specify various ways of slicing contextcount up
-    // into threads, cores and sockets; the appropriate
-    // interconnect and cache hierarchy parameters may
-    // be specified here.
-    //
   }
 
-  cores[0]->init();
+  foreach (i, corecount) cores[i]->init();
   init_luts();
   return true;
 }
 
+//
+// Idle cycle skipping
+//
+// While every thread is blocked on the cache hierarchy, each
+// cycle exactly repeats the previous one until the next miss
+// buffer delivery. The core and cache statistics are saved
+// before simulating one such idle cycle; the difference after
+// it is then credited once per skipped cycle, so the width
+// histograms and stall counters come out exactly as if every
+// cycle had been simulated. Only integer counters are repeated,
+// following the stats template; the floating point fields are
+// derived values or host timings.
+//
+struct IdleCycleStats {
+  OutOfOrderCoreStats ooocore;
+  DataCacheStats dcache;
+};
+
+static IdleCycleStats idle_cycle_stats_base;
+
+template <typename T>
+static void add_repeated_delta(const char* path, T& current, const T& base, W64 repeat) {
+  W64 offset;
+  const DataStoreNodeTemplate* dst = stats_template().searchpath(path, offset);
+  assert(dst && ((dst->words() * sizeof(W64)) == sizeof(T)));
+
+  W64* p = (W64*)&current;
+  const W64* q = (const W64*)&base;
+  dst->addrepeated(p, q, repeat);
+}
+
+//
+// With -host-profile <n>, one core cycle in every <n> is timed,
+// stage by stage, by the cycle timers in the pipeline functions.
+//
+static W64 host_profile_countdown = 1;
+
+//
+// Advance every core by <cycles> cycles, each starting from the
+// same sim_cycle. A core that wants to exit stops at that cycle,
+// but the other cores still finish the quantum.
+//
+bool OutOfOrderMachine::runquantum(W64 cycles) {
+  W64 start_cycle = sim_cycle;
+  bool exiting = false;
+
+  foreach (i, corecount) {
+    OutOfOrderCore& core = *cores[i];
+    sim_cycle = start_cycle;
+
+    for (W64 c = 0; c < cycles; c++) {
+      bool core_exiting;
+
+      if unlikely (config.host_profile_interval && (!(--host_profile_countdown))) {
+        host_profile_countdown = config.host_profile_interval;
+        host_profile_sampling = 1;
+        ctsampled.start();
+        core_exiting = core.runcycle();
+        ctsampled.stop();
+        host_profile_sampling = 0;
+        host_profile_samples++;
+      } else {
+        core_exiting = core.runcycle();
+      }
+
+      sim_cycle++;
+      if unlikely (core_exiting) {
+        exiting = true;
+        break;
+      }
+    }
+  }
+
+  sim_cycle = start_cycle + cycles;
+  return exiting;
+}
+
 //
 // Run the processor model, until a stopping point
 // is hit (as configured elsewhere in config).
 //
 int OutOfOrderMachine::run(PTLsimConfig& config) {
-  time_this_scope(cttotal);
+  // Always timed: this only costs two rdtscs per run
+  CycleTimerScope ctscope(cttotal);
 
-  logfile << "Starting out-of-order core toplevel loop", endl, flush;
+  logfile << "Starting out-of-order core toplevel loop with ", corecount, " cores", endl, flush;
 
   // All VCPUs are running:
   stopped = 0;
@@ -1713,18 +1976,28 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
     logenable = 1;
   }
 
-  cores[0]->reset();
-  cores[0]->flush_pipeline_all();
+  foreach (i, corecount) {
+    OutOfOrderCore& core = *cores[i];
+    core.reset();
+    core.flush_pipeline_all();
 
-  logfile << "IssueQueue states:", endl;
+    if unlikely (config.event_log_enabled && (!core.eventlog.start)) {
+      core.eventlog.init(config.event_log_ring_buffer_size);
+      core.eventlog.logfile = &logfile;
+      core.eventlog.coreid = core.coreid;
+      if unlikely (config.event_trace_filename.set() && open_event_trace(config.event_trace_filename, config.event_log_ring_buffer_size))
+        core.eventlog.tracefile = &eventtrace;
+    }
 
-  if unlikely (config.event_log_enabled && (!cores[0]->eventlog.start)) {
-    cores[0]->eventlog.init(config.event_log_ring_buffer_size);
-    cores[0]->eventlog.logfile = &logfile;
+    // The config may have been reparsed since the last run
+    if unlikely (core.eventlog.start) core.eventlog.setup_filters();
   }
 
+  logfile << "IssueQueue states:", endl;
+
   bool exiting = false;
   bool stopping = false;
+  bool idle_cycle_stats_valid = false;
 
   for (;;) {
     if unlikely (iterations >= config.start_log_at_iteration) {
@@ -1735,10 +2008,9 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
     update_progress();
     inject_events();
 
-    OutOfOrderCore& core =* cores[0]; // only one core for now
     int running_thread_count = 0;
-    foreach (i, core.threadcount) {
-      ThreadContext* thread = core.threads[i];
+    foreach (i, contextcount) {
+      ThreadContext* thread = vcputhreads[i];
 #ifdef PTLSIM_HYPERVISOR
       running_thread_count += thread->ctx.running;
       if unlikely (!thread->ctx.running) {
@@ -1754,13 +2026,27 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
 #endif
     }
 
-    exiting |= core.runcycle();
+    //
+    // A single core always runs one cycle at a time. Never run a
+    // quantum past the cycle where the simulation should stop. Once
+    // every core is idle, step one cycle so the idle skip below can
+    // repeat that single cycle's statistics delta.
+    //
+    W64 quantum = (corecount > 1) ? max(config.ooo_quantum_cycles, (W64)1) : 1;
+    if unlikely (sim_cycle < config.stop_at_cycle) quantum = min(quantum, config.stop_at_cycle - sim_cycle);
+    if unlikely (idle_cycle_stats_valid) quantum = 1;
+
+    if unlikely (idle_cycle_stats_valid) {
+      idle_cycle_stats_base.ooocore = stats.ooocore;
+      idle_cycle_stats_base.dcache = stats.dcache;
+    }
+
+    exiting |= runquantum(quantum);
 
     if unlikely (check_for_async_sim_break() && (!stopping)) {
       logfile << "Waiting for all VCPUs to reach stopping point, starting at cycle ", sim_cycle, endl;
       // force_logging_enabled();
-      OutOfOrderCore& core =* cores[0];
-      foreach (i, core.threadcount) core.threads[i]->stop_at_next_eom = 1;
+      foreach (i, contextcount) vcputhreads[i]->stop_at_next_eom = 1;
       if (config.abort_at_end) {
         config.abort_at_end = 0;
         logfile << "Abort immediately: do not wait for next x86 boundary nor flush pipelines", endl;
@@ -1770,11 +2056,56 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
       stopping = 1;
     }
 
-    stats.summary.cycles++;
-    stats.ooocore.cycles++;
-    sim_cycle++;
-    unhalted_cycle_count += (running_thread_count > 0);
-    iterations++;
+    stats.summary.cycles += quantum;
+    stats.ooocore.cycles += quantum;
+    if (running_thread_count > 0) unhalted_cycle_count += quantum;
+    iterations += quantum;
+
+    if unlikely (total_user_insns_committed >= stats_milestone.insns) {
+      update_stats(stats);
+      *stats_milestone.stats = stats;
+      stats_milestone.committed = total_user_insns_committed;
+      stats_milestone.insns = limits<W64>::max;
+    }
+
+    //
+    // Skip over idle cycles: the statistics delta of the idle cycle
+    // just simulated is credited once for every cycle skipped. With
+    // several cores, all of them must be idle, and only as long as
+    // the core with the earliest miss delivery.
+    //
+    if unlikely (config.skip_idle_cycles && (!stopping) && (!exiting)) {
+      W64 delta = limits<W64>::max;
+      foreach (i, corecount) delta = min(delta, cores[i]->idle_cycles_to_skip());
+
+      if unlikely (delta && idle_cycle_stats_valid) {
+        delta = min(delta, (sim_cycle < config.stop_at_cycle) ? (config.stop_at_cycle - sim_cycle) : 0);
+        delta = min(delta, (iterations < config.stop_at_iteration) ? (config.stop_at_iteration - iterations) : 0);
+        // CacheHierarchy::clock() must see this cycle to clear the cache statistics:
+        delta = min(delta, (W64)(0x7fffffff - (sim_cycle & 0x7fffffff)));
+
+        if likely (delta) {
+          add_repeated_delta("ooocore", stats.ooocore, idle_cycle_stats_base.ooocore, delta);
+          add_repeated_delta("dcache", stats.dcache, idle_cycle_stats_base.dcache, delta);
+          foreach (i, corecount) cores[i]->skip_idle_cycles(delta);
+
+          stats.summary.cycles += delta;
+          sim_cycle += delta;
+          if (running_thread_count > 0) unhalted_cycle_count += delta;
+          iterations += delta;
+
+          stats.ooocore.simulator.idle_skip.skips++;
+          stats.ooocore.simulator.idle_skip.cycles += delta;
+
+          // The next cycle will deliver a miss and is never idle:
+          delta = 0;
+        }
+      }
+
+      idle_cycle_stats_valid = (delta > 0);
+    } else {
+      idle_cycle_stats_valid = false;
+    }
 
     if unlikely (stopping) {
       // logfile << "Waiting for all VCPUs to stop at ", sim_cycle, ": mask = ", stopped, " (need ", contextcount, " VCPUs)", endl;
@@ -1786,10 +2117,8 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
 
   logfile << "Exiting out-of-order core at ", total_user_insns_committed, " commits, ", total_uops_committed, " uops and ", iterations, " iterations (cycles)", endl;
 
-  OutOfOrderCore& core =* cores[0]; /// only one core for now.
-
-  foreach (i, core.threadcount) {
-    ThreadContext* thread = core.threads[i];
+  foreach (i, contextcount) {
+    ThreadContext* thread = vcputhreads[i];
 
     thread->core_to_external_state();
 
@@ -1835,28 +2164,135 @@ void OutOfOrderCore::flush_tlb(Context& ctx, int threadid, bool selective, Waddr
 }
 
 void OutOfOrderMachine::flush_tlb(Context& ctx) {
-  // This assumes all VCPUs are mapped as threads in a single SMT core
-  int coreid = 0;
-  int threadid = ctx.vcpuid;
-  cores[coreid]->flush_tlb(ctx, threadid);
+  ThreadContext* thread = threadof(ctx);
+  thread->core.flush_tlb(ctx, thread->threadid);
 }
 
 void OutOfOrderMachine::flush_tlb_virt(Context& ctx, Waddr virtaddr) {
-  // This assumes all VCPUs are mapped as threads in a single SMT core
-  int coreid = 0;
-  int threadid = ctx.vcpuid;
-  cores[coreid]->flush_tlb(ctx, threadid, true, virtaddr);
+  ThreadContext* thread = threadof(ctx);
+  thread->core.flush_tlb(ctx, thread->threadid, true, virtaddr);
+}
+
+//
+// Functional warming
+//
+// The sequential core calls these for every committed load, store,
+// instruction and branch when -warm is enabled, so the caches, TLBs
+// and branch predictors are already warm when the out of order core
+// takes over. Only tags, LRU and predictor state are updated; no
+// timing is modeled and no statistics are counted.
+//
+void OutOfOrderMachine::warm_data_access(Context& ctx, Waddr virtaddr, W64 physaddr, bool store) {
+  ThreadContext* thread = threadof(ctx);
+  thread->core.caches.warm_data(virtaddr, physaddr, thread->threadid);
+  if unlikely (store) invalidate_other_cores(thread->core.coreid, physaddr);
+}
+
+//
+// A store committed on one core invalidates the line in the private
+// caches of every other core. The cores take turns within a quantum,
+// so the other cores see the write at their next access to the line.
+//
+void OutOfOrderMachine::invalidate_other_cores(int coreid, W64 physaddr) {
+  foreach (i, corecount) {
+    if likely (int(i) != coreid) cores[i]->caches.invalidate_line(physaddr);
+  }
+}
+
+void OutOfOrderMachine::warm_insn_fetch(Context& ctx, Waddr virtaddr, W64 physaddr) {
+  ThreadContext* thread = threadof(ctx);
+  thread->core.caches.warm_insn(virtaddr, physaddr, thread->threadid);
+}
+
+void OutOfOrderMachine::warm_branch(Context& ctx, const TransOp& uop, W64 ripafter, W64 target) {
+  ThreadContext* thread = threadof(ctx);
+
+  BranchPredictorUpdateInfo predinfo = BranchPredictorUpdateInfo();
+  predinfo.bptype =
+    (isclass(uop.opcode, OPCLASS_COND_BRANCH) << log2(BRANCH_HINT_COND)) |
+    (isclass(uop.opcode, OPCLASS_INDIR_BRANCH) << log2(BRANCH_HINT_INDIRECT)) |
+    (bit(uop.extshift, log2(BRANCH_HINT_PUSH_RAS)) << log2(BRANCH_HINT_CALL)) |
+    (bit(uop.extshift, log2(BRANCH_HINT_POP_RAS)) << log2(BRANCH_HINT_RET));
+  predinfo.ripafter = ripafter;
+
+  thread->branchpred.predict(predinfo, predinfo.bptype, ripafter, uop.riptaken);
+  if unlikely (predinfo.bptype & (BRANCH_HINT_CALL|BRANCH_HINT_RET)) thread->branchpred.updateras(predinfo, ripafter);
+  thread->branchpred.update(predinfo, ripafter, target);
+}
+
+//
+// Checkpoints keep the cache tags, TLBs and branch predictor
+// tables as raw images, so they are only valid for a PTLsim
+// binary built with the same cache and predictor geometry.
+//
+#ifdef ENABLE_L3_CACHE
+#define for_each_checkpointed_cache_array(caches, action) action(caches.L1); action(caches.L1I); action(caches.L2); action(caches.L3); action(caches.dtlb); action(caches.itlb)
+#else
+#define for_each_checkpointed_cache_array(caches, action) action(caches.L1); action(caches.L1I); action(caches.L2); action(caches.dtlb); action(caches.itlb)
+#endif
+
+bool OutOfOrderMachine::save_checkpoint(odstream& os) {
+  foreach (c, corecount) {
+    OutOfOrderCore& core = *cores[c];
+
+#define save_array(a) os.write(&(a), sizeof(a))
+    for_each_checkpointed_cache_array(core.caches, save_array);
+#undef save_array
+
+    foreach (i, core.threadcount) core.threads[i]->branchpred.save(os);
+  }
+
+  return os.ok();
+}
+
+bool OutOfOrderMachine::load_checkpoint(idstream& is, W64 size) {
+  W64 expected = contextcount * BranchPredictorInterface::state_size();
+  foreach (c, corecount) {
+#define add_array_size(a) expected += sizeof(a)
+    for_each_checkpointed_cache_array(cores[c]->caches, add_array_size);
+#undef add_array_size
+  }
+
+  if unlikely (size != expected) {
+    logfile << "Checkpoint: out of order core state is ", size, " bytes but these ", corecount, " cores need ", expected, " bytes; not restoring it", endl;
+    return false;
+  }
+
+  bool ok = true;
+  foreach (c, corecount) {
+    OutOfOrderCore& core = *cores[c];
+
+#define load_array(a) ok &= (is.read(&(a), sizeof(a)) == sizeof(a))
+    for_each_checkpointed_cache_array(core.caches, load_array);
+#undef load_array
+
+    foreach (i, core.threadcount) ok &= core.threads[i]->branchpred.restore(is);
+  }
+
+  if unlikely (!ok) {
+    // Never leave partially restored arrays behind
+    foreach (c, corecount) {
+      OutOfOrderCore& core = *cores[c];
+      core.caches.reset();
+      foreach (i, core.threadcount) core.threads[i]->branchpred.init();
+    }
+  }
+
+  return ok;
 }
 
 void OutOfOrderMachine::dump_state(ostream& os) {
   os << " dump_state include event if -ringbuf enabled: ",endl;
   //  foreach (i, contextcount) {
-  foreach (i, MAX_SMT_CORES) {
+  foreach (i, corecount) {
     os << " dump_state for core ", i,endl,flush;
     if (!cores[i]) continue;
     OutOfOrderCore& core =* cores[i];
-    Context& ctx = contextof(i);
-    if unlikely (config.event_log_enabled) 
+    if unlikely (core.eventlog.tracefile) {
+      core.eventlog.flush(true);
+      eventtrace.flush();
+      os << " event log was written to ", config.event_trace_filename, endl;
+    } else if unlikely (config.event_log_enabled) 
                   core.eventlog.print(logfile);
     else
       os << " config.event_log_enabled is not enabled ", config.event_log_enabled, endl;
@@ -1895,6 +2331,10 @@ namespace OutOfOrderModel {
   CycleTimer cttransfer;
   CycleTimer ctwriteback;
   CycleTimer ctcommit;
+  CycleTimer ctsampled;
+
+  bool host_profile_sampling = 0;
+  W64 host_profile_samples = 0;
 };
 
 void OutOfOrderMachine::update_stats(PTLsimStats& stats) {
@@ -1911,18 +2351,46 @@ void OutOfOrderMachine::update_stats(PTLsimStats& stats) {
   s.commit.ipc = (double)s.commit.insns / (double)stats.ooocore.cycles;
 
   stats.ooocore.simulator.total_time = cttotal.seconds();
-  stats.ooocore.simulator.cputime.fetch = ctfetch.seconds();
-  stats.ooocore.simulator.cputime.decode = ctdecode.seconds();
-  stats.ooocore.simulator.cputime.rename = ctrename.seconds();
-  stats.ooocore.simulator.cputime.frontend = ctfrontend.seconds();
-  stats.ooocore.simulator.cputime.dispatch = ctdispatch.seconds();
-  stats.ooocore.simulator.cputime.issue = ctissue.seconds() - (ctissueload.seconds() + ctissuestore.seconds());
-  stats.ooocore.simulator.cputime.issueload = ctissueload.seconds();
-  stats.ooocore.simulator.cputime.issuestore = ctissuestore.seconds();
-  stats.ooocore.simulator.cputime.complete = ctcomplete.seconds();
-  stats.ooocore.simulator.cputime.transfer = cttransfer.seconds();
-  stats.ooocore.simulator.cputime.writeback = ctwriteback.seconds();
-  stats.ooocore.simulator.cputime.commit = ctcommit.seconds();
+
+  struct PTLsimStats::simulator::host_profile& hp = stats.simulator.host_profile;
+  hp.interval = config.host_profile_interval;
+  hp.samples = host_profile_samples;
+  hp.host_cycles = ctsampled.cycles();
+  hp.host_cycles_per_sample = (host_profile_samples) ? ((double)hp.host_cycles / (double)host_profile_samples) : 0;
+  hp.stages.fetch = ctfetch.cycles();
+  hp.stages.decode = ctdecode.cycles();
+  hp.stages.rename = ctrename.cycles();
+  hp.stages.frontend = ctfrontend.cycles();
+  hp.stages.dispatch = ctdispatch.cycles();
+  // Load and store issue time is nested inside ctissue, but saturate in case a sample splits them:
+  W64 issueloadstore = ctissueload.cycles() + ctissuestore.cycles();
+  hp.stages.issue = (ctissue.cycles() > issueloadstore) ? (ctissue.cycles() - issueloadstore) : 0;
+  hp.stages.issueload = ctissueload.cycles();
+  hp.stages.issuestore = ctissuestore.cycles();
+  hp.stages.complete = ctcomplete.cycles();
+  hp.stages.transfer = cttransfer.cycles();
+  hp.stages.writeback = ctwriteback.cycles();
+  hp.stages.commit = ctcommit.cycles();
+
+#ifdef ENABLE_SIM_TIMING
+  // The stage timers run in every cycle
+  double scale = 1;
+#else
+  // The stage timers only run in sampled cycles, so scale them up to estimate the whole run:
+  double scale = max(config.host_profile_interval, W64(1));
+#endif
+  stats.ooocore.simulator.cputime.fetch = ctfetch.seconds() * scale;
+  stats.ooocore.simulator.cputime.decode = ctdecode.seconds() * scale;
+  stats.ooocore.simulator.cputime.rename = ctrename.seconds() * scale;
+  stats.ooocore.simulator.cputime.frontend = ctfrontend.seconds() * scale;
+  stats.ooocore.simulator.cputime.dispatch = ctdispatch.seconds() * scale;
+  stats.ooocore.simulator.cputime.issue = max(ctissue.seconds() - (ctissueload.seconds() + ctissuestore.seconds()), 0.0) * scale;
+  stats.ooocore.simulator.cputime.issueload = ctissueload.seconds() * scale;
+  stats.ooocore.simulator.cputime.issuestore = ctissuestore.seconds() * scale;
+  stats.ooocore.simulator.cputime.complete = ctcomplete.seconds() * scale;
+  stats.ooocore.simulator.cputime.transfer = cttransfer.seconds() * scale;
+  stats.ooocore.simulator.cputime.writeback = ctwriteback.seconds() * scale;
+  stats.ooocore.simulator.cputime.commit = ctcommit.seconds() * scale;
 }
 
 //
@@ -1934,7 +2402,6 @@ void OutOfOrderMachine::update_stats(PTLsimStats& stats) {
 //
 void OutOfOrderMachine::flush_all_pipelines() {
   assert(cores[0]);
-  OutOfOrderCore* core = cores[0];
 
   //
   // Make sure all pipelines are flushed BEFORE
@@ -1942,10 +2409,10 @@ void OutOfOrderMachine::flush_all_pipelines() {
   // Otherwise there will still be some remaining
   // references to to the basic block
   //
-  core->flush_pipeline_all();
+  foreach (i, corecount) cores[i]->flush_pipeline_all();
 
-  foreach (i, core->threadcount) {
-    ThreadContext* thread = core->threads[i];
+  foreach (i, contextcount) {
+    ThreadContext* thread = vcputhreads[i];
     thread->invalidate_smc();
   }  
 }
@@ -41,9 +41,10 @@ static const int MAX_THREADS_PER_CORE = 1;
 #define start_timer(ct) ct.start()
 #define stop_timer(ct) ct.stop()
 #else
-#define time_this_scope(ct) (0)
-#define start_timer(ct) (0)
-#define stop_timer(ct) (0)
+// Only the cycles sampled with -host-profile are timed:
+#define time_this_scope(ct) SampledCycleTimerScope ctscope(ct)
+#define start_timer(ct) ((host_profile_sampling) ? (ct.start(), 0) : 0)
+#define stop_timer(ct) ((host_profile_sampling) ? ct.stop() : 0)
 #endif
 
 #define per_context_ooocore_stats_ref(vcpuid) (*(((PerContextOutOfOrderCoreStats*)&stats.ooocore.vcpu0) + (vcpuid)))
@@ -568,6 +569,8 @@ namespace OutOfOrderModel {
     W64 dispatch_source_counter;
     W64 issue_source_counter;
     W32 flags;
+    // ROB slots currently on this list (only maintained for ROB state lists):
+    bitvec<ROB_SIZE> robmask;
 
     StateList() { count = 0; listid = 0; }
 
@@ -692,9 +695,12 @@ namespace OutOfOrderModel {
     void validate() { entry_valid = true; }
 
     void changestate(StateList& newqueue, bool place_at_head = false, ReorderBufferEntry* prevrob = null) {
-      if (current_state_list)
+      if (current_state_list) {
         current_state_list->remove(this);
+        current_state_list->robmask[idx] = 0;
+      }
       current_state_list = &newqueue;
+      newqueue.robmask[idx] = 1;
       if (place_at_head) newqueue.enqueue_after(this, prevrob); else newqueue.enqueue(this);
     }
 
@@ -749,6 +755,49 @@ namespace OutOfOrderModel {
     return rob.print(os);
   }
 
+  //
+  // Iterate over the ROBs in a given state. In list mode this walks
+  // the StateList links exactly like foreach_list_mutable(). In bitmap
+  // mode it scans a snapshot of the list's robmask oldest first
+  // (starting from the ROB head), without touching the other entries.
+  // Either way the current ROB may be moved to another list.
+  //
+  struct ROBStateScanner {
+    const StateList& list;
+    ReorderBufferEntry* robs;
+    selfqueuelink* nextentry;
+    bitvec<ROB_SIZE> pending;
+    int head;
+    bool bitmap;
+
+    ROBStateScanner(const StateList& list, ReorderBufferEntry* robs, int head, bool bitmap): list(list) {
+      this->robs = robs;
+      this->head = head;
+      this->bitmap = bitmap;
+      if likely (bitmap) pending = list.robmask.rotright(head); else nextentry = list.next;
+    }
+
+    ReorderBufferEntry* next() {
+      if likely (bitmap) {
+        if unlikely (!*pending) return null;
+        int i = pending.lsb();
+        pending[i] = 0;
+        i += head;
+        if (i >= ROB_SIZE) i -= ROB_SIZE;
+        return &robs[i];
+      }
+
+      selfqueuelink* entry = nextentry;
+      if unlikely (entry == &list) return null;
+      nextentry = entry->next;
+      prefetch(nextentry);
+      return (ReorderBufferEntry*)entry;
+    }
+  };
+
+#define foreach_rob_in_state(L, rob) \
+  for (ROBStateScanner __scanner(L, &ROB[0], ROB.head, config.rob_state_bitmaps); (rob = __scanner.next()) != null; )
+
   //
   // Load/Store Queue
   //
@@ -1096,6 +1145,27 @@ namespace OutOfOrderModel {
     EVENT_COMMIT_OK,
     EVENT_RECLAIM_PHYSREG,
     EVENT_RELEASE_MEM_LOCK,
+    EVENT_TYPE_COUNT
+  };
+
+  static const char* event_type_names[EVENT_TYPE_COUNT] = {
+    "invalid", "fetch_stalled", "fetch_icache_wait", "fetch_fetchq_full", "fetch_iq_quota_full",
+    "fetch_bogus_rip", "fetch_icache_miss", "fetch_split", "fetch_assist", "fetch_translate",
+    "fetch_ok", "rename_fetchq_empty", "rename_rob_full", "rename_physregs_full", "rename_ldq_full",
+    "rename_stq_full", "rename_memq_full", "rename_ok", "frontend", "cluster_no_cluster",
+    "cluster_ok", "dispatch_no_cluster", "dispatch_deadlock", "dispatch_ok", "issue_no_fu",
+    "issue_ok", "replay", "store_exception", "store_wait", "store_parallel_forwarding_match",
+    "store_aliased_load", "store_issued", "store_lock_released", "store_lock_annulled",
+    "store_lock_replay", "load_exception", "load_wait", "load_high_annulled", "load_hit",
+    "load_miss", "load_bank_conflict", "load_tlb_miss", "load_lock_replay", "load_lock_overflow",
+    "load_lock_acquired", "load_lfrq_full", "load_wakeup", "tlbwalk_hit", "tlbwalk_miss",
+    "tlbwalk_wakeup", "tlbwalk_no_lfrq_mb", "tlbwalk_complete", "fence_issued", "alignment_fixup",
+    "annul_no_future_uops", "annul_misspeculation", "annul_each_rob", "annul_pseudocommit",
+    "annul_fetchq_ras", "annul_fetchq", "annul_flush", "redispatch_dependents",
+    "redispatch_dependents_done", "redispatch_each_rob", "complete", "broadcast", "forward",
+    "writeback", "commit_fence_completed", "commit_exception_detected",
+    "commit_exception_acknowledged", "commit_skipblock", "commit_smc_detected", "commit_mem_locked",
+    "commit_assist", "commit_ok", "reclaim_physreg", "release_mem_lock"
   };
 
   //
@@ -1297,16 +1367,70 @@ namespace OutOfOrderModel {
     ostream& print(ostream& os) const;
   };
 
+  //
+  // Binary event trace (-event-trace): an EventTraceHeader followed by
+  // chunks, each holding a run of raw OutOfOrderCoreEvents from one
+  // core packed with delta_rle_compress(). Chunks can be decoded on
+  // their own, and the cycle range in each header lets readers skip
+  // chunks without decompressing them. See ptlevents.cpp.
+  //
+#define EVENT_TRACE_MAGIC 0x746e6576654c5450ULL // "PTLevent"
+#define EVENT_TRACE_CHUNK_MAGIC 0x48435645 // "EVCH"
+#define EVENT_TRACE_VERSION 1
+
+  struct EventTraceHeader {
+    W64 magic;
+    W32 version;
+    W32 eventsize;
+  };
+
+  struct EventTraceChunk {
+    W32 magic;
+    W16 coreid;
+    W16 reserved;
+    W32 count;
+    W32 bytes;
+    W32 firstcycle;
+    W32 lastcycle;
+  };
+
   struct EventLog {
     OutOfOrderCoreEvent* start;
     OutOfOrderCoreEvent* end;
     OutOfOrderCoreEvent* tail;
     ostream* logfile;
+    odstream* tracefile;
+    int coreid;
 
-    EventLog() { start = null; end = null; tail = null; logfile = null; }
+    //
+    // Filters (-ringbuf-types, -ringbuf-rip-*, -ringbuf-thread and -ringbuf-uuid-*):
+    // rejected events are filled into the discard slot, so callers
+    // can still write their event specific fields into whatever
+    // add() returns. Each test only applies to events that carry
+    // the field being checked.
+    //
+    bool filtered;
+    bitvec<EVENT_TYPE_COUNT> typemask;
+    W64 riplo;
+    W64 riphi;
+    W64 uuidlo;
+    W64 uuidhi;
+    W64 threadid;
+    OutOfOrderCoreEvent discard;
+
+    EventLog() { start = null; end = null; tail = null; logfile = null; tracefile = null; coreid = 0; filtered = 0; }
 
     bool init(size_t bufsize);
     void reset();
+    void setup_filters();
+
+    bool accept(int type, W64 rip) const {
+      return typemask[type] & inrange(rip, riplo, riphi);
+    }
+
+    bool accept(int type, const FetchBufferEntry& uop) const {
+      return accept(type, uop.rip.rip) & inrange(uop.uuid, uuidlo, uuidhi) & ((threadid == infinity) | (uop.threadid == threadid));
+    }
 
     OutOfOrderCoreEvent* add() {
       if unlikely (tail >= end) {
@@ -1319,28 +1443,35 @@ namespace OutOfOrderModel {
     }
 
     void flush(bool only_to_tail = false);
+    bool write_trace(const OutOfOrderCoreEvent* first, int count);
 
     OutOfOrderCoreEvent* add(int type) {
+      if unlikely (filtered && (!typemask[type])) return &discard;
       return add()->fill(type);
     }
 
     OutOfOrderCoreEvent* add(int type, const RIPVirtPhys& rvp) {
+      if unlikely (filtered && (!accept(type, rvp.rip))) return &discard;
       return add()->fill(type, rvp);
     }
 
     OutOfOrderCoreEvent* add(int type, const FetchBufferEntry& uop) {
+      if unlikely (filtered && (!accept(type, uop))) return &discard;
       return add()->fill(type, uop);
     }
 
     OutOfOrderCoreEvent* add(int type, const ReorderBufferEntry* rob) {
+      if unlikely (filtered && (!accept(type, rob->uop))) return &discard;
       return add()->fill(type, rob);
     }
 
     OutOfOrderCoreEvent* add_commit(int type, const ReorderBufferEntry* rob) {
+      if unlikely (filtered && (!accept(type, rob->uop))) return &discard;
       return add()->fill_commit(type, rob);
     }
 
     OutOfOrderCoreEvent* add_load_store(int type, const ReorderBufferEntry* rob, LoadStoreQueueEntry* inherit_sfr = null, Waddr addr = 0) {
+      if unlikely (filtered && (!accept(type, rob->uop))) return &discard;
       return add()->fill_load_store(type, rob, inherit_sfr, addr);
     }
 
@@ -1416,6 +1547,7 @@ namespace OutOfOrderModel {
     // Fetch-related structures
     RIPVirtPhys fetchrip;
     BasicBlock* current_basic_block;
+    BasicBlockLookaside bblookaside;
     int current_basic_block_transop_index;
     bool stall_frontend;
     bool waiting_for_icache_fill;
@@ -1485,6 +1617,8 @@ namespace OutOfOrderModel {
     void redispatch_deadlock_recovery();
     void flush_mem_lock_release_list(int start = 0);
     int get_priority() const;
+    bool quiescent();
+    void skip_idle_cycles(W64 delta);
 
     void dump_smt_state(ostream& os);
     void print_smt_state(ostream& os);
@@ -1516,6 +1650,7 @@ namespace OutOfOrderModel {
     int commitcount;
     int writecount;
     int dispatchcount;
+    int issuecount;
 
     byte round_robin_tid;
 
@@ -1638,6 +1773,8 @@ namespace OutOfOrderModel {
 
     // Pipeline Stages
     bool runcycle();
+    W64 idle_cycles_to_skip();
+    void skip_idle_cycles(W64 delta);
     void flush_pipeline_all();
     bool fetch();
     void rename();
@@ -1659,10 +1796,21 @@ namespace OutOfOrderModel {
     void check_rob();
   };
 
-#define MAX_SMT_CORES 1
+#define MAX_SMT_CORES MAX_CONTEXTS
 
+  //
+  // VCPUs are spread round robin over <ooo-cores> cores, with up to
+  // MAX_THREADS_PER_CORE threads on each core. The cores advance
+  // <ooo-quantum> cycles at a time: each core runs the whole quantum
+  // from the same starting cycle before the next core takes its turn,
+  // so cross-core effects (interlocks, stopping, idle skips) are
+  // only seen at quantum boundaries. All cores run on the simulator's
+  // own host thread.
+  //
   struct OutOfOrderMachine: public PTLsimMachine {
     OutOfOrderCore* cores[MAX_SMT_CORES];
+    int corecount;
+    ThreadContext* vcputhreads[MAX_CONTEXTS];
     bitvec<MAX_CONTEXTS> stopped;
     OutOfOrderMachine(const char* name);
     virtual bool init(PTLsimConfig& config);
@@ -1671,7 +1819,15 @@ namespace OutOfOrderModel {
     virtual void update_stats(PTLsimStats& stats);
     virtual void flush_tlb(Context& ctx);
     virtual void flush_tlb_virt(Context& ctx, Waddr virtaddr);
+    virtual void warm_data_access(Context& ctx, Waddr virtaddr, W64 physaddr, bool store);
+    virtual void warm_insn_fetch(Context& ctx, Waddr virtaddr, W64 physaddr);
+    virtual void warm_branch(Context& ctx, const TransOp& uop, W64 ripafter, W64 target);
+    virtual bool save_checkpoint(odstream& os);
+    virtual bool load_checkpoint(idstream& is, W64 size);
     void flush_all_pipelines();
+    ThreadContext* threadof(const Context& ctx) const { return vcputhreads[ctx.vcpuid]; }
+    bool runquantum(W64 cycles);
+    void invalidate_other_cores(int coreid, W64 physaddr);
   };
 
   extern CycleTimer cttotal;
@@ -1687,6 +1843,18 @@ namespace OutOfOrderModel {
   extern CycleTimer cttransfer;
   extern CycleTimer ctwriteback;
   extern CycleTimer ctcommit;
+  extern CycleTimer ctsampled;
+
+  // Set while the current cycle is being timed for -host-profile:
+  extern bool host_profile_sampling;
+  extern W64 host_profile_samples;
+
+  struct SampledCycleTimerScope {
+    CycleTimer& ct;
+    bool active;
+    SampledCycleTimerScope(CycleTimer& ct_): ct(ct_) { active = host_profile_sampling; if unlikely (active) ct.start(); }
+    ~SampledCycleTimerScope() { if unlikely (active) ct.stop(); }
+  };
 
 #ifdef DECLARE_STRUCTURES
   //
@@ -2035,6 +2203,11 @@ struct OutOfOrderCoreStats { // rootnode:
 
   struct simulator {
     double total_time;
+    struct idle_skip {
+      W64 skips;
+      W64 cycles;
+    } idle_skip;
+    // Seconds per stage, estimated from the -host-profile samples times their interval
     struct cputime { // node: summable
       double fetch;
       double decode;
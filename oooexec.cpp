@@ -16,6 +16,7 @@
 #include <dcache.h>
 
 #define INSIDE_OOOCORE
+#include <decode.h>
 #include <ooocore.h>
 #include <stats.h>
 
@@ -287,7 +288,7 @@ int ReorderBufferEntry::issue() {
       event->issue.fu_avail = core.fu_avail;
     }
 
-    per_context_ooocore_stats_update(threadid, issue.result.no_fu++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.result.no_fu++);
     //
     // When this (very rarely) happens, stop issuing uops to this cluster
     // and try again with the problem uop on the next cycle. In practice
@@ -308,7 +309,7 @@ int ReorderBufferEntry::issue() {
   //
 
   stats.summary.uops++;
-  per_context_ooocore_stats_update(threadid, issue.uops++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.uops++);
 
   fu = lsbindex(executable_on_fu);
   clearbit(core.fu_avail, fu);
@@ -361,7 +362,7 @@ int ReorderBufferEntry::issue() {
     state.reg.rddata = EXCEPTION_Propagate;
     propagated_exception = 1;
   } else {
-    per_context_ooocore_stats_update(threadid, issue.opclass[opclassof(uop.opcode)]++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.opclass[opclassof(uop.opcode)]++);
 
     if unlikely (ld|st) {
       int completed = 0;
@@ -374,17 +375,17 @@ int ReorderBufferEntry::issue() {
       }
 
       if unlikely (completed == ISSUE_MISSPECULATED) {
-        per_context_ooocore_stats_update(threadid, issue.result.misspeculated++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.result.misspeculated++);
         return ISSUE_MISSPECULATED;
       } else if unlikely (completed == ISSUE_NEEDS_REFETCH) {
-        per_context_ooocore_stats_update(threadid, issue.result.refetch++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.result.refetch++);
         return ISSUE_NEEDS_REFETCH;
       }
 
       state.reg.rddata = lsq->data;
       state.reg.rdflags = (lsq->invalid << log2(FLAG_INV)) | ((!lsq->datavalid) << log2(FLAG_WAIT));
       if unlikely (completed == ISSUE_NEEDS_REPLAY) {
-        per_context_ooocore_stats_update(threadid, issue.result.replay++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.result.replay++);
         return ISSUE_NEEDS_REPLAY;
       }
     } else if unlikely (uop.opcode == OP_ld_pre) {
@@ -466,10 +467,10 @@ int ReorderBufferEntry::issue() {
       bool ret = bit(bptype, log2(BRANCH_HINT_RET));
         
       if unlikely (mispredicted) {
-        per_context_ooocore_stats_update(threadid, branchpred.cond[MISPRED] += cond);
-        per_context_ooocore_stats_update(threadid, branchpred.indir[MISPRED] += (indir & !ret));
-        per_context_ooocore_stats_update(threadid, branchpred.ret[MISPRED] += ret);
-        per_context_ooocore_stats_update(threadid, branchpred.summary[MISPRED]++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.cond[MISPRED] += cond);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.indir[MISPRED] += (indir & !ret));
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.ret[MISPRED] += ret);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.summary[MISPRED]++);
 
         W64 realrip = physreg->data;
 
@@ -518,21 +519,21 @@ int ReorderBufferEntry::issue() {
         // commit like it was predicted perfectly in the first place.
         //
         thread.reset_fetch_unit(realrip);
-        per_context_ooocore_stats_update(threadid, issue.result.branch_mispredict++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.result.branch_mispredict++);
 
         return -1;
       } else {
-        per_context_ooocore_stats_update(threadid, branchpred.cond[CORRECT] += cond);
-        per_context_ooocore_stats_update(threadid, branchpred.indir[CORRECT] += (indir & !ret));
-        per_context_ooocore_stats_update(threadid, branchpred.ret[CORRECT] += ret);
-        per_context_ooocore_stats_update(threadid, branchpred.summary[CORRECT]++);
-        per_context_ooocore_stats_update(threadid, issue.result.complete++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.cond[CORRECT] += cond);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.indir[CORRECT] += (indir & !ret));
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.ret[CORRECT] += ret);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.summary[CORRECT]++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.result.complete++);
       }
     } else {
-      per_context_ooocore_stats_update(threadid, issue.result.complete++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.result.complete++);
     }
   } else {
-    per_context_ooocore_stats_update(threadid, issue.result.exception++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, issue.result.exception++);
   }
 
   return ISSUE_COMPLETED;
@@ -645,9 +646,9 @@ bool ReorderBufferEntry::handle_common_load_store_exceptions(LoadStoreQueueEntry
     thread.reset_fetch_unit(recoveryrip);
 
     if unlikely (st) {
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.unaligned++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.unaligned++);
     } else {
-      per_context_ooocore_stats_update(threadid, dcache.load.issue.unaligned++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.unaligned++);
     }
 
     return false;
@@ -665,9 +666,9 @@ bool ReorderBufferEntry::handle_common_load_store_exceptions(LoadStoreQueueEntry
   }
 
   if unlikely (st) {
-    per_context_ooocore_stats_update(threadid, dcache.store.issue.exception++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.exception++);
   } else {
-    per_context_ooocore_stats_update(threadid, dcache.load.issue.exception++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.exception++);
   }
 
   return true;
@@ -757,10 +758,10 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
     return (handle_common_load_store_exceptions(state, origaddr, addr, exception, pfec)) ? ISSUE_COMPLETED : ISSUE_MISSPECULATED;
   }
 
-  per_context_ooocore_stats_update(threadid, dcache.store.type.aligned += ((!uop.internal) & (aligntype == LDST_ALIGN_NORMAL)));
-  per_context_ooocore_stats_update(threadid, dcache.store.type.unaligned += ((!uop.internal) & (aligntype != LDST_ALIGN_NORMAL)));
-  per_context_ooocore_stats_update(threadid, dcache.store.type.internal += uop.internal);
-  per_context_ooocore_stats_update(threadid, dcache.store.size[sizeshift]++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.type.aligned += ((!uop.internal) & (aligntype == LDST_ALIGN_NORMAL)));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.type.unaligned += ((!uop.internal) & (aligntype != LDST_ALIGN_NORMAL)));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.type.internal += uop.internal);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.size[sizeshift]++);
 
   state.physaddr = (annul) ? INVALID_PHYSADDR : (physaddr >> 3);
 
@@ -795,7 +796,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
       if unlikely (stbuf.lfence | stbuf.sfence) continue;
 
       if (stbuf.physaddr == state.physaddr) {
-        per_context_ooocore_stats_update(threadid, dcache.load.dependency.stq_address_match++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.dependency.stq_address_match++);
         sfra = &stbuf;
         break;
       }
@@ -861,15 +862,15 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
     load_store_second_phase = 1;
 
     if unlikely (sfra && sfra->sfence) {
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.fence++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.fence++);
     } else {
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.sfr_addr_and_data_and_data_to_store_not_ready += ((!rcready) & (sfra && (!sfra->addrvalid) & (!sfra->datavalid))));
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.sfr_addr_and_data_to_store_not_ready += ((!rcready) & (sfra && (!sfra->addrvalid))));
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.sfr_data_and_data_to_store_not_ready += ((!rcready) & (sfra && sfra->addrvalid && (!sfra->datavalid))));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.sfr_addr_and_data_and_data_to_store_not_ready += ((!rcready) & (sfra && (!sfra->addrvalid) & (!sfra->datavalid))));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.sfr_addr_and_data_to_store_not_ready += ((!rcready) & (sfra && (!sfra->addrvalid))));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.sfr_data_and_data_to_store_not_ready += ((!rcready) & (sfra && sfra->addrvalid && (!sfra->datavalid))));
       
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.sfr_addr_and_data_not_ready += (rcready & (sfra && (!sfra->addrvalid) & (!sfra->datavalid))));
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.sfr_addr_not_ready += (rcready & (sfra && ((!sfra->addrvalid) & (sfra->datavalid)))));
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.sfr_data_not_ready += (rcready & (sfra && (sfra->addrvalid & (!sfra->datavalid)))));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.sfr_addr_and_data_not_ready += (rcready & (sfra && (!sfra->addrvalid) & (!sfra->datavalid))));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.sfr_addr_not_ready += (rcready & (sfra && ((!sfra->addrvalid) & (sfra->datavalid)))));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.sfr_data_not_ready += (rcready & (sfra && (sfra->addrvalid & (!sfra->datavalid)))));
     }
 
     return ISSUE_NEEDS_REPLAY;
@@ -930,7 +931,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
 
       if unlikely (parallel_forwarding_match) {
         if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_STORE_PARALLEL_FORWARDING_MATCH, this, &ldbuf, addr);
-        per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.parallel_aliasing++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.parallel_aliasing++);
 
         replay();
         return ISSUE_NEEDS_REPLAY;
@@ -955,7 +956,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
 
       redispatch_dependents();
 
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.ordering++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.ordering++);
 
       return ISSUE_MISSPECULATED;
     }
@@ -992,7 +993,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
         event->loadstore.threadid = lock->threadid;   
       }
 
-      per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.interlocked++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.replay.interlocked++);
       replay_locked();
       return ISSUE_NEEDS_REPLAY;
     }
@@ -1027,9 +1028,9 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
   state.bytemask = (sfra) ? (sfra->bytemask | bytemask) : bytemask;
   state.datavalid = 1;
 
-  per_context_ooocore_stats_update(threadid, dcache.store.forward.zero += (sfra == null));
-  per_context_ooocore_stats_update(threadid, dcache.store.forward.sfr += (sfra != null));
-  per_context_ooocore_stats_update(threadid, dcache.store.datatype[uop.datatype]++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.forward.zero += (sfra == null));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.forward.sfr += (sfra != null));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.datatype[uop.datatype]++);
 
   if unlikely (config.event_log_enabled) {
     event = core.eventlog.add_load_store(EVENT_STORE_ISSUED, this, sfra, addr);
@@ -1038,7 +1039,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
 
   load_store_second_phase = 1;
 
-  per_context_ooocore_stats_update(threadid, dcache.store.issue.complete++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.store.issue.complete++);
 
   return ISSUE_COMPLETED;
 }
@@ -1083,10 +1084,10 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
     return (handle_common_load_store_exceptions(state, origaddr, addr, exception, pfec)) ? ISSUE_COMPLETED : ISSUE_MISSPECULATED;
   }
 
-  per_context_ooocore_stats_update(threadid, dcache.load.type.aligned += ((!uop.internal) & (aligntype == LDST_ALIGN_NORMAL)));
-  per_context_ooocore_stats_update(threadid, dcache.load.type.unaligned += ((!uop.internal) & (aligntype != LDST_ALIGN_NORMAL)));
-  per_context_ooocore_stats_update(threadid, dcache.load.type.internal += uop.internal);
-  per_context_ooocore_stats_update(threadid, dcache.load.size[sizeshift]++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.type.aligned += ((!uop.internal) & (aligntype == LDST_ALIGN_NORMAL)));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.type.unaligned += ((!uop.internal) & (aligntype != LDST_ALIGN_NORMAL)));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.type.internal += uop.internal);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.size[sizeshift]++);
 
   state.physaddr = (annul) ? INVALID_PHYSADDR : (physaddr >> 3);
 
@@ -1129,14 +1130,14 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
       if unlikely (stbuf.lfence | stbuf.sfence) continue;
 
       if (stbuf.physaddr == state.physaddr) {
-        per_context_ooocore_stats_update(threadid, dcache.load.dependency.stq_address_match++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.dependency.stq_address_match++);
         sfra = &stbuf;
         break;
       }
     } else {
       // Address is unknown: is it a memory fence that hasn't committed?
       if unlikely (stbuf.lfence) {
-        per_context_ooocore_stats_update(threadid, dcache.load.dependency.fence++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.dependency.fence++);
         sfra = &stbuf;
         break;
       }
@@ -1148,14 +1149,14 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
 
       // Is this load known to alias with prior stores, and therefore cannot be hoisted?
       if unlikely (load_is_known_to_alias_with_store) {
-        per_context_ooocore_stats_update(threadid, dcache.load.dependency.predicted_alias_unresolved++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.dependency.predicted_alias_unresolved++);
         sfra = &stbuf;
         break;
       }
     }
   }
 
-  per_context_ooocore_stats_update(threadid, dcache.load.dependency.independent += (sfra == null));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.dependency.independent += (sfra == null));
 
   bool ready = (!sfra || (sfra && sfra->addrvalid && sfra->datavalid));
 
@@ -1198,11 +1199,11 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
     }
 
     if unlikely (sfra->lfence | sfra->sfence) {
-      per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.fence++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.replay.fence++);
     } else {
-      per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.sfr_addr_and_data_not_ready += ((!sfra->addrvalid) & (!sfra->datavalid)));
-      per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.sfr_addr_not_ready += ((!sfra->addrvalid) & (sfra->datavalid)));
-      per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.sfr_data_not_ready += ((sfra->addrvalid) & (!sfra->datavalid)));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.replay.sfr_addr_and_data_not_ready += ((!sfra->addrvalid) & (!sfra->datavalid)));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.replay.sfr_addr_not_ready += ((!sfra->addrvalid) & (sfra->datavalid)));
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.replay.sfr_data_not_ready += ((sfra->addrvalid) & (!sfra->datavalid)));
     }
 
     replay();
@@ -1222,7 +1223,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
     //
     if unlikely ((prevaddr != state.physaddr) && (lowbits(prevaddr, log2(CacheSubsystem::L1_DCACHE_BANKS)) == lowbits(state.physaddr, log2(CacheSubsystem::L1_DCACHE_BANKS)))) {
       if unlikely (config.event_log_enabled) core.eventlog.add_load_store(EVENT_LOAD_BANK_CONFLICT, this, null, addr);
-      per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.bank_conflict++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.replay.bank_conflict++);
 
       replay();
       load_store_second_phase = 1;
@@ -1237,7 +1238,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
   //
   if unlikely (core.caches.lfrq_or_missbuf_full()) {
     if unlikely (config.event_log_enabled) core.eventlog.add_load_store(EVENT_LOAD_LFRQ_FULL, this, null, addr);
-    per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.missbuf_full++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.replay.missbuf_full++);
 
     replay();
     load_store_second_phase = 1;
@@ -1282,7 +1283,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
       assert(lock->vcpuid != thread.ctx.vcpuid);
       assert(lock->threadid != threadid);
 
-      per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.interlocked++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.replay.interlocked++);
       replay_locked();
       return ISSUE_NEEDS_REPLAY;
     }
@@ -1323,7 +1324,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
           core.eventlog.add_load_store(EVENT_LOAD_LOCK_OVERFLOW, this, null, addr);
         }
 
-        per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.interlock_overflow++);
+        per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.replay.interlock_overflow++);
         replay();
         return ISSUE_NEEDS_REPLAY;
       }
@@ -1392,10 +1393,10 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
 
   // shift is how many bits to shift the 8-bit bytemask left by within the cache line;
   bool covered = core.caches.covered_by_sfr(addr, sfra, sizeshift);
-  per_context_ooocore_stats_update(threadid, dcache.load.forward.cache += (sfra == null));
-  per_context_ooocore_stats_update(threadid, dcache.load.forward.sfr += ((sfra != null) & covered));
-  per_context_ooocore_stats_update(threadid, dcache.load.forward.sfr_and_cache += ((sfra != null) & (!covered)));
-  per_context_ooocore_stats_update(threadid, dcache.load.datatype[uop.datatype]++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.forward.cache += (sfra == null));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.forward.sfr += ((sfra != null) & covered));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.forward.sfr_and_cache += ((sfra != null) & (!covered)));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.datatype[uop.datatype]++);
 
   //
   // NOTE: Technically the data is valid right now for simulation purposes
@@ -1434,12 +1435,12 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
     cycles_left = 0;
     tlb_walk_level = thread.ctx.page_table_level_count();
     changestate(thread.rob_tlb_miss_list);
-    per_context_dcache_stats_update(threadid, load.dtlb.misses++);
+    per_context_dcache_stats_update(thread.ctx.vcpuid, load.dtlb.misses++);
     
     return ISSUE_COMPLETED;
   }
 
-  per_context_dcache_stats_update(threadid, load.dtlb.hits++);
+  per_context_dcache_stats_update(thread.ctx.vcpuid, load.dtlb.hits++);
 #endif
 
   return probecache(physaddr, sfra);
@@ -1474,12 +1475,12 @@ int ReorderBufferEntry::probecache(Waddr addr, LoadStoreQueueEntry* sfra) {
     lfrqslot = -1;
     forward_cycle = 0;
 
-    per_context_ooocore_stats_update(threadid, dcache.load.issue.complete++);
-    per_context_dcache_stats_update(threadid, load.hit.L1++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.complete++);
+    per_context_dcache_stats_update(thread.ctx.vcpuid, load.hit.L1++);
     return ISSUE_COMPLETED;
   }
 
-  per_context_ooocore_stats_update(threadid, dcache.load.issue.miss++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.load.issue.miss++);
 
   cycles_left = 0;
   changestate(thread.rob_cache_miss_list);
@@ -1523,7 +1524,7 @@ void ReorderBufferEntry::tlbwalk() {
       // entries are free (since the uop already left the scheduler).
       //
       if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_NO_LFRQ_MB, this, null, 0);
-      per_context_dcache_stats_update(threadid, load.tlbwalk.no_lfrq_mb++);
+      per_context_dcache_stats_update(thread.ctx.vcpuid, load.tlbwalk.no_lfrq_mb++);
       return;
     }
 
@@ -1556,7 +1557,7 @@ void ReorderBufferEntry::tlbwalk() {
     // The PTE was in the cache: directly proceed to the next level
     //
     if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_HIT, this, null, pteaddr);
-    per_context_dcache_stats_update(threadid, load.tlbwalk.L1_dcache_hit++);
+    per_context_dcache_stats_update(thread.ctx.vcpuid, load.tlbwalk.L1_dcache_hit++);
 
     tlb_walk_level--;
     return;
@@ -1576,7 +1577,7 @@ void ReorderBufferEntry::tlbwalk() {
   //
   if (lfrqslot < 0) {
     if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_NO_LFRQ_MB, this, null, pteaddr);
-    per_context_dcache_stats_update(threadid, load.tlbwalk.no_lfrq_mb++);
+    per_context_dcache_stats_update(thread.ctx.vcpuid, load.tlbwalk.no_lfrq_mb++);
     return;
   }
 
@@ -1584,7 +1585,7 @@ void ReorderBufferEntry::tlbwalk() {
   changestate(thread.rob_cache_miss_list);
 
   if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_MISS, this, null, pteaddr);
-  per_context_dcache_stats_update(threadid, load.tlbwalk.L1_dcache_miss++);
+  per_context_dcache_stats_update(thread.ctx.vcpuid, load.tlbwalk.L1_dcache_miss++);
 }
 
 void ThreadContext::tlbwalk() {
@@ -1649,9 +1650,9 @@ int ReorderBufferEntry::issuefence(LoadStoreQueueEntry& state) {
 
   assert(uop.opcode == OP_mf);
 
-  per_context_ooocore_stats_update(threadid, dcache.fence.lfence += (uop.extshift == MF_TYPE_LFENCE));
-  per_context_ooocore_stats_update(threadid, dcache.fence.sfence += (uop.extshift == MF_TYPE_SFENCE));
-  per_context_ooocore_stats_update(threadid, dcache.fence.mfence += (uop.extshift == (MF_TYPE_LFENCE|MF_TYPE_SFENCE)));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.fence.lfence += (uop.extshift == MF_TYPE_LFENCE));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.fence.sfence += (uop.extshift == MF_TYPE_SFENCE));
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dcache.fence.mfence += (uop.extshift == (MF_TYPE_LFENCE|MF_TYPE_SFENCE)));
 
   //
   // The mf uop is issued but its "data" (for dependency purposes only)
@@ -1715,12 +1716,12 @@ void ReorderBufferEntry::issueprefetch(IssueState& state, W64 ra, W64 rb, W64 rc
     cycles_left = 0;
     tlb_walk_level = thread.ctx.page_table_level_count();
     changestate(thread.rob_tlb_miss_list);
-    per_context_dcache_stats_update(thread.threadid, load.dtlb.misses++);
+    per_context_dcache_stats_update(thread.ctx.vcpuid, load.dtlb.misses++);
 #endif
     return;
   }
 
-  per_context_dcache_stats_update(threadid, load.dtlb.hits++);
+  per_context_dcache_stats_update(thread.ctx.vcpuid, load.dtlb.hits++);
 #endif
 
   core.caches.initiate_prefetch(physaddr, cachelevel);
@@ -2246,7 +2247,7 @@ void ReorderBufferEntry::redispatch(const bitvec<MAX_OPERANDS>& dependent_operan
     foreach (i, MAX_OPERANDS) operands[i]->fill_operand_info(event->redispatch.opinfo[i]);
   }
 
-  per_context_ooocore_stats_update(threadid, dispatch.redispatch.trigger_uops++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dispatch.redispatch.trigger_uops++);
 
   // Remove from issue queue, if it was already in some issue queue
   if unlikely (cluster >= 0) {
@@ -2362,7 +2363,7 @@ void ReorderBufferEntry::redispatch_dependents(bool inclusive) {
   }
 
   assert(inrange(count, 1, ROB_SIZE));
-  per_context_ooocore_stats_update(threadid, dispatch.redispatch.dependent_uops[count-1]++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, dispatch.redispatch.dependent_uops[count-1]++);
 
   if unlikely (config.event_log_enabled) {
     event = core.eventlog.add(EVENT_REDISPATCH_DEPENDENTS_DONE, this);
@@ -16,6 +16,7 @@
 #include <dcache.h>
 
 #define INSIDE_OOOCORE
+#include <decode.h>
 #include <ooocore.h>
 #include <stats.h>
 
@@ -294,7 +295,7 @@ void ThreadContext::external_to_core_state() {
 void ThreadContext::redispatch_deadlock_recovery() {
   if (logable(6)) core.dump_smt_state(logfile);
 
-  per_context_ooocore_stats_update(threadid, dispatch.redispatch.deadlock_flushes++);
+  per_context_ooocore_stats_update(ctx.vcpuid, dispatch.redispatch.deadlock_flushes++);
   // don't want to reset the counter for no commit in this case
   W64 previous_last_commit_at_cycle = last_commit_at_cycle;
   flush_pipeline();
@@ -325,7 +326,7 @@ void ThreadContext::redispatch_deadlock_recovery() {
   if (recovery_required) {
   rob.redispatch(noops, prevrob);
   prevrob = &rob;
-  per_context_ooocore_stats_update(threadid, dispatch.redispatch.deadlock_uops_flushed++);
+  per_context_ooocore_stats_update(ctx.vcpuid, dispatch.redispatch.deadlock_uops_flushed++);
   }
   }
 
@@ -393,7 +394,7 @@ bool ThreadContext::fetch() {
       event = eventlog.add(EVENT_FETCH_STALLED);
       event->threadid = threadid;
     }
-    per_context_ooocore_stats_update(threadid, fetch.stop.stalled++);
+    per_context_ooocore_stats_update(ctx.vcpuid, fetch.stop.stalled++);
     return true;
   }
 
@@ -404,7 +405,7 @@ bool ThreadContext::fetch() {
       event->rip = fetchrip;
       event->uuid = fetch_uuid;
     }
-    per_context_ooocore_stats_update(threadid, fetch.stop.icache_miss++);
+    per_context_ooocore_stats_update(ctx.vcpuid, fetch.stop.icache_miss++);
     return true;
   }
 
@@ -417,7 +418,7 @@ bool ThreadContext::fetch() {
           event->uuid = fetch_uuid;
         }
       }
-      per_context_ooocore_stats_update(threadid, fetch.stop.fetchq_full++);
+      per_context_ooocore_stats_update(ctx.vcpuid, fetch.stop.fetchq_full++);
       break;
     }
 
@@ -459,7 +460,7 @@ bool ThreadContext::fetch() {
         event = eventlog.add(EVENT_FETCH_BOGUS_RIP, fetchrip);
         event->threadid = threadid;
       }
-      per_context_ooocore_stats_update(threadid, fetch.stop.bogus_rip++);
+      per_context_ooocore_stats_update(ctx.vcpuid, fetch.stop.bogus_rip++);
       //
       // Keep fetching - the decoder has injected assist microcode that
       // branches to the invalid opcode or exec page fault handler.
@@ -491,13 +492,13 @@ bool ThreadContext::fetch() {
         }
         waiting_for_icache_fill = 1;
         waiting_for_icache_fill_physaddr = req_icache_block;
-        per_context_ooocore_stats_update(threadid, fetch.stop.icache_miss++);
+        per_context_ooocore_stats_update(ctx.vcpuid, fetch.stop.icache_miss++);
         break;
       }
 
-      per_context_ooocore_stats_update(threadid, fetch.blocks++);
+      per_context_ooocore_stats_update(ctx.vcpuid, fetch.blocks++);
       current_icache_block = req_icache_block;
-      per_context_dcache_stats_update(threadid, fetch.hit.L1++);
+      per_context_dcache_stats_update(ctx.vcpuid, fetch.hit.L1++);
     }
 
     FetchBufferEntry& transop = *fetchq.alloc();
@@ -537,16 +538,16 @@ bool ThreadContext::fetch() {
 
     current_basic_block_transop_index += (unaligned_ldst_buf.empty());
 
-    per_context_ooocore_stats_update(threadid, fetch.user_insns += transop.som);
+    per_context_ooocore_stats_update(ctx.vcpuid, fetch.user_insns += transop.som);
 
     if unlikely (isclass(transop.opcode, OPCLASS_BARRIER)) {
       // We've hit an assist: stall the frontend until we resume or redirect
       if unlikely (config.event_log_enabled) eventlog.add(EVENT_FETCH_ASSIST, transop);
-      per_context_ooocore_stats_update(threadid, fetch.stop.microcode_assist++);
+      per_context_ooocore_stats_update(ctx.vcpuid, fetch.stop.microcode_assist++);
       stall_frontend = 1;
     }
 
-    per_context_ooocore_stats_update(threadid, fetch.uops++);
+    per_context_ooocore_stats_update(ctx.vcpuid, fetch.uops++);
 
     Waddr predrip = 0;
     bool redirectrip = false;
@@ -567,7 +568,7 @@ bool ThreadContext::fetch() {
       transop.predinfo.ripafter = fetchrip + transop.bytes;
       predrip = branchpred.predict(transop.predinfo, transop.predinfo.bptype, transop.predinfo.ripafter, transop.riptaken);
       redirectrip = 1;
-      per_context_ooocore_stats_update(threadid, branchpred.predictions++);
+      per_context_ooocore_stats_update(ctx.vcpuid, branchpred.predictions++);
     }
 
     // Set up branches so mispredicts can be calculated correctly:
@@ -588,7 +589,7 @@ bool ThreadContext::fetch() {
       transop.ripseq = predrip;
     }
 
-    per_context_ooocore_stats_update(threadid, fetch.opclass[opclassof(transop.opcode)]++);
+    per_context_ooocore_stats_update(ctx.vcpuid, fetch.opclass[opclassof(transop.opcode)]++);
 
     if unlikely (config.event_log_enabled) {
       event = eventlog.add(EVENT_FETCH_OK, transop);
@@ -610,7 +611,7 @@ bool ThreadContext::fetch() {
         fetchrip.update(ctx);
         if (taken) {
           fetchcount++;
-          per_context_ooocore_stats_update(threadid, fetch.stop.branch_taken++);
+          per_context_ooocore_stats_update(ctx.vcpuid, fetch.stop.branch_taken++);
           break;
         }
       }
@@ -619,8 +620,8 @@ bool ThreadContext::fetch() {
     fetchcount++;
   }
 
-  per_context_ooocore_stats_update(threadid, fetch.stop.full_width += (fetchcount == FETCH_WIDTH));
-  per_context_ooocore_stats_update(threadid, fetch.width[fetchcount]++);
+  per_context_ooocore_stats_update(ctx.vcpuid, fetch.stop.full_width += (fetchcount == FETCH_WIDTH));
+  per_context_ooocore_stats_update(ctx.vcpuid, fetch.width[fetchcount]++);
 
   return true;
 }
@@ -634,7 +635,7 @@ BasicBlock* ThreadContext::fetch_or_translate_basic_block(const RIPVirtPhys& rvp
     current_basic_block = null;
   }
 
-  BasicBlock* bb = bbcache(rvp);
+  BasicBlock* bb = bbcache.lookup(rvp, bblookaside);
 
   if likely (bb) {
     current_basic_block = bb;
@@ -684,7 +685,7 @@ void ThreadContext::rename() {
           event->threadid = threadid;
         }
       }
-      per_context_ooocore_stats_update(threadid, frontend.status.fetchq_empty++);
+      per_context_ooocore_stats_update(ctx.vcpuid, frontend.status.fetchq_empty++);
       break;
     }
 
@@ -695,7 +696,7 @@ void ThreadContext::rename() {
           event->threadid = threadid;
         }
       }
-      per_context_ooocore_stats_update(threadid, frontend.status.rob_full++);
+      per_context_ooocore_stats_update(ctx.vcpuid, frontend.status.rob_full++);
       break;
     }
 
@@ -719,7 +720,7 @@ void ThreadContext::rename() {
           event->threadid = threadid;
         }
       }
-      per_context_ooocore_stats_update(threadid, frontend.status.physregs_full++);
+      per_context_ooocore_stats_update(ctx.vcpuid, frontend.status.physregs_full++);
       break;
     }
 
@@ -729,13 +730,13 @@ void ThreadContext::rename() {
 
     if unlikely (ld && (loads_in_flight >= LDQ_SIZE)) {
       if unlikely (config.event_log_enabled) { if likely (!prepcount) core.eventlog.add(EVENT_RENAME_LDQ_FULL)->threadid = threadid; }
-      per_context_ooocore_stats_update(threadid, frontend.status.ldq_full++);
+      per_context_ooocore_stats_update(ctx.vcpuid, frontend.status.ldq_full++);
       break;
     }
 
     if unlikely (st && (stores_in_flight >= STQ_SIZE)) {
       if unlikely (config.event_log_enabled) { if likely (!prepcount) core.eventlog.add(EVENT_RENAME_STQ_FULL)->threadid = threadid; }
-      per_context_ooocore_stats_update(threadid, frontend.status.stq_full++);
+      per_context_ooocore_stats_update(ctx.vcpuid, frontend.status.stq_full++);
       break;
     }
 
@@ -744,7 +745,7 @@ void ThreadContext::rename() {
       break;
     }
 
-    per_context_ooocore_stats_update(threadid, frontend.status.complete++);
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.status.complete++);
 
     FetchBufferEntry& transop = *fetchq.dequeue();
     ReorderBufferEntry& rob = *ROB.alloc();
@@ -771,10 +772,10 @@ void ThreadContext::rename() {
       stores_in_flight += (st == 1);
     }
 
-    per_context_ooocore_stats_update(threadid, frontend.alloc.reg += (!(ld|st|br)));
-    per_context_ooocore_stats_update(threadid, frontend.alloc.ldreg += ld);
-    per_context_ooocore_stats_update(threadid, frontend.alloc.sfr += st);
-    per_context_ooocore_stats_update(threadid, frontend.alloc.br += br);
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.alloc.reg += (!(ld|st|br)));
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.alloc.ldreg += ld);
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.alloc.sfr += st);
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.alloc.br += br);
 
     //
     // Rename operands:
@@ -905,16 +906,16 @@ void ThreadContext::rename() {
     if unlikely (br) specrrt.renamed_in_this_basic_block.reset();
 #endif
 
-    per_context_ooocore_stats_update(threadid, frontend.renamed.none += ((!renamed_reg) && (!renamed_flags)));
-    per_context_ooocore_stats_update(threadid, frontend.renamed.reg += ((renamed_reg) && (!renamed_flags)));
-    per_context_ooocore_stats_update(threadid, frontend.renamed.flags += ((!renamed_reg) && (renamed_flags)));
-    per_context_ooocore_stats_update(threadid, frontend.renamed.reg_and_flags += ((renamed_reg) && (renamed_flags)));
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.renamed.none += ((!renamed_reg) && (!renamed_flags)));
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.renamed.reg += ((renamed_reg) && (!renamed_flags)));
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.renamed.flags += ((!renamed_reg) && (renamed_flags)));
+    per_context_ooocore_stats_update(ctx.vcpuid, frontend.renamed.reg_and_flags += ((renamed_reg) && (renamed_flags)));
     rob.changestate(rob_frontend_list);
 
     prepcount++;
   }
 
-  per_context_ooocore_stats_update(threadid, frontend.width[prepcount]++);
+  per_context_ooocore_stats_update(ctx.vcpuid, frontend.width[prepcount]++);
 }
 
 void ThreadContext::frontend() {
@@ -1196,7 +1197,7 @@ int ReorderBufferEntry::select_cluster() {
     }
   }
 
-  per_context_ooocore_stats_update(threadid, dispatch.cluster[cluster]++);
+  per_context_ooocore_stats_update(getthread().ctx.vcpuid, dispatch.cluster[cluster]++);
 
   if unlikely (config.event_log_enabled) event->cluster = cluster;
 
@@ -1329,7 +1330,7 @@ int ThreadContext::complete(int cluster) {
   // Check the list of issued ROBs. If a given ROB is complete (i.e., is ready
   // for writeback and forwarding), move it to rob_completed_list.
   //
-  foreach_list_mutable(rob_issued_list[cluster], rob, entry, nextentry) {
+  foreach_rob_in_state(rob_issued_list[cluster], rob) {
     rob->cycles_left--;
 
     if unlikely (rob->cycles_left <= 0) {
@@ -1356,7 +1357,7 @@ int ThreadContext::transfer(int cluster) {
 
   int wakeupcount = 0;
   ReorderBufferEntry* rob;
-  foreach_list_mutable(rob_completed_list[cluster], rob, entry, nextentry) {
+  foreach_rob_in_state(rob_completed_list[cluster], rob) {
     rob->forward();
     rob->forward_cycle++;
     if unlikely (rob->forward_cycle > MAX_FORWARDING_LATENCY) {
@@ -1380,7 +1381,7 @@ int ThreadContext::writeback(int cluster) {
   //  int writecount = 0;
   int wakeupcount = 0;
   ReorderBufferEntry* rob;
-  foreach_list_mutable(rob_ready_to_writeback_list[cluster], rob, entry, nextentry) {
+  foreach_rob_in_state(rob_ready_to_writeback_list[cluster], rob) {
     if unlikely (core.writecount >= WRITEBACK_WIDTH) break;
 
     //
@@ -1429,7 +1430,7 @@ int ThreadContext::writeback(int cluster) {
     // so we don't need to actually write anything back here.
     //
 
-    per_context_ooocore_stats_update(threadid, writeback.writebacks[rob->physreg->rfid]++);
+    per_context_ooocore_stats_update(ctx.vcpuid, writeback.writebacks[rob->physreg->rfid]++);
     rob->physreg->writeback();
     rob->cycles_left = -1;
     rob->changestate(rob_ready_to_commit_queue);
@@ -1721,7 +1722,7 @@ int ReorderBufferEntry::commit() {
   all_ready_to_commit &= found_eom;
 
   if unlikely (!all_ready_to_commit) {
-    per_context_ooocore_stats_update(threadid, commit.result.none++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.result.none++);
     return COMMIT_RESULT_NONE;
   }
 
@@ -1731,7 +1732,7 @@ int ReorderBufferEntry::commit() {
   bool st = isstore(uop.opcode);
   bool br = isbranch(uop.opcode);
 
-  per_context_ooocore_stats_update(threadid, commit.opclass[opclassof(uop.opcode)]++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.opclass[opclassof(uop.opcode)]++);
 
   if unlikely (macro_op_has_exceptions) {
     if unlikely (config.event_log_enabled) event = core.eventlog.add_commit(EVENT_COMMIT_EXCEPTION_ACKNOWLEDGED, this);
@@ -1740,9 +1741,9 @@ int ReorderBufferEntry::commit() {
     if likely (isclass(uop.opcode, OPCLASS_CHECK) & (ctx.exception == EXCEPTION_SkipBlock)) {
       thread.chk_recovery_rip = ctx.commitarf[REG_rip] + uop.bytes;
       if unlikely (config.event_log_enabled) event->type = EVENT_COMMIT_SKIPBLOCK;
-      per_context_ooocore_stats_update(threadid, commit.result.skipblock++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.result.skipblock++);
     } else {
-      per_context_ooocore_stats_update(threadid, commit.result.exception++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.result.exception++);
     }
 
     return COMMIT_RESULT_EXCEPTION;
@@ -1767,7 +1768,7 @@ int ReorderBufferEntry::commit() {
     thread.smc_invalidate_pending = 1;
     thread.smc_invalidate_rvp = uop.rip;
 
-    per_context_ooocore_stats_update(threadid, commit.result.smc++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.result.smc++);
     // Let this uop commit to prevent livelock!
   }
 
@@ -1800,7 +1801,7 @@ int ReorderBufferEntry::commit() {
     if unlikely (lock && (lock->vcpuid != thread.ctx.vcpuid)) {
       if unlikely (config.event_log_enabled) core.eventlog.add_commit(EVENT_COMMIT_MEM_LOCKED, this);
 
-      per_context_ooocore_stats_update(threadid, commit.result.memlocked++);
+      per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.result.memlocked++);
       return COMMIT_RESULT_NONE;
     }
   }
@@ -1908,8 +1909,8 @@ int ReorderBufferEntry::commit() {
     W64 flagmask = setflags_to_x86_flags[uop.setflags];
     ctx.commitarf[REG_flags] = (ctx.commitarf[REG_flags] & ~flagmask) | (physreg->flags & flagmask);
 
-    per_context_ooocore_stats_update(threadid, commit.setflags.no += (uop.setflags == 0));
-    per_context_ooocore_stats_update(threadid, commit.setflags.yes += (uop.setflags != 0));
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.setflags.no += (uop.setflags == 0));
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.setflags.yes += (uop.setflags != 0));
 
     if unlikely (config.event_log_enabled) event->commit.state.reg.rdflags = ctx.commitarf[REG_flags];
 
@@ -1934,7 +1935,10 @@ int ReorderBufferEntry::commit() {
     Waddr mfn = (lsq->physaddr << 3) >> 12;
     smc_setdirty(mfn);
 
-    if (lsq->bytemask) assert(core.caches.commitstore(*lsq, thread.threadid) == 0);
+    if (lsq->bytemask) {
+      assert(core.caches.commitstore(*lsq, thread.threadid) == 0);
+      core.machine.invalidate_other_cores(core.coreid, lsq->physaddr << 3);
+    }
   }
 
   if unlikely (pteupdate) {
@@ -1973,7 +1977,7 @@ int ReorderBufferEntry::commit() {
 
   if likely (!(br|st)) {
     int k = clipto((int)consumer_count, 0, lengthof(stats.ooocore.total.frontend.consumer_count) - 1);
-    per_context_ooocore_stats_update(threadid, frontend.consumer_count[k]++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, frontend.consumer_count[k]++);
   }
 
   physreg->changestate(PHYSREG_ARCH);
@@ -2008,12 +2012,12 @@ int ReorderBufferEntry::commit() {
     }
 
     thread.branchpred.update(uop.predinfo, end_of_branch_x86_insn, ctx.commitarf[REG_rip]);
-    per_context_ooocore_stats_update(threadid, branchpred.updates++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, branchpred.updates++);
   }
 
   if likely (uop.eom) {
     total_user_insns_committed++;
-    per_context_ooocore_stats_update(threadid, commit.insns++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.insns++);
     thread.total_insns_committed++;
 
     stats.summary.insns++;
@@ -2021,7 +2025,7 @@ int ReorderBufferEntry::commit() {
 
   stats.summary.uops++;
   total_uops_committed++;
-  per_context_ooocore_stats_update(threadid, commit.uops++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.uops++);
   thread.total_uops_committed++;
 
   bool uop_is_eom = uop.eom;
@@ -2036,7 +2040,7 @@ int ReorderBufferEntry::commit() {
 
   if unlikely (uop_is_barrier) {
     if unlikely (config.event_log_enabled) core.eventlog.add(EVENT_COMMIT_ASSIST, RIPVirtPhys(ctx.commitarf[REG_rip]))->threadid = thread.threadid;
-    per_context_ooocore_stats_update(threadid, commit.result.barrier++);
+    per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.result.barrier++);
     return COMMIT_RESULT_BARRIER;
   }
 
@@ -2050,7 +2054,7 @@ int ReorderBufferEntry::commit() {
     return COMMIT_RESULT_INTERRUPT;
   }
 
-  per_context_ooocore_stats_update(threadid, commit.result.ok++);
+  per_context_ooocore_stats_update(thread.ctx.vcpuid, commit.result.ok++);
   return COMMIT_RESULT_OK;
 }
 
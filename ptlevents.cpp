@@ -0,0 +1,190 @@
+//
+// PTLsim: Cycle Accurate x86-64 Simulator
+// Event Trace Decoder
+//
+// Reads the binary event trace written by the out of order core
+// with -event-trace and prints the events, optionally filtered.
+//
+// Copyright 2000-2008 Matt T. Yourst <yourst@yourst.com>
+//
+
+#include <globals.h>
+#include <ptlsim.h>
+#include <branchpred.h>
+#include <logic.h>
+#include <dcache.h>
+#include <decode.h>
+#define INSIDE_OOOCORE
+#include <ooocore.h>
+
+using namespace OutOfOrderModel;
+
+struct PTLeventsConfig {
+  W64 uuid;
+  W64 rip;
+  stringbuf type;
+  W64 core;
+  W64 start_cycle;
+  W64 end_cycle;
+  W64 count;
+  bool print_info;
+
+  void reset();
+};
+
+void PTLeventsConfig::reset() {
+  uuid = infinity;
+  rip = infinity;
+  type.reset();
+  core = infinity;
+  start_cycle = 0;
+  end_cycle = infinity;
+  count = infinity;
+  print_info = 0;
+}
+
+PTLeventsConfig options;
+ConfigurationParser<PTLeventsConfig> optionparser;
+
+template <>
+void ConfigurationParser<PTLeventsConfig>::setup() {
+  section("Filters");
+  add(uuid,                             "uuid",                      "Only print events for the uop with this uuid");
+  add(rip,                              "rip",                       "Only print events for uops from this rip");
+  add(type,                             "type",                      "Only print events whose type name starts with <type> (e.g. issue, load_miss)");
+  add(core,                             "core",                      "Only print events from this core");
+
+  section("Range");
+  add(start_cycle,                      "start",                     "First cycle to print");
+  add(end_cycle,                        "end",                       "Last cycle to print");
+  add(count,                            "count",                     "Stop after printing <count> events");
+
+  section("Miscellaneous");
+  add(print_info,                       "info",                      "Only list the chunks in the trace file");
+};
+
+static void print_event(ostream& os, const OutOfOrderCoreEvent& event) {
+  os << intstring(event.uuid, 20), " t", event.threadid, " ",
+    padstring((event.type < EVENT_TYPE_COUNT) ? event_type_names[event.type] : "???", -30);
+
+  if (event.uuid) {
+    stringbuf uopname;
+    nameof(uopname, event.uop);
+    os << " rip ", event.rip, " ", padstring(uopname, -12);
+  }
+
+  // Fetch and rename stall events are not tied to a ROB entry:
+  if (event.type >= EVENT_RENAME_OK) {
+    os << " rob ", intstring(event.rob, -3), " r", intstring(event.physreg, -3), " lsq ", intstring(event.lsq, -3), " cluster ", event.cluster;
+  }
+
+  os << endl;
+}
+
+static bool match_event(const OutOfOrderCoreEvent& event, int typenamelen) {
+  if unlikely (event.type == EVENT_INVALID) return false;
+  if (!inrange((W64)event.cycle, options.start_cycle, options.end_cycle)) return false;
+  if ((options.uuid != infinity) && (event.uuid != options.uuid)) return false;
+  if ((options.rip != infinity) && (event.rip.rip != options.rip)) return false;
+  if (typenamelen && ((event.type >= EVENT_TYPE_COUNT) || strncmp(event_type_names[event.type], options.type, typenamelen))) return false;
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  detect_host_cpu_features();
+  optionparser.setup();
+  options.reset();
+
+  argc--; argv++;
+
+  int n = (argc) ? optionparser.parse(options, argc, argv) : -1;
+
+  if (n < 0) {
+    cerr << "Syntax is:", endl;
+    cerr << "  ptlevents [-options] tracefile", endl, endl;
+    optionparser.printusage(cerr, options);
+    return 1;
+  }
+
+  char* filename = argv[n];
+
+  idstream is(filename);
+  if (!is) {
+    cerr << "ptlevents: Cannot open '", filename, "'", endl;
+    return 2;
+  }
+
+  EventTraceHeader header;
+  if ((is.read(&header, sizeof(header)) != sizeof(header)) || (header.magic != EVENT_TRACE_MAGIC)) {
+    cerr << "ptlevents: '", filename, "' is not an event trace", endl;
+    return 2;
+  }
+
+  if ((header.version != EVENT_TRACE_VERSION) || (header.eventsize != sizeof(OutOfOrderCoreEvent))) {
+    cerr << "ptlevents: '", filename, "' has version ", header.version, " with ", header.eventsize, "-byte events, ",
+      "but this ptlevents reads version ", EVENT_TRACE_VERSION, " with ", sizeof(OutOfOrderCoreEvent), "-byte events", endl;
+    return 2;
+  }
+
+  int typenamelen = strlen(options.type);
+
+  dynarray<OutOfOrderCoreEvent> events;
+  dynarray<byte> packed;
+  W64 printed = 0;
+  W64 chunkid = 0;
+  W64 cycle = infinity;
+
+  for (;;) {
+    EventTraceChunk chunk;
+    int bytes = is.read(&chunk, sizeof(chunk));
+    if (!bytes) break;
+
+    if ((bytes != sizeof(chunk)) || (chunk.magic != EVENT_TRACE_CHUNK_MAGIC)) {
+      cerr << "ptlevents: corrupt chunk header at chunk ", chunkid, endl;
+      return 3;
+    }
+
+    if (options.print_info) {
+      cout << "Chunk ", intstring(chunkid, 8), ": core ", chunk.coreid, ", ", intstring(chunk.count, 8), " events in ",
+        intstring(chunk.bytes, 10), " bytes (", floatstring(((double)chunk.count * sizeof(OutOfOrderCoreEvent)) / (double)max(chunk.bytes, W32(1)), 0, 1), "x), ",
+        "cycles ", chunk.firstcycle, " to ", chunk.lastcycle, endl;
+    }
+
+    // Skip whole chunks outside the requested range without decompressing them:
+    bool skip = options.print_info ||
+      ((options.core != infinity) && (chunk.coreid != options.core)) ||
+      (chunk.lastcycle < options.start_cycle) || (chunk.firstcycle > options.end_cycle);
+
+    if (skip) {
+      is.seek(is.where() + chunk.bytes);
+      chunkid++;
+      continue;
+    }
+
+    packed.resize(chunk.bytes);
+    events.resize(chunk.count);
+
+    if ((is.read(packed.data, chunk.bytes) != chunk.bytes) ||
+        (!delta_rle_decompress(events.data, sizeof(OutOfOrderCoreEvent), chunk.count, packed.data, chunk.bytes))) {
+      cerr << "ptlevents: corrupt data in chunk ", chunkid, endl;
+      return 3;
+    }
+
+    foreach (i, chunk.count) {
+      const OutOfOrderCoreEvent& event = events[i];
+      if (!match_event(event, typenamelen)) continue;
+
+      if (event.cycle != cycle) {
+        cycle = event.cycle;
+        cout << "Cycle ", cycle, " (core ", chunk.coreid, "):", endl;
+      }
+
+      print_event(cout, event);
+      if ((++printed) >= options.count) return 0;
+    }
+
+    chunkid++;
+  }
+
+  return 0;
+}
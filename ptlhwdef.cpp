@@ -496,7 +496,6 @@ ostream& RIPVirtPhysBase::print(ostream& os) const {
 
 void BasicBlock::reset() {
   setzero(*((BasicBlockBase*)this));
-  hashlink.reset();
   mfnlo_loc.reset();
   mfnhi_loc.reset();
   type = BB_TYPE_COND;
@@ -520,7 +519,9 @@ void BasicBlock::reset(const RIPVirtPhys& rip) {
 //
 void BasicBlock::free() {
   if (synthops) delete[] synthops;
+  if (fusedops) delete[] fusedops;
   synthops = null;
+  fusedops = null;
   ::free(this);
 }
 
@@ -530,8 +531,11 @@ BasicBlock* BasicBlock::clone() {
   memcpy(bb, this, sizeof(BasicBlockBase));
 
   bb->synthops = null;
-  // hashlink, mfnlo_loc, mfnhi_loc are always updated after cloning
-  bb->hashlink.reset();
+  bb->fusedops = null;
+  bb->taken_link = null;
+  bb->not_taken_link = null;
+  bb->jitcode = null;
+  // mfnlo_loc, mfnhi_loc are always updated after cloning
   bb->use(0);
 
   foreach (i, count) bb->transops[i] = this->transops[i];
@@ -1308,6 +1308,19 @@ enum {
 };
 extern const char* datatype_names[DATATYPE_COUNT];
 
+//
+// Threaded dispatch in the sequential core: fuse_uops_for_bb() sets
+// TransOp.dispatch to the handler each uop is executed by.
+//
+enum {
+  SEQ_DISPATCH_GENERIC = 0, // loads, stores, branches, checks, assists
+  SEQ_DISPATCH_ALU,         // any other uop
+  SEQ_DISPATCH_ALU_BRANCH,  // add, sub or and fused with the conditional branch after it
+  SEQ_DISPATCH_LOAD_ALU,    // load fused with an ALU uop in the same insn that uses it
+  SEQ_DISPATCH_ALU_STORE,   // ALU uop fused with a store of its result in the same insn
+  SEQ_DISPATCH_COUNT
+};
+
 struct TransOpBase {
   // Opcode:
   byte opcode;
@@ -1324,7 +1337,7 @@ struct TransOpBase {
   // Index in basic block
   byte bbindex;
   // Misc info (terminal writer of targets in this insn, etc)
-  byte final_insn_in_bb:1, final_arch_in_insn:1, final_flags_in_insn:1, any_flags_in_insn:1, pad:3, marked:1;
+  byte final_insn_in_bb:1, final_arch_in_insn:1, final_flags_in_insn:1, any_flags_in_insn:1, dispatch:3, marked:1;
   // Immediates
   W64s rbimm;
   W64s rcimm;
@@ -1362,6 +1375,9 @@ struct BasicBlock;
 
 typedef void (*uopimpl_func_t)(IssueState& state, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags);
 
+// Fused ALU uop and conditional branch: <brstate> holds the branch targets on entry
+typedef void (*fusedimpl_func_t)(IssueState& state, IssueState& brstate, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags);
+
 
 //
 // List of all BBs on a physical page (for SMC invalidation)
@@ -1461,7 +1477,6 @@ static const char* branch_type_names[8] = {
 
 struct BasicBlockBase {
   RIPVirtPhys rip;
-  selflistlink hashlink;
   BasicBlockChunkList::Locator mfnlo_loc;
   BasicBlockChunkList::Locator mfnhi_loc;
   W64 rip_taken;
@@ -1476,12 +1491,20 @@ struct BasicBlockBase {
   byte marked:1, mfence:1, x87:1, sse:1, nondeterministic:1, brtype:3;
   W64 usedregs;
   uopimpl_func_t* synthops;
+  fusedimpl_func_t* fusedops;
   int refcount;
   W32 hitcount;
   W32 predcount;
   W32 confidence;
   W64 lastused;
   W64 lasttarget;
+  // Successor links followed by the sequential core (valid while link_epoch == bbcache.link_epoch)
+  BasicBlock* taken_link;
+  BasicBlock* not_taken_link;
+  W64 link_epoch;
+  // Host code compiled by the sequential core (valid while jit_epoch matches the code buffer)
+  void* jitcode;
+  W64 jit_epoch;
 
   void acquire() {
     refcount++;
@@ -46,6 +46,17 @@ void PTLsimConfig::reset() {
 
   quiet = 0;
   core_name = "ooo";
+  sequential_jit = 0;
+  sample_fastforward_insns = 10000000;
+  sample_warmup_insns = 30000;
+  sample_measure_insns = 10000;
+#ifndef PTLSIM_HYPERVISOR
+  sample_jobs = 0;
+#endif
+  bbv_filename.reset();
+  bbv_interval_insns = 100000000;
+  simpoints_filename.reset();
+  simpoint_weights_filename.reset();
   log_filename = "ptlsim.log";
   loglevel = 0;
   start_log_at_iteration = 0;
@@ -61,6 +72,13 @@ void PTLsimConfig::reset() {
   event_log_enabled = 0;
   event_log_ring_buffer_size = 32768;
   flush_event_log_every_cycle = 0;
+  event_trace_filename.reset();
+  event_log_types.reset();
+  event_log_rip_start = 0;
+  event_log_rip_end = infinity;
+  event_log_thread = infinity;
+  event_log_uuid_start = 0;
+  event_log_uuid_end = infinity;
   log_backwards_from_trigger_rip = INVALIDRIP;
   dump_state_now = 0;
   abort_at_end = 0;
@@ -70,6 +88,7 @@ void PTLsimConfig::reset() {
   stats_filename.reset();
   snapshot_cycles = infinity;
   snapshot_now.reset();
+  snapshot_keyframe_interval = 64;
 
 #ifndef PTLSIM_HYPERVISOR
   // Starting Point
@@ -111,15 +130,27 @@ void PTLsimConfig::reset() {
   validation_start_cycle = 0;
 
   perfect_cache = 0;
+  skip_idle_cycles = 0;
+  functional_warming = 0;
+  ooo_core_count = 1;
+  ooo_quantum_cycles = 1;
+  rob_state_bitmaps = 0;
+  host_profile_interval = 0;
 
   dumpcode_filename = "test.dat";
   dump_at_end = 0;
   overshoot_and_dump = 0;
   bbcache_dump_filename.reset();
+#ifndef PTLSIM_HYPERVISOR
+  bbcache_store_filename.reset();
+#endif
 
 #ifndef PTLSIM_HYPERVISOR
   sequential_mode_insns = 0;
   exit_after_fullsim = 0;
+
+  save_checkpoint_filename.reset();
+  load_checkpoint_filename.reset();
 #endif
 }
 
@@ -142,6 +173,21 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   section("Simulation Control");
 
   add(core_name,                    "core",                 "Run using specified core (-core <corename>)");
+  add(sequential_jit,               "seq-jit",              "Compile hot basic blocks to host code in the sequential core");
+
+  section("Sampled Simulation (-core sample)");
+  add(sample_fastforward_insns,     "sample-ffwd",          "Fast-forward <sample-ffwd> instructions in the sequential core between samples");
+  add(sample_warmup_insns,          "sample-warmup",        "Warm up the out of order core for <sample-warmup> instructions before each sample");
+  add(sample_measure_insns,         "sample-measure",       "Measure IPC over <sample-measure> instructions in each sample");
+#ifndef PTLSIM_HYPERVISOR
+  add(sample_jobs,                  "sample-jobs",          "Run up to <sample-jobs> samples at once in forked child processes (0 = run samples in order)");
+#endif
+
+  section("SimPoint (-core simpoint)");
+  add(bbv_filename,                 "bbv",                  "Write basic block vectors from the sequential core to this file");
+  add(bbv_interval_insns,           "bbv-interval",         "Basic block vector and simpoint interval length in instructions");
+  add(simpoints_filename,           "simpoints",            "SimPoint intervals to simulate (lines of <interval> <cluster>)");
+  add(simpoint_weights_filename,    "simpoint-weights",     "SimPoint weights (lines of <weight> <cluster>)");
 
   section("General Logging Control");
   add(quiet,                        "quiet",                "Do not print PTLsim system information banner");
@@ -163,14 +209,22 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   add(event_log_enabled,            "ringbuf",              "Log all core events to the ring buffer for backwards-in-time debugging");
   add(event_log_ring_buffer_size,   "ringbuf-size",         "Core event log ring buffer size: only save last <ringbuf> entries");
   add(flush_event_log_every_cycle,  "flush-events",         "Flush event log ring buffer to logfile after every cycle");
+  add(event_trace_filename,         "event-trace",          "Write every event to <event-trace> as compressed binary chunks (read with ptlevents) instead of formatting them in the logfile");
   add(log_backwards_from_trigger_rip,"ringbuf-trigger-rip", "Print event ring buffer when first uop in this rip is committed");
   add(log_trigger_virt_addr_start,   "ringbuf-trigger-virt-start", "Print event ring buffer when any virtual address in this range is touched");
   add(log_trigger_virt_addr_end,     "ringbuf-trigger-virt-end",   "Print event ring buffer when any virtual address in this range is touched");
+  add(event_log_types,              "ringbuf-types",        "Only log events whose type names start with one of these comma separated prefixes (e.g. issue,commit_ok)");
+  add(event_log_rip_start,          "ringbuf-rip-start",    "Only log events for uops with rips in this range");
+  add(event_log_rip_end,            "ringbuf-rip-end",      "Only log events for uops with rips in this range");
+  add(event_log_thread,             "ringbuf-thread",       "Only log events for uops from this thread");
+  add(event_log_uuid_start,         "ringbuf-uuid-start",   "Only log events for uops with uuids in this range");
+  add(event_log_uuid_end,           "ringbuf-uuid-end",     "Only log events for uops with uuids in this range");
 
   section("Statistics Database");
   add(stats_filename,               "stats",                "Statistics data store hierarchy root");
   add(snapshot_cycles,              "snapshot-cycles",      "Take statistical snapshot and reset every <snapshot> cycles");
   add(snapshot_now,                 "snapshot-now",         "Take statistical snapshot immediately, using specified name");
+  add(snapshot_keyframe_interval,   "snapshot-keyframes",   "Delta encode snapshots against the previous one, with a full snapshot every <n> (0 = store all in full)");
 #ifndef PTLSIM_HYPERVISOR
   // Userspace only
   section("Start Point");
@@ -217,16 +271,29 @@ void ConfigurationParser<PTLsimConfig>::setup() {
 
   section("Out of Order Core (ooocore)");
   add(perfect_cache,                "perfect-cache",        "Perfect cache performance: all loads and stores hit in L1");
+  add(skip_idle_cycles,             "skip-idle",            "Skip ahead to the next cache miss delivery when all threads are stalled on misses");
+  add(functional_warming,           "warm",                 "Warm the out of order core's caches, TLBs and branch predictors while running the sequential core");
+  add(ooo_core_count,               "ooo-cores",            "Spread the VCPUs over <ooo-cores> out of order cores, each with its own pipeline and caches");
+  add(ooo_quantum_cycles,           "ooo-quantum",          "Run each out of order core <ooo-quantum> cycles at a time before synchronizing with the other cores");
+  add(rob_state_bitmaps,            "rob-bitmaps",          "Scan ROB state lists oldest first using per-state slot bitmaps instead of walking the linked lists");
+  add(host_profile_interval,        "host-profile",         "Time the host cycles spent in each pipeline stage in one of every <n> cycles (0 = never)");
 
   section("Miscellaneous");
   add(dumpcode_filename,            "dumpcode",             "Save page of user code at final rip to file <dumpcode>");
   add(dump_at_end,                  "dump-at-end",          "Set breakpoint and dump core before first instruction executed on return to native mode");
   add(overshoot_and_dump,           "overshoot-and-dump",   "Set breakpoint and dump core after first instruction executed on return to native mode");
   add(bbcache_dump_filename,        "bbdump",               "Basic block cache dump filename");
+#ifndef PTLSIM_HYPERVISOR
+  add(bbcache_store_filename,       "bbstore",              "Reuse translated basic blocks saved in <bbstore> by earlier runs, and add new ones to it");
+#endif
 #ifndef PTLSIM_HYPERVISOR
   // Userspace only
   add(sequential_mode_insns,        "seq",                  "Run in sequential mode for <seq> instructions before switching to out of order");
   add(exit_after_fullsim,           "exitend",              "Kill the thread after full simulation completes rather than going native");
+
+  section("Checkpoints");
+  add(save_checkpoint_filename,     "save-checkpoint",      "Save a checkpoint of the user process (and any warmed caches and predictors) to this file when simulation ends");
+  add(load_checkpoint_filename,     "load-checkpoint",      "Start simulating from a checkpoint saved with -save-checkpoint instead of the program entry point");
 #endif
 };
 
@@ -303,6 +370,9 @@ void print_usage(int argc, char** argv) {
 stringbuf current_stats_filename;
 stringbuf current_log_filename;
 stringbuf current_bbcache_dump_filename;
+#ifndef PTLSIM_HYPERVISOR
+stringbuf current_bbcache_store_filename;
+#endif
 
 void backup_and_reopen_logfile() {
   if (config.log_filename) {
@@ -325,6 +395,23 @@ void force_logging_enabled() {
 extern byte _binary_ptlsim_dst_start;
 extern byte _binary_ptlsim_dst_end;
 StatsFileWriter statswriter;
+StatsMilestone stats_milestone = {limits<W64>::max, 0, null};
+bool in_sample_child = 0;
+
+//
+// Template of PTLsimStats, parsed on first use from the copy linked into the binary
+//
+const DataStoreNodeTemplate& stats_template() {
+  static DataStoreNodeTemplate* dst = null;
+
+  if unlikely (!dst) {
+    const byte* p = &_binary_ptlsim_dst_start;
+    dst = new DataStoreNodeTemplate(p);
+    assert(p <= &_binary_ptlsim_dst_end);
+  }
+
+  return *dst;
+}
 
 void capture_stats_snapshot(const char* name) {
   if unlikely (!statswriter) return;
@@ -347,7 +434,7 @@ void capture_stats_snapshot(const char* name) {
   }
 
   stats.snapshot_uuid = statswriter.next_uuid();
-  statswriter.write(&stats, name);
+  statswriter.write(&stats, name, stats.summary.cycles, stats.summary.insns);
 }
 
 void flush_stats() {
@@ -371,7 +458,7 @@ bool handle_config_change(PTLsimConfig& config, int argc, char** argv) {
     // Can also use "-logfile /dev/fd/1" to send to stdout (or /dev/fd/2 for stderr):
     statswriter.open(config.stats_filename, &_binary_ptlsim_dst_start,
                      &_binary_ptlsim_dst_end - &_binary_ptlsim_dst_start,
-                     sizeof(PTLsimStats));
+                     sizeof(PTLsimStats), config.snapshot_keyframe_interval);
     current_stats_filename = config.stats_filename;
   }
 
@@ -387,6 +474,8 @@ bool handle_config_change(PTLsimConfig& config, int argc, char** argv) {
     config.flush_event_log_every_cycle = 1;
   }
 
+  if (config.event_trace_filename.set()) config.event_log_enabled = 1;
+
   //
   // Fix up parameter defaults:
   //
@@ -406,6 +495,13 @@ bool handle_config_change(PTLsimConfig& config, int argc, char** argv) {
     current_bbcache_dump_filename = config.bbcache_dump_filename;
   }
 
+#ifndef PTLSIM_HYPERVISOR
+  if (config.bbcache_store_filename.set() && (config.bbcache_store_filename != current_bbcache_store_filename)) {
+    bbstore.open(config.bbcache_store_filename);
+    current_bbcache_store_filename = config.bbcache_store_filename;
+  }
+#endif
+
   if (config.log_trigger_virt_addr_start && (!config.log_trigger_virt_addr_end)) {
     config.log_trigger_virt_addr_end = config.log_trigger_virt_addr_start;
   }
@@ -463,6 +559,11 @@ void PTLsimMachine::update_stats(PTLsimStats& stats) { return; }
 void PTLsimMachine::dump_state(ostream& os) { return; }
 void PTLsimMachine::flush_tlb(Context& ctx) { return; }
 void PTLsimMachine::flush_tlb_virt(Context& ctx, Waddr virtaddr) { return; }
+void PTLsimMachine::warm_data_access(Context& ctx, Waddr virtaddr, W64 physaddr, bool store) { return; }
+void PTLsimMachine::warm_insn_fetch(Context& ctx, Waddr virtaddr, W64 physaddr) { return; }
+void PTLsimMachine::warm_branch(Context& ctx, const TransOp& uop, W64 ripafter, W64 target) { return; }
+bool PTLsimMachine::save_checkpoint(odstream& os) { return false; }
+bool PTLsimMachine::load_checkpoint(idstream& is, W64 size) { return false; }
 
 void PTLsimMachine::addmachine(const char* name, PTLsimMachine* machine) {
   if unlikely (!machinetable) {
@@ -607,7 +708,610 @@ bool simulate(const char* machinename) {
   return 0;
 }
 
+//
+// Sampled simulation
+//
+// Alternates between fast-forwarding in the sequential core and
+// short detailed samples in the out of order core, SMARTS style.
+// Each sample first runs <sample-warmup> instructions to warm up
+// the out of order core's pipeline and caches, then measures IPC
+// over the next <sample-measure> instructions. The mean IPC across
+// samples and its confidence interval go in stats.sampling.
+//
+#ifndef PTLSIM_HYPERVISOR
+extern bool privatize_ptlsim_memory();
+#endif
+
+struct SampledMachine: public PTLsimMachine {
+  PTLsimMachine* fastmachine;
+  PTLsimMachine* detailmachine;
+  PTLsimMachine* activemachine;
+
+  W64 samples;
+  double ipc_sum;
+  double ipc_sum_squares;
+
+  SampledMachine(const char* name) {
+    addmachine(name, this);
+    fastmachine = null;
+    detailmachine = null;
+    activemachine = null;
+    samples = 0;
+    ipc_sum = 0;
+    ipc_sum_squares = 0;
+  }
+
+  static PTLsimMachine* init_submachine(PTLsimConfig& config, const char* machinename) {
+    PTLsimMachine* machine = PTLsimMachine::getmachine(machinename);
+
+    if (!machine) {
+      logfile << "Sampled simulation: cannot find core named '", machinename, "'", endl;
+      return null;
+    }
+
+    if (!machine->initialized) {
+      if (!machine->init(config)) return null;
+      machine->initialized = 1;
+    }
+
+    return machine;
+  }
+
+  virtual bool init(PTLsimConfig& config) {
+    fastmachine = init_submachine(config, "seq");
+    detailmachine = init_submachine(config, "ooo");
+    return (fastmachine && detailmachine);
+  }
+
+  //
+  // Run <machine> for <insns> more user instructions, stopping early
+  // at the configured overall stopping point. Returns true only if
+  // the full count was reached and the run should continue.
+  //
+  bool run_for_insns(PTLsimMachine* machine, PTLsimConfig& config, W64 insns) {
+    if unlikely (!insns) return true;
+
+    W64 saved_stop_at_user_insns = config.stop_at_user_insns;
+    W64 target = total_user_insns_committed + insns;
+    config.stop_at_user_insns = min(target, saved_stop_at_user_insns);
+
+    activemachine = machine;
+    machine->run(config);
+    machine->update_stats(stats);
+    activemachine = null;
+
+    config.stop_at_user_insns = saved_stop_at_user_insns;
+
+    return ((total_user_insns_committed >= target) && (total_user_insns_committed < saved_stop_at_user_insns));
+  }
+
+  //
+  // Run one detailed window in the out of order core: <warmup>
+  // instructions, then <measure> more. Both go in a single run, since
+  // each run starts by resetting the core, so the pipeline, caches and
+  // predictors stay warm across the boundary. <base> receives the stats
+  // at the boundary and <boundary> the commit count there. Returns true
+  // only if the whole window completed.
+  //
+  bool run_detailed_window(PTLsimConfig& config, W64 warmup, W64 measure, PTLsimStats& base, W64& boundary) {
+    if (warmup) {
+      stats_milestone.insns = total_user_insns_committed + warmup;
+      stats_milestone.committed = 0;
+      stats_milestone.stats = &base;
+    } else {
+      base = stats;
+      stats_milestone.committed = total_user_insns_committed;
+    }
+
+    bool ok = run_for_insns(detailmachine, config, warmup + measure);
+
+    // Stopped before the boundary: the whole window is warmup
+    bool reached = (stats_milestone.insns == limits<W64>::max);
+    boundary = (reached) ? stats_milestone.committed : total_user_insns_committed;
+    if unlikely (!reached) base = stats;
+
+    stats_milestone.insns = limits<W64>::max;
+    stats_milestone.stats = null;
+
+    return ok && reached;
+  }
+
+#ifndef PTLSIM_HYPERVISOR
+  //
+  // Parallel sampling (-sample-jobs N)
+  //
+  // A sample only depends on the architectural state at its start,
+  // so each one can run in a forked copy of the process while the
+  // parent fast-forwards on to the next sample in the sequential
+  // core. The child runs the warmup and measurement windows in the
+  // out of order core, then sends its result and raw stats back down
+  // a pipe. The parent writes each child's stats as a "sample-<n>"
+  // snapshot and merges its delta into the main stats, oldest first.
+  //
+  // The parent also runs every sample window in the sequential core,
+  // so only the detailed model subtrees are merged; the summary and
+  // sequential core counters already cover those instructions.
+  //
+  struct SampleResult {
+    W64 ok;
+    W64 warmup;
+    W64 insns;
+    W64 cycles;
+  };
+
+  struct SampleChild {
+    int pid;
+    int fd;
+    W64 number;
+    PTLsimStats* base;
+  };
+
+  static bool read_fully(int fd, void* buf, size_t count) {
+    byte* p = (byte*)buf;
+    while (count) {
+      ssize_t rc = sys_read(fd, p, count);
+      if unlikely (rc <= 0) return false;
+      p += rc;
+      count -= rc;
+    }
+    return true;
+  }
+
+  static bool write_fully(int fd, const void* buf, size_t count) {
+    const byte* p = (const byte*)buf;
+    while (count) {
+      ssize_t rc = sys_write(fd, p, count);
+      if unlikely (rc <= 0) return false;
+      p += rc;
+      count -= rc;
+    }
+    return true;
+  }
+
+  int child_fd;
+  PTLsimStats* child_base;
+  W64 child_start;
+
+  void run_sample_child(PTLsimConfig& config, W64 number, int fd) {
+    // Only the parent writes the stats file: the buffer was flushed before the fork
+    statswriter.os.close();
+
+    stringbuf logname;
+    logname << config.log_filename, ".sample-", number;
+    logfile.open(logname);
+
+    in_sample_child = 1;
+    child_fd = fd;
+    child_base = new PTLsimStats();
+    child_start = total_user_insns_committed;
+
+    W64 boundary;
+    bool ok = run_detailed_window(config, config.sample_warmup_insns, config.sample_measure_insns, *child_base, boundary);
+    finish_sample_child(ok, boundary);
+  }
+
+  //
+  // Called from the syscall handler when the child's guest makes a
+  // syscall: the measurement ends there, and the sample is kept if the
+  // warmup was already complete. The parent re-executes the same
+  // instructions in the sequential core, including this syscall.
+  //
+  void end_sample_child() {
+    bool reached = (stats_milestone.insns == limits<W64>::max);
+    if (logable(1)) logfile << "Sample window ends at syscall after ", total_user_insns_committed, " commits", endl;
+    detailmachine->update_stats(stats);
+    finish_sample_child(reached, (reached) ? stats_milestone.committed : total_user_insns_committed);
+  }
+
+  void finish_sample_child(bool ok, W64 boundary) {
+    SampleResult result;
+    result.ok = ok;
+    result.warmup = boundary - child_start;
+    result.insns = total_user_insns_committed - boundary;
+    result.cycles = stats.ooocore.cycles - child_base->ooocore.cycles;
+
+    logfile.close();
+
+    write_fully(child_fd, &result, sizeof(result));
+    write_fully(child_fd, &stats, sizeof(stats));
+    sys_close(child_fd);
+    sys_exit(0);
+  }
+
+  static void merge_sample_subtree(const char* path, const PTLsimStats& childstats, const PTLsimStats& base) {
+    W64 offset;
+    const DataStoreNodeTemplate* dst = stats_template().searchpath(path, offset);
+    assert(dst);
+
+    W64* p = ((W64*)&stats) + offset;
+    const W64* pa = ((const W64*)&childstats) + offset;
+    const W64* pb = ((const W64*)&base) + offset;
+    dst->addscaled(p, pa, pb, 1.0);
+  }
+
+  void reap_sample_child(PTLsimConfig& config, SampleChild& child) {
+    SampleResult result;
+    PTLsimStats* childstats = new PTLsimStats();
+
+    bool ok = read_fully(child.fd, &result, sizeof(result)) && read_fully(child.fd, childstats, sizeof(PTLsimStats)) && result.ok;
+
+    int status = 0;
+    sys_wait4(child.pid, &status, 0, null);
+    sys_close(child.fd);
+
+    // A child that hit the stopping point or the end of the program only returns a partial sample
+    if unlikely (!ok) {
+      logfile << "Sample ", child.number, " (pid ", child.pid, ") did not complete; discarded", endl;
+    } else {
+      stats.sampling.insns.warmup += result.warmup;
+      stats.sampling.insns.measure += result.insns;
+      stats.sampling.cycles += result.cycles;
+
+      double ipc = (result.cycles) ? ((double)result.insns / (double)result.cycles) : 0;
+      samples++;
+      ipc_sum += ipc;
+      ipc_sum_squares += ipc * ipc;
+
+      if (statswriter) {
+        stringbuf name;
+        name << "sample-", child.number;
+        childstats->snapshot_uuid = statswriter.next_uuid();
+        setzero(childstats->snapshot_name);
+        strncpy(childstats->snapshot_name, name, sizeof(childstats->snapshot_name));
+        statswriter.write(childstats, name, childstats->summary.cycles, childstats->summary.insns);
+      }
+
+      merge_sample_subtree("ooocore", *childstats, *child.base);
+      merge_sample_subtree("dcache", *childstats, *child.base);
+
+      if (logable(1)) logfile << "Sample ", child.number, " (pid ", child.pid, "): ", result.insns, " insns in ", result.cycles, " cycles (ipc ", ipc, ")", endl;
+    }
+
+    delete childstats;
+    delete child.base;
+  }
+
+  int run_parallel(PTLsimConfig& config) {
+    logfile << "Starting parallel sampled simulation with up to ", config.sample_jobs, " children: fast-forward ", config.sample_fastforward_insns,
+      ", warmup ", config.sample_warmup_insns, ", measure ", config.sample_measure_insns, " instructions", endl, flush;
+
+    // Children are reaped oldest first, so this is a simple queue
+    dynarray<SampleChild> children;
+    int oldest = 0;
+    W64 forked = 0;
+
+    for (;;) {
+      W64 insns_before = total_user_insns_committed;
+      bool ok = run_for_insns(fastmachine, config, config.sample_fastforward_insns);
+      stats.sampling.insns.fastforward += (total_user_insns_committed - insns_before);
+      if unlikely (!ok) break;
+
+      if ((children.length - oldest) >= config.sample_jobs) {
+        reap_sample_child(config, children[oldest++]);
+      }
+
+      // The child must not share PTLsim's own mappings with the parent
+      if unlikely (!privatize_ptlsim_memory()) {
+        logfile << "Sampled simulation: cannot make PTLsim memory private for fork", endl;
+        break;
+      }
+
+      int fds[2];
+      if unlikely (sys_pipe(fds) < 0) {
+        logfile << "Sampled simulation: cannot create pipe", endl;
+        break;
+      }
+
+      logfile.flush();
+      statswriter.os.flush();
+
+      SampleChild child;
+      child.number = forked;
+      child.base = new PTLsimStats();
+      *child.base = stats;
+
+      int pid = sys_fork();
+
+      if unlikely (pid < 0) {
+        logfile << "Sampled simulation: fork failed (rc ", pid, ")", endl;
+        sys_close(fds[0]);
+        sys_close(fds[1]);
+        delete child.base;
+        break;
+      }
+
+      if (!pid) {
+        sys_close(fds[0]);
+        run_sample_child(config, child.number, fds[1]);
+      }
+
+      sys_close(fds[1]);
+      child.pid = pid;
+      child.fd = fds[0];
+      children.push(child);
+      forked++;
+
+      // Skip over the sample window the child is simulating
+      if unlikely (!run_for_insns(fastmachine, config, config.sample_warmup_insns + config.sample_measure_insns)) break;
+    }
+
+    for (int i = oldest; i < children.length; i++) reap_sample_child(config, children[i]);
+    children.clear();
+
+    logfile << "Exiting parallel sampled simulation after ", samples, " of ", forked, " samples at ", total_user_insns_committed, " commits", endl, flush;
+    return 0;
+  }
+#endif
+
+  virtual int run(PTLsimConfig& config) {
+#ifndef PTLSIM_HYPERVISOR
+    if (config.sample_jobs) {
+      if (!config.bbv_filename.set()) return run_parallel(config);
+      logfile << "Sampled simulation: -bbv needs one continuous run; ignoring -sample-jobs", endl;
+    }
+#endif
+
+    logfile << "Starting sampled simulation: fast-forward ", config.sample_fastforward_insns, ", warmup ",
+      config.sample_warmup_insns, ", measure ", config.sample_measure_insns, " instructions", endl, flush;
+
+    PTLsimStats* base = new PTLsimStats();
+
+    for (;;) {
+      W64 insns_before = total_user_insns_committed;
+      bool ok = run_for_insns(fastmachine, config, config.sample_fastforward_insns);
+      stats.sampling.insns.fastforward += (total_user_insns_committed - insns_before);
+      if unlikely (!ok) break;
+
+      insns_before = total_user_insns_committed;
+      W64 boundary;
+      ok = run_detailed_window(config, config.sample_warmup_insns, config.sample_measure_insns, *base, boundary);
+      W64 insns = total_user_insns_committed - boundary;
+      W64 cycles = stats.ooocore.cycles - base->ooocore.cycles;
+      stats.sampling.insns.warmup += (boundary - insns_before);
+      stats.sampling.insns.measure += insns;
+      stats.sampling.cycles += cycles;
+
+      // Discard partial samples cut off by the stopping point
+      if unlikely (!ok) break;
+
+      double ipc = (cycles) ? ((double)insns / (double)cycles) : 0;
+      samples++;
+      ipc_sum += ipc;
+      ipc_sum_squares += ipc * ipc;
+
+      if (logable(1)) logfile << "Sample ", samples, " at ", total_user_insns_committed, " commits: ", insns, " insns in ", cycles, " cycles (ipc ", ipc, ")", endl;
+    }
+
+    delete base;
+
+    logfile << "Exiting sampled simulation after ", samples, " samples at ", total_user_insns_committed, " commits", endl, flush;
+    return 0;
+  }
+
+  virtual void update_stats(PTLsimStats& stats) {
+    if (activemachine) activemachine->update_stats(stats);
+
+    stats.sampling.samples = samples;
+    if unlikely (!samples) return;
+
+    double n = (double)samples;
+    double mean = ipc_sum / n;
+    double variance = (samples > 1) ? max((ipc_sum_squares - (n * mean * mean)) / (n - 1), 0.0) : 0.0;
+    double stddev = sqrt(variance);
+
+    stats.sampling.ipc.mean = mean;
+    stats.sampling.ipc.stddev = stddev;
+    // 95% confidence interval half-width (normal approximation)
+    stats.sampling.ipc.ci95 = 1.96 * stddev / sqrt(n);
+  }
+
+  virtual void dump_state(ostream& os) {
+    if (activemachine) activemachine->dump_state(os);
+  }
+
+  virtual void flush_tlb(Context& ctx) {
+    if (activemachine) activemachine->flush_tlb(ctx);
+  }
+
+  virtual void flush_tlb_virt(Context& ctx, Waddr virtaddr) {
+    if (activemachine) activemachine->flush_tlb_virt(ctx, virtaddr);
+  }
+};
+
+SampledMachine sampledmodel("sample");
+
+#ifndef PTLSIM_HYPERVISOR
+void end_sample_child() {
+  sampledmodel.end_sample_child();
+}
+#endif
+
+//
+// SimPoint simulation
+//
+// Simulates only the representative intervals chosen by SimPoint from
+// the basic block vectors written with -bbv. Each simulation point is
+// reached by fast-forwarding in the sequential core, warmed up for
+// <sample-warmup> instructions in the out of order core, then measured
+// for one full <bbv-interval>. Every interval is saved as a snapshot
+// named "simpoint-<interval>", and the per-interval deltas, scaled by
+// the cluster weights, are summed into a final "simpoint-weighted"
+// snapshot representing one average interval of the whole program.
+//
+struct SimPointInterval {
+  W64 interval;
+  int cluster;
+  double weight;
+
+  bool operator <(const SimPointInterval& b) const { return (interval < b.interval); }
+  bool operator ==(const SimPointInterval& b) const { return (interval == b.interval); }
+};
+
+//
+// Parse a non-negative decimal fraction like "0.0125" (no exponent).
+// The runtime has no floating point scanf, so do it by hand.
+//
+static double parse_simpoint_weight(const char*& p) {
+  double value = 0;
+  double scale = 1;
+  bool fraction = 0;
+
+  while (*p == ' ') p++;
+
+  for (; *p; p++) {
+    if ((*p == '.') & (!fraction)) { fraction = 1; continue; }
+    if (!inrange(*p, '0', '9')) break;
+    if (fraction) {
+      scale /= 10;
+      value += (*p - '0') * scale;
+    } else {
+      value = (value * 10) + (*p - '0');
+    }
+  }
+
+  return value;
+}
+
+struct SimpointMachine: public SampledMachine {
+  dynarray<SimPointInterval> simpoints;
+
+  SimpointMachine(const char* name): SampledMachine(name) { }
+
+  bool load_simpoints(PTLsimConfig& config) {
+    simpoints.clear();
+
+    istream is(config.simpoints_filename);
+    if (!is) {
+      logfile << "SimPoint: cannot open simpoints file '", config.simpoints_filename, "'", endl;
+      return false;
+    }
+
+    while (is) {
+      char line[256];
+      is >> readline(line, sizeof(line));
+
+      int interval;
+      int cluster;
+      if (sscanf(line, "%d %d", &interval, &cluster) != 2) continue;
+
+      SimPointInterval sp;
+      sp.interval = interval;
+      sp.cluster = cluster;
+      sp.weight = 0;
+      simpoints.push(sp);
+    }
+
+    istream ws(config.simpoint_weights_filename);
+    if (!ws) {
+      logfile << "SimPoint: cannot open weights file '", config.simpoint_weights_filename, "'", endl;
+      return false;
+    }
+
+    while (ws) {
+      char line[256];
+      ws >> readline(line, sizeof(line));
+
+      const char* p = line;
+      double weight = parse_simpoint_weight(p);
+      int cluster;
+      if (sscanf(p, "%d", &cluster) != 1) continue;
+
+      foreach (i, simpoints.length) {
+        if (simpoints[i].cluster == cluster) simpoints[i].weight = weight;
+      }
+    }
+
+    sort(simpoints.data, simpoints.length, DefaultComparator<SimPointInterval>());
+
+    return (simpoints.length > 0);
+  }
+
+  virtual int run(PTLsimConfig& config) {
+    if unlikely (!statswriter) {
+      logfile << "SimPoint: a stats file (-stats) is required to collect the weighted snapshot", endl;
+      return 0;
+    }
+
+    if unlikely (!load_simpoints(config)) {
+      logfile << "SimPoint: no simulation points to run", endl;
+      return 0;
+    }
+
+    PTLsimStats* base = new PTLsimStats();
+    PTLsimStats* weighted = new PTLsimStats();
+    setzero(*weighted);
+    double total_weight = 0;
+    int measured = 0;
+
+    logfile << "Starting SimPoint simulation of ", simpoints.length, " intervals of ", config.bbv_interval_insns, " instructions", endl, flush;
+
+    foreach (i, simpoints.length) {
+      const SimPointInterval& sp = simpoints[i];
+      W64 start = sp.interval * config.bbv_interval_insns;
+
+      if unlikely (start < total_user_insns_committed) {
+        logfile << "SimPoint: skipping interval ", sp.interval, " which overlaps the previous interval", endl;
+        continue;
+      }
+
+      W64 warmup_start = max((start > config.sample_warmup_insns) ? (start - config.sample_warmup_insns) : 0, total_user_insns_committed);
+
+      W64 insns_before = total_user_insns_committed;
+      bool ok = run_for_insns(fastmachine, config, warmup_start - total_user_insns_committed);
+      stats.sampling.insns.fastforward += (total_user_insns_committed - insns_before);
+      if unlikely (!ok) break;
+
+      // Warmup and interval run back to back in one detailed run:
+      insns_before = total_user_insns_committed;
+      W64 boundary;
+      ok = run_detailed_window(config, start - total_user_insns_committed, config.bbv_interval_insns, *base, boundary);
+      stats.sampling.insns.warmup += (boundary - insns_before);
+      stats.sampling.insns.measure += (total_user_insns_committed - boundary);
+
+      // Discard partial intervals cut off by the stopping point
+      if unlikely (!ok) break;
+
+      stringbuf name;
+      name << "simpoint-", sp.interval;
+      capture_stats_snapshot(name);
+
+      W64* p = (W64*)weighted;
+      const W64* pa = (const W64*)&stats;
+      const W64* pb = (const W64*)base;
+      // The template gives the type of every word in PTLsimStats
+      stats_template().addscaled(p, pa, pb, sp.weight);
+
+      total_weight += sp.weight;
+      measured++;
+
+      if (logable(1)) logfile << "SimPoint interval ", sp.interval, " (cluster ", sp.cluster, ", weight ", sp.weight, ") done at ", total_user_insns_committed, " commits", endl;
+    }
+
+    logfile << "Exiting SimPoint simulation after ", measured, " of ", simpoints.length, " intervals (total weight ", total_weight, ")", endl, flush;
+
+    if (measured) {
+      weighted->snapshot_uuid = statswriter.next_uuid();
+      setzero(weighted->snapshot_name);
+      strncpy(weighted->snapshot_name, "simpoint-weighted", sizeof(weighted->snapshot_name));
+      statswriter.write(weighted, "simpoint-weighted", weighted->summary.cycles, weighted->summary.insns);
+      statswriter.flush();
+    }
+
+    delete base;
+    delete weighted;
+
+    return 0;
+  }
+
+  virtual void update_stats(PTLsimStats& stats) {
+    if (activemachine) activemachine->update_stats(stats);
+  }
+};
+
+SimpointMachine simpointmodel("simpoint");
+
 extern void shutdown_uops();
+extern void shutdown_seqcore();
 
 void shutdown_subsystems() {
   //
@@ -615,6 +1319,7 @@ void shutdown_subsystems() {
   // they may have open:
   //
   shutdown_uops();
+  shutdown_seqcore();
   shutdown_decode();
   ptl_mm_flush_logging();
 }
@@ -43,6 +43,13 @@ struct PTLsimMachine {
   virtual void dump_state(ostream& os);
   virtual void flush_tlb(Context& ctx);
   virtual void flush_tlb_virt(Context& ctx, Waddr virtaddr);
+  // Functional warming of caches and predictors by a faster core:
+  virtual void warm_data_access(Context& ctx, Waddr virtaddr, W64 physaddr, bool store);
+  virtual void warm_insn_fetch(Context& ctx, Waddr virtaddr, W64 physaddr);
+  virtual void warm_branch(Context& ctx, const TransOp& uop, W64 ripafter, W64 target);
+  // Microarchitectural state (caches, predictors) kept in checkpoints:
+  virtual bool save_checkpoint(odstream& os);
+  virtual bool load_checkpoint(idstream& is, W64 size);
   static void addmachine(const char* name, PTLsimMachine* machine);
   static PTLsimMachine* getmachine(const char* name);
   static PTLsimMachine* getcurrent();
@@ -82,6 +89,30 @@ struct TransOpBuffer {
 void split_unaligned(const TransOp& transop, TransOpBuffer& buf);
 
 void capture_stats_snapshot(const char* name = null);
+
+//
+// Stats milestone for sampled simulation: once <insns> user instructions
+// have committed, the out of order core copies the stats at that point
+// into <stats>, records the exact commit count in <committed> and clears
+// the milestone, all without leaving the run.
+//
+struct StatsMilestone {
+  W64 insns;
+  W64 committed;
+  PTLsimStats* stats;
+};
+
+extern StatsMilestone stats_milestone;
+
+//
+// Set in a forked sample child (-sample-jobs). The child shares its
+// open file descriptions with the parent, so any syscall that is not
+// handled inside PTLsim ends its window through end_sample_child().
+//
+extern bool in_sample_child;
+void end_sample_child();
+
+const DataStoreNodeTemplate& stats_template();
 void flush_stats();
 bool handle_config_change(PTLsimConfig& config, int argc = 0, char** argv = null);
 void collect_common_sysinfo(PTLsimStats& stats);
@@ -111,6 +142,7 @@ void shutdown_uops();
 uopimpl_func_t get_synthcode_for_uop(int op, int size, bool setflags, int cond, int extshift, bool except, bool internal);
 uopimpl_func_t get_synthcode_for_cond_branch(int opcode, int cond, int size, bool except);
 void synth_uops_for_bb(BasicBlock& bb);
+void fuse_uops_for_bb(BasicBlock& bb);
 struct PTLsimStats;
 void print_banner(ostream& os, const PTLsimStats& stats, int argc = 0, char** argv = null);
 
@@ -139,6 +171,21 @@ struct PTLsimConfig {
 #endif
 
   stringbuf core_name;
+  bool sequential_jit;
+
+  // Sampled simulation
+  W64 sample_fastforward_insns;
+  W64 sample_warmup_insns;
+  W64 sample_measure_insns;
+#ifndef PTLSIM_HYPERVISOR
+  W64 sample_jobs;
+#endif
+
+  // SimPoint
+  stringbuf bbv_filename;
+  W64 bbv_interval_insns;
+  stringbuf simpoints_filename;
+  stringbuf simpoint_weights_filename;
 
   // Logging
   bool quiet;
@@ -158,6 +205,13 @@ struct PTLsimConfig {
   bool event_log_enabled;
   W64 event_log_ring_buffer_size;
   bool flush_event_log_every_cycle;
+  stringbuf event_trace_filename;
+  stringbuf event_log_types;
+  W64 event_log_rip_start;
+  W64 event_log_rip_end;
+  W64 event_log_thread;
+  W64 event_log_uuid_start;
+  W64 event_log_uuid_end;
   W64 log_backwards_from_trigger_rip;
   bool dump_state_now;
   bool abort_at_end;
@@ -169,6 +223,7 @@ struct PTLsimConfig {
   stringbuf stats_filename;
   W64 snapshot_cycles;
   stringbuf snapshot_now;
+  W64 snapshot_keyframe_interval;
 
 #ifndef PTLSIM_HYPERVISOR
   // Starting Point
@@ -213,17 +268,30 @@ struct PTLsimConfig {
 
   // Out of order core features
   bool perfect_cache;
+  bool skip_idle_cycles;
+  bool functional_warming;
+  W64 ooo_core_count;
+  W64 ooo_quantum_cycles;
+  bool rob_state_bitmaps;
+  W64 host_profile_interval;
 
   // Other info
   stringbuf dumpcode_filename;
   bool dump_at_end;
   bool overshoot_and_dump;
   stringbuf bbcache_dump_filename;
+#ifndef PTLSIM_HYPERVISOR
+  stringbuf bbcache_store_filename;
+#endif
 
 #ifndef PTLSIM_HYPERVISOR
   // Simulation Mode
   W64 sequential_mode_insns;
   bool exit_after_fullsim;
+
+  // Checkpoints
+  stringbuf save_checkpoint_filename;
+  stringbuf load_checkpoint_filename;
 #endif
   void reset();
 };
@@ -9,6 +9,7 @@
 #include <datastore.h>
 #define PTLSIM_PUBLIC_ONLY
 #include <ptlhwdef.h>
+#include <pthread.h>
 
 struct PTLstatsConfig {
   stringbuf mode_subtree;
@@ -20,6 +21,8 @@ struct PTLstatsConfig {
   stringbuf mode_table;
   stringbuf mode_slice;
   stringbuf mode_slice_graph;
+  stringbuf mode_timeseries;
+  bool timeseries_binary;
 
   stringbuf table_row_names;
   stringbuf table_col_names;
@@ -54,11 +57,14 @@ struct PTLstatsConfig {
   bool percent_of_toplevel;
   bool hide_zero_branches;
   bool slice_cumulative;
+  stringbuf slice_start;
+  stringbuf slice_end;
   
   bool invert_gains;
 
   bool print_datastore_info;
   bool print_template;
+  W64 threads;
 
   void reset();
 };
@@ -73,6 +79,8 @@ void PTLstatsConfig::reset() {
   mode_table.reset();
   mode_slice.reset();
   mode_slice_graph.reset();
+  mode_timeseries.reset();
+  timeseries_binary = 0;
 
   table_row_names.reset();
   table_col_names.reset();
@@ -107,11 +115,14 @@ void PTLstatsConfig::reset() {
   percent_of_toplevel = 1;
   hide_zero_branches = 1;
   slice_cumulative = 0;
+  slice_start.reset();
+  slice_end.reset();
 
   invert_gains = 0;
 
   print_datastore_info = 0;
   print_template = 0;
+  threads = 1;
 }
 
 PTLstatsConfig config;
@@ -129,6 +140,8 @@ void ConfigurationParser<PTLstatsConfig>::setup() {
   add(mode_table,                       "table",                     "Table of one node across multiple data stores");
   add(mode_slice,                       "slice",                     "Slice of every snapshot, in list format");
   add(mode_slice_graph,                 "slice-graph",               "Slice of every snapshot, in line graph format");
+  add(mode_timeseries,                  "timeseries",                "Export the listed counters from every snapshot, as CSV");
+  add(timeseries_binary,                "timeseries-binary",         "Write -timeseries output in columnar binary format instead of CSV");
 
   section("Table or Graph");
   add(table_row_names,                  "rows",                      "Row names (comma separated)");
@@ -141,8 +154,10 @@ void ConfigurationParser<PTLstatsConfig>::setup() {
   add(invert_gains,                     "invert-gains",              "Invert sense of gains vs losses (i.e. 1 / x)");
 
   section("Statistics Range");
-  add(snapshot,                         "snapshot",                  "Main snapshot (default is final snapshot)");
+  add(snapshot,                         "snapshot",                  "Main snapshot (default is final snapshot): uuid, name, cycle:<n> or insns:<n>");
   add(subtract_branch,                  "subtract",                  "Snapshot to subtract from the main snapshot");
+  add(slice_start,                      "slice-start",               "First snapshot in slice (default is first snapshot)");
+  add(slice_end,                        "slice-end",                 "Last snapshot in slice (default is final snapshot)");
 
   section("Display Control");
   add(show_sum_of_subtrees_only,        "sum-subtrees-only",         "Show only the sum of subtrees in applicable nodes");
@@ -169,6 +184,7 @@ void ConfigurationParser<PTLstatsConfig>::setup() {
   section("Miscellaneous");
   add(print_datastore_info,             "info",                      "Print information about the data store file");
   add(print_template,                   "template",                  "Print template in C++ struct format");
+  add(threads,                          "threads",                   "Read stats files for -collect and tables using <n> threads (0 = one per host CPU)");
 };
 
 struct RGBAColor {
@@ -669,48 +685,136 @@ void printbanner() {
   cerr << endl;
 }
 
-DataStoreNode* collect_into_supernode(int argc, char** argv, char* path, const char* deltastart = null, const char* deltaend = "final") {
-  DataStoreNode* supernode = new DataStoreNode("super");
+//
+// Reading many stats files (for -collect*, tables and bar graphs) is
+// split into one job per file. The jobs are run by a pool of -threads
+// threads, each with its own reader, and only the requested subtree
+// of each snapshot is reconstructed. Errors are reported afterwards
+// by the main thread, in the original order.
+//
+enum { COLLECT_OK, COLLECT_NO_FILE, COLLECT_NO_SNAPSHOT, COLLECT_NO_SUBTREE };
+
+struct CollectJob {
+  char* filename;
+  const char* path;
+  const char* snapshot;
+  const char* subtract;
+  DataStoreNode* node;
+  int status;
+};
 
+static void run_collect_job(CollectJob& job) {
   StatsFileReader reader;
 
-  foreach (i, argc) {
-    char* filename = argv[i];
-    DataStoreNode* endbase;
-    DataStoreNode* end;
-    DataStoreNode* startbase;
-    DataStoreNode* start;
+  job.node = null;
 
-    if (!reader.open(filename)) {
-      cerr << "ptlstats: Cannot open '", filename, "'", endl, endl;
-      return null;
-    }
+  if (!reader.open(job.filename)) {
+    job.status = COLLECT_NO_FILE;
+    return;
+  }
 
-    // Can't have slashes in tree pathnames
-    int filenamelen = strlen(filename);
-    foreach (i, filenamelen) { if (filename[i] == '/') filename[i] = ':'; }
+  bool found = (job.subtract) ? (reader.uuid_of_name(job.snapshot) >= 0) && (reader.uuid_of_name(job.subtract) >= 0) : (reader.uuid_of_name(job.snapshot) >= 0);
 
-    DataStoreNode* dsbase = (deltastart) ? reader.getdelta(deltaend, deltastart) : reader.get(deltaend);
+  if (found) {
+    job.node = (job.subtract) ? reader.getdelta(job.snapshot, job.subtract, job.path) : reader.get(job.snapshot, job.path);
+    job.status = (job.node) ? COLLECT_OK : COLLECT_NO_SUBTREE;
+  } else {
+    job.status = COLLECT_NO_SNAPSHOT;
+  }
 
-    if (!dsbase) {
-      cerr << "ptlstats: Error: cannot find ending snapshot '", deltaend, "' or starting snapshot '", deltastart, "'", endl;
-      reader.close();
-      return null;
-    }
+  reader.close();
+}
 
-    DataStoreNode* ds = null;
+struct CollectJobQueue {
+  CollectJob* jobs;
+  int count;
+  int next;
+};
 
-    if (!(ds = dsbase->searchpath(path))) {
-      cerr << "ptlstats: Error: cannot find subtree '", path, "'", endl;
-      delete dsbase;
-      reader.close();
+static void* collect_thread(void* arg) {
+  CollectJobQueue& queue = *(CollectJobQueue*)arg;
+
+  for (;;) {
+    int i = __sync_fetch_and_add(&queue.next, 1);
+    if (i >= queue.count) break;
+    run_collect_job(queue.jobs[i]);
+  }
+
+  return null;
+}
+
+static void run_collect_jobs(CollectJob* jobs, int count) {
+  int threads = (config.threads) ? config.threads : sysconf(_SC_NPROCESSORS_ONLN);
+  threads = min(max(threads, 1), count);
+
+  CollectJobQueue queue;
+  queue.jobs = jobs;
+  queue.count = count;
+  queue.next = 0;
+
+  // The calling thread is one of the workers:
+  pthread_t* tids = new pthread_t[threads];
+  int started = 0;
+
+  foreach (i, threads-1) {
+    if (pthread_create(&tids[started], null, collect_thread, &queue)) break;
+    started++;
+  }
+
+  collect_thread(&queue);
+
+  foreach (i, started) pthread_join(tids[i], null);
+
+  delete[] tids;
+}
+
+DataStoreNode* collect_into_supernode(int argc, char** argv, char* path, const char* deltastart = null, const char* deltaend = "final") {
+  DataStoreNode* supernode = new DataStoreNode("super");
+
+  CollectJob* jobs = new CollectJob[argc];
+
+  foreach (i, argc) {
+    CollectJob& job = jobs[i];
+    job.filename = argv[i];
+    job.path = path;
+    job.snapshot = deltaend;
+    job.subtract = deltastart;
+  }
+
+  run_collect_jobs(jobs, argc);
+
+  foreach (i, argc) {
+    CollectJob& job = jobs[i];
+
+    if (job.status != COLLECT_OK) {
+      if (job.status == COLLECT_NO_FILE) {
+        cerr << "ptlstats: Cannot open '", job.filename, "'", endl, endl;
+      } else if (job.status == COLLECT_NO_SNAPSHOT) {
+        cerr << "ptlstats: Error: cannot find ending snapshot '", deltaend, "' or starting snapshot '", deltastart, "'", endl;
+      } else {
+        cerr << "ptlstats: Error: cannot find subtree '", path, "'", endl;
+      }
+      foreach (j, argc) { if (jobs[j].node) delete jobs[j].node; }
+      delete[] jobs;
+      delete supernode;
       return null;
     }
+  }
+
+  foreach (i, argc) {
+    CollectJob& job = jobs[i];
 
-    ds->rename(filename);
-    supernode->add(ds);
+    // Can't have slashes in tree pathnames
+    char* filename = job.filename;
+    int filenamelen = strlen(filename);
+    foreach (j, filenamelen) { if (filename[j] == '/') filename[j] = ':'; }
+
+    job.node->rename(filename);
+    supernode->add(job.node);
   }
 
+  delete[] jobs;
+
   return supernode;
 }
 
@@ -827,12 +931,14 @@ bool capture_table(dynarray<char*>& rowlist, dynarray<char*>& collist, dynarray<
   //
   const char* findarray[2] = {"%row", "%col"};
 
-  StatsFileReader reader;
+  int cols = collist.size();
+  int count = rowlist.size() * cols;
+  CollectJob* jobs = new CollectJob[count];
 
   for (int row = 0; row < rowlist.size(); row++) {
-    data[row].resize(collist.size());
+    data[row].resize(cols);
 
-    for (int col = 0; col < collist.size(); col++) {
+    for (int col = 0; col < cols; col++) {
       stringbuf filename;
 
       const char* replarray[2];
@@ -840,23 +946,37 @@ bool capture_table(dynarray<char*>& rowlist, dynarray<char*>& collist, dynarray<
       replarray[1] = collist[col];
       stringsubst(filename, config.table_row_col_pattern, findarray, replarray, 2);
 
-      if (!reader.open(filename)) {
-        cerr << "ptlstats: Cannot open '", filename, "' for row ", row, ", col ", col, endl, endl, flush;
-        return false;
-      }
+      CollectJob& job = jobs[row*cols + col];
+      job.filename = strdup(filename);
+      job.path = statname;
+      job.snapshot = config.snapshot;
+      job.subtract = null;
+    }
+  }
 
-      DataStoreNode* ds = reader.get(config.snapshot);
-      if (!ds) {
-        cerr << "ptlstats: Cannot open snapshot '", config.snapshot, "' in '", filename, "' for row ", row, ", col ", col, endl, endl, flush;
-        reader.close();
-        return false;
+  run_collect_jobs(jobs, count);
+
+  bool ok = true;
+
+  for (int row = 0; row < rowlist.size(); row++) {
+    for (int col = 0; col < cols; col++) {
+      CollectJob& job = jobs[row*cols + col];
+
+      if (job.status == COLLECT_NO_FILE) {
+        cerr << "ptlstats: Cannot open '", job.filename, "' for row ", row, ", col ", col, endl, endl, flush;
+        ok = false;
+        break;
       }
 
-      ds = ds->searchpath(statname);
+      if (job.status == COLLECT_NO_SNAPSHOT) {
+        cerr << "ptlstats: Cannot open snapshot '", config.snapshot, "' in '", job.filename, "' for row ", row, ", col ", col, endl, endl, flush;
+        ok = false;
+        break;
+      }
 
       double value;
-      if (ds) {
-        value = *ds;
+      if (job.node) {
+        value = *job.node;
         sum_of_all_rows[col] += value;
       } else { 
         cerr << "ptlstats: Warning: cannot find subtree '", statname, "' for row ", row, ", col ", col, endl;
@@ -864,12 +984,19 @@ bool capture_table(dynarray<char*>& rowlist, dynarray<char*>& collist, dynarray<
       }
 
       data[row][col] = value;
-
-      reader.close();
     }
+
+    if (!ok) break;
   }
 
-  return true;
+  foreach (i, count) {
+    if (jobs[i].node) delete jobs[i].node;
+    free(jobs[i].filename);
+  }
+
+  delete[] jobs;
+
+  return ok;
 }
 
 void create_table(ostream& os, int tabletype, char* statname, char* rownames, char* colnames, char* row_col_pattern, int scale_relative_to_col) {
@@ -1103,7 +1230,202 @@ void create_grouped_bargraph(ostream& os, char* statname, char* rownames, char*
   svg.exitlayer();
 }
 
+//
+// Time series export: each counter path is resolved once against the
+// template to the word offset of its value in the raw record, and that
+// word is then read straight from every record in the slice range,
+// without reconstructing any trees. Like -slice, each value is the
+// difference from the previous snapshot unless -slice-cumulative.
+//
+// The columnar binary format is a TimeSeriesHeader, then for each
+// column a TimeSeriesColumnHeader followed by its name (with the
+// terminating null), then each column as <rows> consecutive W64s.
+// The first column is the snapshot uuid; if the file has a snapshot
+// table, the cycle and instruction counts it was taken at follow.
+//
+struct TimeSeriesHeader {
+  W64 magic;
+  W64 rows;
+  W64 columns;
+
+  static const W64 MAGIC = 0x31306373744c5450ULL; // 'PTLtsc01'
+};
+
+struct TimeSeriesColumnHeader {
+  W16 type; // DataStoreNodeTemplate::DS_NODE_TYPE_INT or DS_NODE_TYPE_FLOAT
+  W16 namelen;
+};
+
+struct TimeSeriesColumn {
+  char* name;
+  W64 offset;
+  int type;
+};
+
+static bool resolve_timeseries_column(const DataStoreNodeTemplate* dst, char* path, TimeSeriesColumn& col) {
+  col.name = path;
+
+  W64 offset;
+  const DataStoreNodeTemplate* node = dst->searchpath(path, offset);
+  int index = 0;
+
+  if (!node) {
+    // Histogram slots are named by label or index (e.g. "commit.result.ok" or "fetch.width.3"):
+    char* sep = max(strrchr(path, '.'), strrchr(path, '/'));
+    if (!sep) return false;
+
+    char sepchar = *sep;
+    *sep = 0;
+    node = dst->searchpath(path, offset);
+    *sep = sepchar;
+    if ((!node) || (node->type == DataStoreNodeTemplate::DS_NODE_TYPE_NULL) || (node->count <= 1)) return false;
+
+    const char* slot = sep + 1;
+    index = -1;
+
+    if (node->labeled_histogram) {
+      foreach (i, node->count) {
+        if (strequal(node->labels[i], slot)) { index = i; break; }
+      }
+    }
+
+    if ((index < 0) && inrange(slot[0], '0', '9')) index = atoi(slot);
+    if (!inrange(index, 0, int(node->count) - 1)) return false;
+  } else if (node->count != 1) {
+    return false;
+  }
+
+  if ((node->type != DataStoreNodeTemplate::DS_NODE_TYPE_INT) && (node->type != DataStoreNodeTemplate::DS_NODE_TYPE_FLOAT)) return false;
+
+  col.offset = offset + index;
+  col.type = node->type;
+  return true;
+}
+
+static int export_timeseries(StatsFileReader& reader, char* paths) {
+  dynarray<char*> names;
+  names.tokenize(paths, ",");
+
+  dynarray<TimeSeriesColumn> columns;
+  columns.resize(names.length);
+
+  foreach (i, names.length) {
+    if (!resolve_timeseries_column(reader.dst, names[i], columns[i])) {
+      cerr << "ptlstats: Error: '", names[i], "' is not an integer or floating point counter", endl;
+      return 2;
+    }
+  }
+
+  W64s first = (config.slice_start.set()) ? reader.uuid_of_name(config.slice_start) : 0;
+  W64s last = (config.slice_end.set()) ? reader.uuid_of_name(config.slice_end) : W64s(reader.header.record_count) - 1;
+  last = min(last, W64s(reader.header.record_count) - 1);
+
+  if ((first < 0) || (last < first)) {
+    cerr << "ptlstats: Error: cannot find snapshot range '", config.slice_start, "' to '", config.slice_end, "'", endl;
+    return 2;
+  }
+
+  int rows = (last - first) + 1;
+  int cols = columns.length;
+  bool subtract = (!config.slice_cumulative);
+
+  // Values of the previous snapshot, for subtraction:
+  W64* prev = new W64[cols];
+  memset(prev, 0, cols * sizeof(W64));
+
+  if (subtract && (first > 0)) {
+    const W64* rec = reader.record(first - 1);
+    if (rec) { foreach (c, cols) prev[c] = rec[columns[c].offset]; }
+  }
+
+  int fixedcols = (reader.timed()) ? 3 : 1;
+  W64* values = (config.timeseries_binary) ? new W64[rows * cols] : null;
+
+  if (!config.timeseries_binary) {
+    cout << "snapshot";
+    if (reader.timed()) cout << ",cycle,insns";
+    foreach (c, cols) cout << ',', columns[c].name;
+    cout << endl;
+  }
+
+  foreach (r, rows) {
+    W64 uuid = first + r;
+    const W64* rec = reader.record(uuid);
+
+    if (!rec) {
+      cerr << "ptlstats: Error: cannot read snapshot ", uuid, endl;
+      delete[] prev;
+      if (values) delete[] values;
+      return 2;
+    }
+
+    if (!config.timeseries_binary) {
+      cout << uuid;
+      if (reader.timed()) cout << ',', reader.snapshots[uuid].cycle, ',', reader.snapshots[uuid].insns;
+    }
+
+    foreach (c, cols) {
+      W64 raw = rec[columns[c].offset];
+      W64 v = raw;
+
+      if (columns[c].type == DataStoreNodeTemplate::DS_NODE_TYPE_FLOAT) {
+        double d;
+        memcpy(&d, &raw, sizeof(d));
+        if (subtract) {
+          double p;
+          memcpy(&p, &prev[c], sizeof(p));
+          d -= p;
+        }
+        if (values) memcpy(&v, &d, sizeof(v)); else cout << ',', floatstring(d, 0, 6);
+      } else {
+        if (subtract) v -= prev[c];
+        if (!values) cout << ',', W64s(v);
+      }
+
+      if (values) values[c*rows + r] = v;
+      prev[c] = raw;
+    }
+
+    if (!config.timeseries_binary) cout << endl;
+  }
+
+  if (config.timeseries_binary) {
+    TimeSeriesHeader header;
+    header.magic = TimeSeriesHeader::MAGIC;
+    header.rows = rows;
+    header.columns = fixedcols + cols;
+    cout.write(&header, sizeof(header));
+
+    static const char* fixednames[3] = {"snapshot", "cycle", "insns"};
+
+    foreach (c, fixedcols + cols) {
+      const char* name = (c < fixedcols) ? fixednames[c] : columns[c - fixedcols].name;
+      TimeSeriesColumnHeader colheader;
+      colheader.type = (c < fixedcols) ? DataStoreNodeTemplate::DS_NODE_TYPE_INT : columns[c - fixedcols].type;
+      colheader.namelen = strlen(name) + 1;
+      cout.write(&colheader, sizeof(colheader));
+      cout.write(name, colheader.namelen);
+    }
+
+    foreach (c, fixedcols) {
+      foreach (r, rows) {
+        W64 uuid = first + r;
+        W64 v = (c == 0) ? uuid : (c == 1) ? reader.snapshots[uuid].cycle : reader.snapshots[uuid].insns;
+        cout.write(&v, sizeof(v));
+      }
+    }
+
+    cout.write(values, rows * cols * sizeof(W64));
+    delete[] values;
+  }
+
+  delete[] prev;
+
+  return 0;
+}
+
 int main(int argc, char* argv[]) {
+  detect_host_cpu_features();
   configparser.setup();
   config.reset();
 
@@ -1242,6 +1564,15 @@ int main(int argc, char* argv[]) {
     create_grouped_bargraph(cout, config.mode_bargraph, config.table_row_names, config.table_col_names,
                             config.table_row_col_pattern, config.table_scale_rel_to_col, config.graph_title,
                             config.graph_width, config.graph_height);
+  } else if (config.mode_timeseries.set()) {
+    if (!reader.open(filename)) {
+      cerr << "ptlstats: Cannot open '", filename, "'", endl, endl;
+      return 2;
+    }
+
+    int rc = export_timeseries(reader, config.mode_timeseries);
+    reader.close();
+    return rc;
   } else if (config.mode_slice.set() || config.mode_slice_graph.set()) {
     bool graphing = config.mode_slice_graph.set();
 
@@ -1261,22 +1592,44 @@ int main(int argc, char* argv[]) {
       cout << endl;
     }
 
-    double* xpoints = new double[reader.header.record_count];
+    // Look up the range in the snapshot table so only the records in it are read:
+    W64s first = (config.slice_start.set()) ? reader.uuid_of_name(config.slice_start) : 0;
+    W64s last = (config.slice_end.set()) ? reader.uuid_of_name(config.slice_end) : W64s(reader.header.record_count) - 1;
+    last = min(last, W64s(reader.header.record_count) - 1);
+
+    if ((first < 0) || (last < first)) {
+      cerr << "ptlstats: Error: cannot find snapshot range '", config.slice_start, "' to '", config.slice_end, "'", endl;
+      reader.close();
+      return 2;
+    }
+
+    int slicecount = (last - first) + 1;
+    double* xpoints = new double[slicecount];
     double** ypoints = new double*[colnames.length];
 
     foreach (col, colnames.length) {
-      ypoints[col] = new double[reader.header.record_count];
+      ypoints[col] = new double[slicecount];
     }
 
     W64 basecycle = 0;
 
-    foreach (i, reader.header.record_count) {
+    foreach (j, slicecount) {
+      W64 i = first + j;
       bool do_subtract = ((!config.slice_cumulative) && (i > 0));
       DataStoreNode* dsroot = (do_subtract) ? reader.getdelta(i, i-1) : reader.get(i);
 
+      if (!dsroot) {
+        cerr << "ptlstats: Error: cannot read snapshot ", i, endl;
+        foreach (col, colnames.length) delete[] ypoints[col];
+        delete[] ypoints;
+        delete[] xpoints;
+        reader.close();
+        return 2;
+      }
+
       if (!graphing) cout << intstring(i, 16);
 
-      xpoints[i] = i;
+      xpoints[j] = i;
 
       double sum = 0;
 
@@ -1312,11 +1665,11 @@ int main(int argc, char* argv[]) {
           else value = (ds->percent_of_parent() * 100);
         }
         */
-        ypoints[col][i] = value;
+        ypoints[col][j] = value;
       }
 
       foreach (col, colnames.length) {
-        double& value = ypoints[col][i];
+        double& value = ypoints[col][j];
         if (config.use_percents) {
           if (sum) value = 100 * (value / sum);
         }
@@ -1336,7 +1689,7 @@ int main(int argc, char* argv[]) {
     }
 
     if (graphing) {
-      create_svg_of_percentage_line_graph(cout, xpoints, reader.header.record_count, ypoints, colnames.length, colnames,
+      create_svg_of_percentage_line_graph(cout, xpoints, slicecount, ypoints, colnames.length, colnames,
                                           config.graph_width, config.graph_height, null, graph_background, config.graph_stacked);
     }
 
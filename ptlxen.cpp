@@ -2138,6 +2138,7 @@ void ptlsim_init() {
 
   inject_ptlsim_into_toplevel(get_cr3_mfn());
 
+  detect_host_cpu_features();
   init_uops();
   init_decode();
 
@@ -531,14 +531,525 @@ ostream& SequentialCoreEventLog::print(ostream& os, bool only_to_tail, W64 bbcou
 
 static SequentialCoreEventLog eventlog;
 
+//
+// Basic block vector (BBV) collection for SimPoint
+//
+// Counts the user instructions executed in each basic block
+// (keyed by its starting RIP) over fixed intervals of
+// <bbv-interval> instructions, and appends one line per
+// interval to the <bbv> file in SimPoint frequency vector
+// format:
+//
+//   T:id:count :id:count ...
+//
+// Basic block ids are assigned densely in order of first
+// execution; <bbv>.rips maps each id back to its RIP.
+//
+struct BasicBlockVectorEntry {
+  W64 rip;
+  W64 insns;
+  W32 id;
+};
+
+struct BasicBlockVectorCollector {
+  Hashtable<W64, BasicBlockVectorEntry, 16384> blocks;
+  dynarray<BasicBlockVectorEntry*> touched;
+  ostream os;
+  ostream ripos;
+  W64 interval_insns;
+  W64 next_interval_at;
+  W32 next_id;
+
+  BasicBlockVectorCollector() { interval_insns = 0; next_interval_at = 0; next_id = 1; }
+
+  bool enabled() const { return os.ok(); }
+
+  bool open(const char* filename, W64 interval) {
+    os.open(filename);
+    if (!os) return false;
+    stringbuf ripfilename;
+    ripfilename << filename, ".rips";
+    ripos.open(ripfilename);
+    interval_insns = interval;
+    next_interval_at = total_user_insns_committed + interval_insns;
+    return true;
+  }
+
+  void add(W64 rip, int insns) {
+    BasicBlockVectorEntry* entry = blocks.get(rip);
+
+    if unlikely (!entry) {
+      BasicBlockVectorEntry newentry;
+      newentry.rip = rip;
+      newentry.insns = 0;
+      newentry.id = next_id++;
+      entry = blocks.add(rip, newentry);
+      ripos << newentry.id, " 0x", hexstring(rip, 64), endl;
+    }
+
+    if unlikely (!entry->insns) touched.push(entry);
+    entry->insns += insns;
+
+    while unlikely (total_user_insns_committed >= next_interval_at) {
+      write_interval();
+      next_interval_at += interval_insns;
+    }
+  }
+
+  void write_interval() {
+    os << "T";
+    foreach (i, touched.length) {
+      BasicBlockVectorEntry* entry = touched[i];
+      os << ":", entry->id, ":", entry->insns, " ";
+      entry->insns = 0;
+    }
+    os << endl;
+    touched.clear();
+  }
+
+  void close() {
+    if (!enabled()) return;
+    // Final partial interval
+    if (touched.length) write_interval();
+    os.close();
+    ripos.close();
+  }
+};
+
+static BasicBlockVectorCollector bbvcollector;
+
+//
+// Machine whose caches, TLBs and branch predictors are functionally
+// warmed by every committed access (-warm), or null if not warming.
+//
+static PTLsimMachine* warmmachine = null;
+
+void shutdown_seqcore() {
+  bbvcollector.close();
+}
+
+#ifdef __x86_64__
+//
+// Sequential core JIT (-seq-jit)
+//
+// Hot basic blocks are compiled into straight line host code that
+// does, for each uop, exactly what the interpreter loop in
+// SequentialCore::execute() does: load the operands from the
+// architectural register file, compute the result, check for
+// exceptions and write back the result and flags. mov, and, or,
+// xor, add, sub and branches are compiled to host instructions;
+// other ALU uops call their synthop directly. Loads and stores go
+// through seqjit_memory_uop(), which uses the same issueload() and
+// issuestore() paths (and therefore the same address translation)
+// as the interpreter.
+//
+// Compiled code returns (reason << 16) | uopindex, where uopindex is
+// the first uop not completed (bb.count if all were). Anything else
+// unusual (logging, stopping points, warming, transactional commits)
+// just runs the block in the interpreter instead.
+//
+struct SequentialCore;
+
+struct SequentialJitFrame {
+  W64* arf;
+  W16* arflags;
+  SequentialCore* core;
+  W64 saved_flags;
+  IssueState state;
+};
+
+enum {
+  SEQJIT_DONE = 0,            // uopindex == bb.count
+  SEQJIT_EXCEPTION = 1,       // ALU uop raised an exception: code in state.reg.rddata
+  SEQJIT_MEM_EXCEPTION = 2,   // Load or store raised an exception: ctx already updated
+  SEQJIT_RESTART = 3,         // Re-execute from the start of the current instruction
+  SEQJIT_SMC = 4,             // Completed store dirtied the block's own code
+};
+
+typedef int (*seqjit_func_t)(SequentialJitFrame* frame);
+
+static int seqjit_memory_uop(SequentialCore* core, int uopindex, W64 ra, W64 rb, W64 rc);
+
+static const int SEQJIT_CODE_BUFFER_SIZE = 4*1024*1024;
+static const int SEQJIT_MAX_BYTES_PER_UOP = 320;
+static const int SEQJIT_HOT_THRESHOLD = 8;
+
+static byte* seqjit_code_buffer = null;
+static int seqjit_code_used = 0;
+// Bumped when the code buffer is recycled, orphaning all compiled blocks
+static W64 seqjit_epoch = 1;
+
+//
+// Just enough of an x86-64 assembler for the code below. All memory
+// operands are [base + disp32].
+//
+struct SeqJitAssembler {
+  enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R12 = 12, R13 = 13 };
+
+  byte* start;
+  byte* p;
+
+  SeqJitAssembler(byte* buf) { start = buf; p = buf; }
+
+  int size() const { return p - start; }
+
+  void b(byte v) { *p++ = v; }
+  void w16(W16 v) { *(W16*)p = v; p += 2; }
+  void w32(W32 v) { *(W32*)p = v; p += 4; }
+  void w64(W64 v) { *(W64*)p = v; p += 8; }
+
+  void rex(bool w, int reg, int base, bool force = false) {
+    byte r = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | ((base >> 3) & 1);
+    if (force | (r != 0x40)) b(r);
+  }
+
+  void modrm_mem(int reg, int base, W32 disp) {
+    b(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) b(0x24);
+    w32(disp);
+  }
+
+  // mov reg, qword [base+disp]
+  void load64(int reg, int base, W32 disp) { rex(1, reg, base); b(0x8b); modrm_mem(reg, base, disp); }
+  // mov qword [base+disp], reg
+  void store64(int base, W32 disp, int reg) { rex(1, reg, base); b(0x89); modrm_mem(reg, base, disp); }
+  // movzx reg32, word [base+disp]
+  void load16(int reg, int base, W32 disp) { rex(0, reg, base); b(0x0f); b(0xb7); modrm_mem(reg, base, disp); }
+  // mov word [base+disp], reg16
+  void store16(int base, W32 disp, int reg) { b(0x66); rex(0, reg, base); b(0x89); modrm_mem(reg, base, disp); }
+  // mov word [base+disp], imm16
+  void store16imm(int base, W32 disp, W16 imm) { b(0x66); rex(0, 0, base); b(0xc7); modrm_mem(0, base, disp); w16(imm); }
+  // test word [base+disp], imm16
+  void test16imm(int base, W32 disp, W16 imm) { b(0x66); rex(0, 0, base); b(0xf7); modrm_mem(0, base, disp); w16(imm); }
+  // add qword [base+disp], imm32
+  void add64imm(int base, W32 disp, W32 imm) { rex(1, 0, base); b(0x81); modrm_mem(0, base, disp); w32(imm); }
+  // lea reg, [base+disp]
+  void lea(int reg, int base, W32 disp) { rex(1, reg, base); b(0x8d); modrm_mem(reg, base, disp); }
+  // mov reg, imm64
+  void movimm64(int reg, W64 imm) { rex(1, 0, reg); b(0xb8 + (reg & 7)); w64(imm); }
+  // mov reg32, imm32 (zero extended)
+  void movimm32(int reg, W32 imm) { rex(0, 0, reg); b(0xb8 + (reg & 7)); w32(imm); }
+  // mov dst, src (64-bit)
+  void mov(int dst, int src) { rex(1, src, dst); b(0x89); b(0xc0 | ((src & 7) << 3) | (dst & 7)); }
+  // and reg, imm32 (sign extended)
+  void and64imm(int reg, W32 imm) { rex(1, 0, reg); b(0x81); b(0xe0 | (reg & 7)); w32(imm); }
+  // and reg32, imm32
+  void and32imm(int reg, W32 imm) { rex(0, 0, reg); b(0x81); b(0xe0 | (reg & 7)); w32(imm); }
+  // or dst, src (64-bit)
+  void or64(int dst, int src) { rex(1, src, dst); b(0x09); b(0xc0 | ((src & 7) << 3) | (dst & 7)); }
+  // <op> dst, src for an "op r/m, reg" opcode; 32-bit forms zero extend dst
+  void alu(byte opcode, int dst, int src, bool w64) { rex(w64, src, dst); b(opcode); b(0xc0 | ((src & 7) << 3) | (dst & 7)); }
+  // cmov<cc> dst, src (64-bit)
+  void cmov(int cc, int dst, int src) { rex(1, dst, src); b(0x0f); b(0x40 | cc); b(0xc0 | ((dst & 7) << 3) | (src & 7)); }
+  // bt reg32, imm8
+  void btimm(int reg, byte bit) { rex(0, 0, reg); b(0x0f); b(0xba); b(0xe0 | (reg & 7)); b(bit); }
+  // pushfq
+  void pushf() { b(0x9c); }
+  // push reg16; popfw
+  void popf16(int reg) { b(0x66); rex(0, 0, reg); b(0x50 + (reg & 7)); b(0x66); b(0x9d); }
+  // test eax, eax
+  void testeax() { b(0x85); b(0xc0); }
+  // call reg
+  void call(int reg) { rex(0, 0, reg); b(0xff); b(0xd0 | (reg & 7)); }
+  // jnz rel32, returning the address of the rel32 field to patch
+  W32* jnz() { b(0x0f); b(0x85); W32* fixup = (W32*)p; w32(0); return fixup; }
+  // jmp rel32
+  W32* jmp() { b(0xe9); W32* fixup = (W32*)p; w32(0); return fixup; }
+  void patch(W32* fixup, byte* target) { *fixup = (W32)(target - ((byte*)fixup + 4)); }
+  void push(int reg) { rex(0, 0, reg); b(0x50 + (reg & 7)); }
+  void pop(int reg) { rex(0, 0, reg); b(0x58 + (reg & 7)); }
+  void subrsp(byte imm) { b(0x48); b(0x83); b(0xec); b(imm); }
+  void addrsp(byte imm) { b(0x48); b(0x83); b(0xc4); b(imm); }
+  void ret() { b(0xc3); }
+};
+
+static bool seqjit_can_compile(const BasicBlock& bb) {
+  foreach (i, bb.count) {
+    const TransOp& uop = bb.transops[i];
+    if unlikely (uop.unaligned) return false;
+    if unlikely (isclass(uop.opcode, OPCLASS_BARRIER|OPCLASS_CHECK)) return false;
+    // Branch prediction bookkeeping is only done for the final branch
+    if unlikely (isbranch(uop.opcode) && (i != (bb.count-1))) return false;
+#ifdef PTLSIM_HYPERVISOR
+    // Leave the FPU availability checks to the interpreter
+    if unlikely (uop.is_sse|uop.is_x87) return false;
+#endif
+  }
+
+  return true;
+}
+
+//
+// The common ALU uops and conditional branches are compiled to host
+// instructions instead of calls to their synthops. Each computes the
+// same result and flags as the synthop (see aluop() and
+// uop_impl_condbranch() in uopimpl.cpp), leaving rddata in rax and
+// rdflags in rdx. 8 and 16 bit ALU uops merge into ra and are left
+// to the synthops.
+//
+static bool seqjit_can_inline(const TransOp& uop) {
+  switch (uop.opcode) {
+  case OP_mov: case OP_and: case OP_or: case OP_xor: case OP_add: case OP_sub:
+    return (uop.size >= 2);
+  case OP_br: case OP_bru:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static void seqjit_load_operand(SeqJitAssembler& as, int reg, int archreg, W64 imm) {
+  if (archreg == REG_imm) as.movimm64(reg, imm); else as.load64(reg, SeqJitAssembler::RBX, archreg_remap_table[archreg] * 8);
+}
+
+static void seqjit_inline_uop(SeqJitAssembler& as, const TransOp& uop) {
+  typedef SeqJitAssembler A;
+  bool w64 = (uop.size == 3);
+
+  switch (uop.opcode) {
+  case OP_mov: {
+    seqjit_load_operand(as, A::RAX, uop.rb, uop.rbimm);
+    if (!w64) as.alu(0x89, A::RAX, A::RAX, 0);
+    as.load16(A::RDX, A::R12, archreg_remap_table[uop.rb] * 2);
+    break;
+  }
+  case OP_and: case OP_or: case OP_xor: case OP_add: case OP_sub: {
+    // add and sub are really adc and sbb with the carry in from rcflags
+    bool addsub = ((uop.opcode == OP_add) | (uop.opcode == OP_sub));
+    bool carry = addsub && (uop.setflags || (uop.rc != REG_zero));
+    byte opcode = 0;
+    switch (uop.opcode) {
+    case OP_and: opcode = 0x21; break;
+    case OP_or:  opcode = 0x09; break;
+    case OP_xor: opcode = 0x31; break;
+    case OP_add: opcode = (carry) ? 0x11 : 0x01; break;
+    case OP_sub: opcode = (carry) ? 0x19 : 0x29; break;
+    }
+
+    as.load64(A::RAX, A::RBX, archreg_remap_table[uop.ra] * 8);
+    seqjit_load_operand(as, A::RCX, uop.rb, uop.rbimm);
+    if (carry) {
+      as.load16(A::RDX, A::R12, archreg_remap_table[uop.rc] * 2);
+      as.btimm(A::RDX, 0);
+    }
+    as.alu(opcode, A::RAX, A::RCX, w64);
+
+    if (uop.setflags) {
+      // The logical ops clear CF and OF, just like aluop() does
+      as.pushf();
+      as.pop(A::RDX);
+      as.and32imm(A::RDX, FLAG_SF|FLAG_ZF|FLAG_PF|FLAG_CF|FLAG_OF);
+    } else {
+      as.movimm32(A::RDX, 0);
+    }
+    break;
+  }
+  case OP_br: {
+    // Condition codes use the x86 jcc encoding: ZF/SF/PF from ra, CF/OF from rb
+    as.load16(A::RCX, A::R12, archreg_remap_table[uop.ra] * 2);
+    as.and32imm(A::RCX, FLAG_SF|FLAG_ZF|FLAG_PF);
+    as.load16(A::RDX, A::R12, archreg_remap_table[uop.rb] * 2);
+    as.and32imm(A::RDX, FLAG_CF|FLAG_OF);
+    as.or64(A::RCX, A::RDX);
+    as.popf16(A::RCX);
+    as.movimm64(A::RAX, uop.ripseq);
+    as.movimm64(A::RCX, uop.riptaken);
+    as.cmov(uop.cond, A::RAX, A::RCX);
+    as.movimm32(A::RDX, 0);
+    as.movimm32(A::RCX, FLAG_BR_TK);
+    as.cmov(uop.cond, A::RDX, A::RCX);
+    break;
+  }
+  case OP_bru: {
+    as.movimm64(A::RAX, uop.riptaken);
+    as.movimm32(A::RDX, FLAG_BR_TK);
+    break;
+  }
+  default:
+    assert(false);
+  }
+}
+
+//
+// Compile <bb> into the code buffer; returns null if the block
+// cannot be compiled. The buffer is recycled when full.
+//
+static void* seqjit_compile(BasicBlock& bb) {
+  typedef SeqJitAssembler A;
+
+  if unlikely (!seqjit_can_compile(bb)) return null;
+
+  if unlikely (!seqjit_code_buffer) {
+    seqjit_code_buffer = (byte*)ptl_mm_alloc_private_pages(SEQJIT_CODE_BUFFER_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC);
+    if unlikely (!seqjit_code_buffer) return null;
+  }
+
+  int maxbytes = 256 + (bb.count * SEQJIT_MAX_BYTES_PER_UOP);
+  if unlikely ((seqjit_code_used + maxbytes) > SEQJIT_CODE_BUFFER_SIZE) {
+    seqjit_code_used = 0;
+    seqjit_epoch++;
+  }
+
+  A as(seqjit_code_buffer + seqjit_code_used);
+
+  const W32 state_rddata = offsetof_(SequentialJitFrame, state);
+  const W32 state_rdflags = offsetof_(SequentialJitFrame, state) + 14;
+  const W32 saved_flags = offsetof_(SequentialJitFrame, saved_flags);
+
+  //
+  // rbx = arf, r12 = arflags, r13 = frame. After three pushes and
+  // 16 bytes for the 7th call argument, rsp stays 16 byte aligned.
+  //
+  as.push(A::RBX);
+  as.push(A::R12);
+  as.push(A::R13);
+  as.subrsp(16);
+  as.mov(A::R13, A::RDI);
+  as.load64(A::RBX, A::R13, offsetof_(SequentialJitFrame, arf));
+  as.load64(A::R12, A::R13, offsetof_(SequentialJitFrame, arflags));
+
+  W32* bailouts[MAX_BB_UOPS*2];
+  bool memory_bailout[MAX_BB_UOPS*2];
+  int bytes_in_current_insn = 0;
+
+  foreach (i, bb.count) {
+    const TransOp& uop = bb.transops[i];
+    bool ld = isload(uop.opcode);
+    bool st = isstore(uop.opcode);
+    bool br = isbranch(uop.opcode);
+
+    if (uop.som) {
+      bytes_in_current_insn = uop.bytes;
+      as.load64(A::RAX, A::RBX, REG_flags * 8);
+      as.store64(A::R13, saved_flags, A::RAX);
+    }
+
+    if (ld|st) {
+      // Loads and stores do their own writeback in seqjit_memory_uop()
+      as.load64(A::RDI, A::R13, offsetof_(SequentialJitFrame, core));
+      as.movimm32(A::RSI, i);
+      as.load64(A::RDX, A::RBX, archreg_remap_table[uop.ra] * 8);
+      if (uop.rb == REG_imm) as.movimm64(A::RCX, uop.rbimm); else as.load64(A::RCX, A::RBX, archreg_remap_table[uop.rb] * 8);
+      if (uop.rc == REG_imm) as.movimm64(A::R8, uop.rcimm); else as.load64(A::R8, A::RBX, archreg_remap_table[uop.rc] * 8);
+      as.movimm64(A::RAX, (W64)(Waddr)&seqjit_memory_uop);
+      as.call(A::RAX);
+      as.testeax();
+      bailouts[i] = as.jnz();
+      memory_bailout[i] = 1;
+    } else if (seqjit_can_inline(uop)) {
+      seqjit_inline_uop(as, uop);
+      if (br) as.store64(A::R13, state_rddata, A::RAX);
+      bailouts[i] = null;
+      memory_bailout[i] = 0;
+    } else {
+      as.load64(A::RSI, A::RBX, archreg_remap_table[uop.ra] * 8);
+      if (uop.rb == REG_imm) as.movimm64(A::RDX, uop.rbimm); else as.load64(A::RDX, A::RBX, archreg_remap_table[uop.rb] * 8);
+      if (uop.rc == REG_imm) as.movimm64(A::RCX, uop.rcimm); else as.load64(A::RCX, A::RBX, archreg_remap_table[uop.rc] * 8);
+      as.load16(A::R8, A::R12, archreg_remap_table[uop.ra] * 2);
+      as.load16(A::R9, A::R12, archreg_remap_table[uop.rb] * 2);
+      as.load16(A::RAX, A::R12, archreg_remap_table[uop.rc] * 2);
+      as.store64(A::RSP, 0, A::RAX);
+
+      if (br) {
+        as.movimm64(A::RAX, uop.riptaken);
+        as.store64(A::R13, state_rddata, A::RAX);
+        as.movimm64(A::RAX, uop.ripseq);
+        as.store64(A::R13, state_rddata + 8, A::RAX);
+      } else {
+        as.store16imm(A::R13, state_rdflags, 0);
+      }
+
+      as.lea(A::RDI, A::R13, state_rddata);
+      as.movimm64(A::RAX, (W64)(Waddr)bb.synthops[i]);
+      as.call(A::RAX);
+
+      if (br) {
+        bailouts[i] = null;
+      } else {
+        as.test16imm(A::R13, state_rdflags, FLAG_INV);
+        bailouts[i] = as.jnz();
+      }
+      memory_bailout[i] = 0;
+
+      as.load64(A::RAX, A::R13, state_rddata);
+      as.load16(A::RDX, A::R13, state_rdflags);
+    }
+
+    // Writeback, exactly as in the interpreter's commit stage
+    if ((!(ld|st)) && (uop.rd != REG_zero)) {
+      as.store64(A::RBX, uop.rd * 8, A::RAX);
+      as.store16(A::R12, uop.rd * 2, A::RDX);
+
+      if (!uop.nouserflags) {
+        W32 flagmask = setflags_to_x86_flags[uop.setflags];
+        as.load64(A::RCX, A::RBX, REG_flags * 8);
+        as.and64imm(A::RCX, ~flagmask);
+        as.and32imm(A::RDX, flagmask);
+        as.or64(A::RCX, A::RDX);
+        as.store64(A::RBX, REG_flags * 8, A::RCX);
+        as.store16(A::R12, REG_flags * 2, A::RCX);
+      }
+    }
+
+    if (uop.eom && (uop.rd != REG_rip)) as.add64imm(A::RBX, REG_rip * 8, bytes_in_current_insn);
+  }
+
+  as.movimm32(A::RAX, bb.count);
+
+  byte* epilogue = as.p;
+  as.addrsp(16);
+  as.pop(A::R13);
+  as.pop(A::R12);
+  as.pop(A::RBX);
+  as.ret();
+
+  //
+  // Bailout stubs: memory uops return the reason in eax,
+  // ALU uops always bail out with SEQJIT_EXCEPTION.
+  //
+  foreach (i, bb.count) {
+    if (!bailouts[i]) continue;
+    as.patch(bailouts[i], as.p);
+    if (memory_bailout[i]) {
+      // eax = (reason << 16) | uopindex
+      as.b(0xc1); as.b(0xe0); as.b(16); // shl eax, 16
+      as.b(0x0d); as.w32(i);            // or eax, i
+    } else {
+      as.movimm32(A::RAX, (SEQJIT_EXCEPTION << 16) | i);
+    }
+    W32* j = as.jmp();
+    as.patch(j, epilogue);
+  }
+
+  assert(as.size() <= maxbytes);
+
+  void* code = as.start;
+  seqjit_code_used += ceil(as.size(), 16);
+
+  bb.jitcode = code;
+  bb.jit_epoch = seqjit_epoch;
+
+  return code;
+}
+#endif
+
 struct SequentialCore {
   Context& ctx;
   CommitRecord* cmtrec;
 
-  SequentialCore(): ctx(contextof(0)), cmtrec(null) { }
-  SequentialCore(Context& ctx_, CommitRecord* cmtrec_ = null): ctx(ctx_), cmtrec(cmtrec_) { }
+  SequentialCore(): ctx(contextof(0)), cmtrec(null) { chain_from = null; }
+  SequentialCore(Context& ctx_, CommitRecord* cmtrec_ = null): ctx(ctx_), cmtrec(cmtrec_) { chain_from = null; }
 
   BasicBlock* current_basic_block;
+  BasicBlockLookaside bblookaside;
+  BasicBlock* chain_from;
+  W64 chain_from_epoch;
+#ifdef __x86_64__
+  // Block being run by JIT compiled code, and the pages it was fetched from
+  BasicBlock* jit_bb;
+  W64 jit_mfnlo;
+  W64 jit_mfnhi;
+#endif
   int bytes_in_current_insn;
   int current_uop_in_macro_op;
   W64 current_uuid;
@@ -593,6 +1104,7 @@ struct SequentialCore {
   void reset_fetch(W64 realrip) {
     arf[REG_rip] = realrip;
     current_basic_block = null;
+    chain_from = null;
   }
 
   enum {
@@ -746,6 +1258,8 @@ struct SequentialCore {
     //
     state.physaddr = (annul) ? INVALID_PHYSADDR : (physaddr >> 3);
 
+    if unlikely (warmmachine && (!annul)) warmmachine->warm_data_access(ctx, origaddr, physaddr, true);
+
     bool ready;
     byte bytemask;
 
@@ -817,6 +1331,8 @@ struct SequentialCore {
 
     state.physaddr = (annul) ? 0xffffffffffffffffULL : (physaddr >> 3);
 
+    if unlikely (warmmachine && (!annul)) warmmachine->warm_data_access(ctx, origaddr, physaddr, false);
+
     W64 data = 0;
     if likely (!annul) {
       if unlikely (cmtrec) {
@@ -1063,7 +1579,7 @@ struct SequentialCore {
 
     rvp.update(ctx);
 
-    BasicBlock* bb = bbcache(rvp);
+    BasicBlock* bb = bbcache.lookup(rvp, bblookaside);
 
     if likely (bb) {
       current_basic_block = bb;
@@ -1087,10 +1603,215 @@ struct SequentialCore {
     return current_basic_block;
   }
 
+  //
+  // Basic block chaining
+  //
+  // Each block keeps links to the blocks at its taken and not taken
+  // targets, so the next block is usually found without a bbcache
+  // lookup. Freeing any block bumps bbcache.link_epoch, which breaks
+  // every link at once. chain_from is the block just executed, and is
+  // only touched if no block was freed since it started executing.
+  //
+  BasicBlock* fetch_chained_basic_block(Waddr rip) {
+    BasicBlock* prev = chain_from;
+    chain_from = null;
+
+    bool prev_valid = (prev && (chain_from_epoch == bbcache.link_epoch));
+
+    if likely (prev_valid && (prev->link_epoch == bbcache.link_epoch)) {
+      BasicBlock* next = (rip == prev->rip_taken) ? prev->taken_link : (rip == prev->rip_not_taken) ? prev->not_taken_link : null;
+#ifdef PTLSIM_HYPERVISOR
+      // Blocks are also keyed by mode: any page table change bumps the epoch
+      if likely (next) {
+        if unlikely ((next->rip.use64 != ctx.use64) | (next->rip.kernel != ctx.kernel_mode) | (next->rip.df != ((ctx.internal_eflags & FLAG_DF) != 0))) next = null;
+      }
+#endif
+      if likely (next) {
+        stats.decoder.bbcache.chained++;
+        current_basic_block = next;
+        next->use(sim_cycle);
+        return next;
+      }
+    }
+
+    BasicBlock* bb = fetch_or_translate_basic_block(rip);
+
+    // Translation may have reclaimed blocks, possibly including prev
+    if likely (prev_valid && (chain_from_epoch == bbcache.link_epoch)) {
+      if unlikely (prev->link_epoch != bbcache.link_epoch) {
+        prev->taken_link = null;
+        prev->not_taken_link = null;
+        prev->link_epoch = bbcache.link_epoch;
+      }
+
+      if (rip == prev->rip_taken) prev->taken_link = bb;
+      else if (rip == prev->rip_not_taken) prev->not_taken_link = bb;
+    }
+
+    return bb;
+  }
+
   //
   // Execute one basic block sequentially
   //
 
+#ifdef __x86_64__
+  //
+  // Run <bb> as JIT compiled host code if it is hot enough and
+  // nothing requires the interpreter to look at each uop. Returns
+  // -1 if the caller should interpret the block instead.
+  //
+  int execute_jit(BasicBlock* bb, W64 insnlimit) {
+    if likely (!config.sequential_jit) return -1;
+    if unlikely ((cmtrec != null) | config.event_log_enabled | (warmmachine != null) | logable(5)) return -1;
+    if unlikely (insnlimit < bb->user_insn_count) return -1;
+
+    Waddr riplo = bb->rip.rip;
+    Waddr riphi = riplo + bb->bytes;
+    if unlikely (inrange((Waddr)config.stop_at_rip, riplo, riphi) | inrange((Waddr)config.start_log_at_rip, riplo, riphi)) return -1;
+
+    if unlikely ((!bb->jitcode) | (bb->jit_epoch != seqjit_epoch)) {
+      if (bb->hitcount < SEQJIT_HOT_THRESHOLD) return -1;
+      if (!seqjit_compile(*bb)) return -1;
+    }
+
+    RIPVirtPhys rvp(riplo);
+    rvp.update(ctx, bb->bytes);
+
+    // Let the interpreter deal with any pending self modifying code
+    if unlikely (smc_isdirty(rvp.mfnlo) | smc_isdirty(rvp.mfnhi)) return -1;
+
+    SequentialJitFrame frame;
+    frame.arf = arf;
+    frame.arflags = arflags;
+    frame.core = this;
+    frame.saved_flags = arf[REG_flags];
+    frame.state.reg.rdflags = 0;
+
+    jit_bb = bb;
+    jit_mfnlo = rvp.mfnlo;
+    jit_mfnhi = rvp.mfnhi;
+    ctx.exception = 0;
+
+    int rc = ((seqjit_func_t)bb->jitcode)(&frame);
+    int done = lowbits(rc, 16);
+    int reason = rc >> 16;
+
+    //
+    // Bring the counters up to date for the uops that completed.
+    // Uops up to and including a faulting one count as fetched.
+    //
+    int fetched = min(done + (reason != SEQJIT_DONE), (int)bb->count);
+    int insns = 0;
+    foreach (i, fetched) {
+      const TransOp& uop = bb->transops[i];
+      fetch_user_insns_fetched += uop.som;
+      if (uop.som) bytes_in_current_insn = uop.bytes;
+      if (i < done) insns += uop.eom;
+    }
+
+    fetch_uops_fetched += fetched;
+    total_uops_committed += done;
+    seq_total_uops_committed += done;
+    seq_total_user_insns_committed += insns;
+    total_user_insns_committed += (suppress_total_user_insn_count_updates_in_seqcore) ? 0 : insns;
+    stats.summary.insns += insns;
+    stats.summary.uops += done;
+    current_uuid += done;
+
+    switch (reason) {
+    case SEQJIT_DONE:
+      break;
+    case SEQJIT_EXCEPTION:
+      ctx.exception = LO32(frame.state.reg.rddata);
+      arf[REG_flags] = frame.saved_flags;
+      return SEQEXEC_EXCEPTION;
+    case SEQJIT_MEM_EXCEPTION:
+      arf[REG_flags] = frame.saved_flags;
+      return SEQEXEC_EXCEPTION;
+    case SEQJIT_RESTART:
+      // Refetch from the start of the current instruction
+      arf[REG_flags] = frame.saved_flags;
+      arflags[REG_flags] = arf[REG_flags];
+      return SEQEXEC_SMC;
+    case SEQJIT_SMC: {
+      //
+      // The store at uop <done> committed and dirtied this block's
+      // code; finish its instruction the way the interpreter would
+      // and only invalidate if more of the block remains.
+      //
+      const TransOp& uop = bb->transops[done];
+      total_uops_committed++;
+      seq_total_uops_committed++;
+      stats.summary.uops++;
+      current_uuid++;
+      if (uop.eom) {
+        arf[REG_rip] += bytes_in_current_insn;
+        seq_total_user_insns_committed++;
+        total_user_insns_committed += (!suppress_total_user_insn_count_updates_in_seqcore);
+        stats.summary.insns++;
+      }
+      if (done < (bb->count-1)) {
+        logfile << "Self-modifying code at rip ", rvp, " detected: mfn was dirty (invalidate and retry)", endl;
+        bbcache.invalidate_page(rvp.mfnlo, INVALIDATE_REASON_SMC);
+        if (rvp.mfnlo != rvp.mfnhi) bbcache.invalidate_page(rvp.mfnhi, INVALIDATE_REASON_SMC);
+        return SEQEXEC_SMC;
+      }
+      break;
+    }
+    default:
+      assert(false);
+    }
+
+    const TransOp& last = bb->transops[bb->count-1];
+    if (isbranch(last.opcode)) {
+      W64 target = frame.state.reg.rddata;
+      bb->predcount += (last.opcode == OP_jmp) ? (target == bb->lasttarget) : (target == last.riptaken);
+      bb->lasttarget = target;
+    }
+
+    return SEQEXEC_OK;
+  }
+#endif
+
+  void issue_synthop(uopimpl_func_t synthop, const TransOp& uop, IssueState& state) {
+    synthop(state, arf[archreg_remap_table[uop.ra]],
+            (uop.rb == REG_imm) ? uop.rbimm : arf[archreg_remap_table[uop.rb]],
+            (uop.rc == REG_imm) ? uop.rcimm : arf[archreg_remap_table[uop.rc]],
+            arflags[archreg_remap_table[uop.ra]], arflags[archreg_remap_table[uop.rb]], arflags[archreg_remap_table[uop.rc]]);
+  }
+
+  void issue_fused(fusedimpl_func_t fusedop, const TransOp& uop, IssueState& state, IssueState& brstate) {
+    fusedop(state, brstate, arf[archreg_remap_table[uop.ra]],
+            (uop.rb == REG_imm) ? uop.rbimm : arf[archreg_remap_table[uop.rb]],
+            (uop.rc == REG_imm) ? uop.rcimm : arf[archreg_remap_table[uop.rc]],
+            arflags[archreg_remap_table[uop.ra]], arflags[archreg_remap_table[uop.rb]], arflags[archreg_remap_table[uop.rc]]);
+  }
+
+  // Write the result of a committed uop other than a store
+  void commit_result(const TransOp& uop, const IssueState& state) {
+    if unlikely (uop.rd == REG_zero) return;
+
+    arf[uop.rd] = state.reg.rddata;
+    arflags[uop.rd] = state.reg.rdflags;
+
+    if (!uop.nouserflags) {
+      W64 flagmask = setflags_to_x86_flags[uop.setflags];
+      arf[REG_flags] = (arf[REG_flags] & ~flagmask) | (state.reg.rdflags & flagmask);
+      arflags[REG_flags] = arf[REG_flags];
+    }
+  }
+
+  void commit_counts(const TransOp& uop) {
+    total_uops_committed++;
+    seq_total_uops_committed++;
+    seq_total_user_insns_committed += uop.eom;
+    total_user_insns_committed += uop.eom && (!suppress_total_user_insn_count_updates_in_seqcore);
+    stats.summary.insns += uop.eom;
+    stats.summary.uops++;
+    current_uuid++;
+  }
+
   int execute(BasicBlock* bb, W64 insnlimit) {
     arf[REG_rip] = bb->rip;
     
@@ -1111,6 +1832,7 @@ struct SequentialCore {
     }
 
     if unlikely (!bb->synthops) synth_uops_for_bb(*bb);
+    if unlikely (!bb->fusedops) fuse_uops_for_bb(*bb);
     bb->hitcount++;
 
     TransOpBuffer unaligned_ldst_buf;
@@ -1128,10 +1850,289 @@ struct SequentialCore {
 
     assert(bb->rip.rip == arf[REG_rip]);
 
+#ifdef __x86_64__
+    int jitresult = execute_jit(bb, insnlimit);
+    if likely (jitresult >= 0) return jitresult;
+#endif
+
     // See comment below about idempotent updates
     W64 saved_flags = 0;
 
+    //
+    // Threaded dispatch: ALU uops and fused ALU + branch, load + ALU
+    // and ALU + store pairs (see fuse_uops_for_bb()) are run by the
+    // handlers below, each of which jumps straight to the handler for
+    // the next uop. Everything else, and any uop that hits a trigger
+    // rip or raises an exception, goes through the generic path, which
+    // also does all the event logging.
+    //
+    static const void* const threaded_dispatch[SEQ_DISPATCH_COUNT] = {
+      &&dispatch_generic, &&dispatch_alu, &&dispatch_alu_branch, &&dispatch_load_alu, &&dispatch_alu_store
+    };
+
     while ((uopindex < bb->count) & (user_insns < insnlimit)) {
+      if likely ((!config.event_log_enabled) & (!logable(9)) & unaligned_ldst_buf.empty()) goto *threaded_dispatch[bb->transops[uopindex].dispatch];
+      goto dispatch_generic;
+
+    dispatch_alu_branch: {
+        const TransOp& uop = bb->transops[uopindex];
+        const TransOp& br = bb->transops[uopindex+1];
+        Waddr rip = arf[REG_rip];
+        int bytes = (uop.som) ? uop.bytes : bytes_in_current_insn;
+        Waddr brrip = (uop.eom) ? (rip + bytes) : rip;
+
+        // Run the branch separately if the generic path would stop before it:
+        if unlikely (W64(user_insns + uop.eom) >= insnlimit) goto dispatch_alu;
+        if unlikely (br.som & ((brrip == config.stop_at_rip) | (brrip == config.start_log_at_rip))) goto dispatch_alu;
+        if unlikely (uop.som & ((rip == config.stop_at_rip) | (rip == config.start_log_at_rip))) goto dispatch_generic;
+
+        IssueState state;
+        IssueState brstate;
+        state.reg.rdflags = 0;
+        brstate.brreg.riptaken = br.riptaken;
+        brstate.brreg.ripseq = br.ripseq;
+        issue_fused(bb->fusedops[uopindex], uop, state, brstate);
+
+        if likely (uop.som) {
+          current_uop_in_macro_op = 0;
+          bytes_in_current_insn = uop.bytes;
+          fetch_user_insns_fetched++;
+          rvp.update(ctx, uop.bytes);
+          if unlikely (warmmachine && (rvp.mfnlo != RIPVirtPhys::INVALID)) {
+            warmmachine->warm_insn_fetch(ctx, rip, (((W64)rvp.mfnlo) << 12) | lowbits(rip, 12));
+          }
+          saved_flags = arf[REG_flags];
+        }
+
+        if unlikely (smc_isdirty(rvp.mfnlo) | smc_isdirty(rvp.mfnhi)) goto self_modifying_code;
+
+        fetch_uops_fetched++;
+        commit_result(uop, state);
+        if likely (uop.eom) arf[REG_rip] = brrip;
+        commit_counts(uop);
+        user_insns += uop.eom;
+        uopindex++;
+        current_uop_in_macro_op++;
+
+        if likely (br.som) {
+          current_uop_in_macro_op = 0;
+          bytes_in_current_insn = br.bytes;
+          fetch_user_insns_fetched++;
+          rvp.update(ctx, br.bytes);
+          if unlikely (warmmachine && (rvp.mfnlo != RIPVirtPhys::INVALID)) {
+            warmmachine->warm_insn_fetch(ctx, brrip, (((W64)rvp.mfnlo) << 12) | lowbits(brrip, 12));
+          }
+          saved_flags = arf[REG_flags];
+        }
+
+        if unlikely (smc_isdirty(rvp.mfnlo) | smc_isdirty(rvp.mfnhi)) goto self_modifying_code;
+
+        fetch_uops_fetched++;
+        if unlikely (warmmachine) warmmachine->warm_branch(ctx, br, brrip + bytes_in_current_insn, brstate.reg.rddata);
+        bb->predcount += (brstate.reg.rddata == br.riptaken);
+        bb->lasttarget = brstate.reg.rddata;
+
+        commit_result(br, brstate);
+        if likely (br.eom) arf[REG_rip] = brstate.reg.rddata;
+        commit_counts(br);
+        user_insns += br.eom;
+        uopindex++;
+        current_uop_in_macro_op++;
+
+        barrier = 0;
+        stats.decoder.fusion.threaded += 2;
+        stats.decoder.fusion.fused++;
+
+        if unlikely ((uopindex >= bb->count) | (W64(user_insns) >= insnlimit)) continue;
+        goto *threaded_dispatch[bb->transops[uopindex].dispatch];
+      }
+
+    dispatch_load_alu: {
+        const TransOp& ld = bb->transops[uopindex];
+        const TransOp& alu = bb->transops[uopindex+1];
+        Waddr rip = arf[REG_rip];
+
+        if unlikely (ld.unaligned) goto dispatch_generic;
+        if unlikely (ld.som & ((rip == config.stop_at_rip) | (rip == config.start_log_at_rip))) goto dispatch_generic;
+
+        SFR sfr;
+        PTEUpdate pteupdate = 0;
+        Waddr origvirt = 0;
+
+        // Faults and unaligned loads have no side effects here: the generic path redoes them
+        int status = issueload(ld, sfr, origvirt, arf[archreg_remap_table[ld.ra]],
+                               (ld.rb == REG_imm) ? ld.rbimm : arf[archreg_remap_table[ld.rb]],
+                               (ld.rc == REG_imm) ? ld.rcimm : arf[archreg_remap_table[ld.rc]], pteupdate);
+        if unlikely (status != ISSUE_COMPLETED) goto dispatch_generic;
+
+        if likely (ld.som) {
+          current_uop_in_macro_op = 0;
+          bytes_in_current_insn = ld.bytes;
+          fetch_user_insns_fetched++;
+          rvp.update(ctx, ld.bytes);
+          if unlikely (warmmachine && (rvp.mfnlo != RIPVirtPhys::INVALID)) {
+            warmmachine->warm_insn_fetch(ctx, rip, (((W64)rvp.mfnlo) << 12) | lowbits(rip, 12));
+          }
+          saved_flags = arf[REG_flags];
+        }
+
+        if unlikely (smc_isdirty(rvp.mfnlo) | smc_isdirty(rvp.mfnhi)) goto self_modifying_code;
+
+        fetch_uops_fetched++;
+        IssueState ldstate;
+        ldstate.reg.rddata = sfr.data;
+        ldstate.reg.rdflags = 0;
+        commit_result(ld, ldstate);
+        if unlikely (pteupdate && (!cmtrec)) ctx.update_pte_acc_dirty(origvirt, pteupdate);
+        commit_counts(ld);
+        uopindex++;
+        current_uop_in_macro_op++;
+        stats.decoder.fusion.threaded++;
+
+        //
+        // The ALU uop is in the same insn, so it cannot hit a trigger
+        // rip or the insn limit, and the load could not dirty the code.
+        //
+        IssueState state;
+        state.reg.rdflags = 0;
+        issue_synthop(bb->synthops[uopindex], alu, state);
+
+        // The load is committed: the generic path takes the exception from here
+        if unlikely (state.reg.rdflags & FLAG_INV) goto dispatch_generic;
+
+        fetch_uops_fetched++;
+        commit_result(alu, state);
+        if likely (alu.eom) arf[REG_rip] = rip + bytes_in_current_insn;
+        commit_counts(alu);
+        user_insns += alu.eom;
+        uopindex++;
+        current_uop_in_macro_op++;
+
+        barrier = 0;
+        stats.decoder.fusion.threaded++;
+        stats.decoder.fusion.fused++;
+
+        if unlikely ((uopindex >= bb->count) | (W64(user_insns) >= insnlimit)) continue;
+        goto *threaded_dispatch[bb->transops[uopindex].dispatch];
+      }
+
+    dispatch_alu_store: {
+        const TransOp& alu = bb->transops[uopindex];
+        const TransOp& st = bb->transops[uopindex+1];
+        Waddr rip = arf[REG_rip];
+
+        // Split stores go through the generic path:
+        if unlikely (st.unaligned) goto dispatch_alu;
+        if unlikely (alu.som & ((rip == config.stop_at_rip) | (rip == config.start_log_at_rip))) goto dispatch_generic;
+
+        IssueState state;
+        state.reg.rdflags = 0;
+        issue_synthop(bb->synthops[uopindex], alu, state);
+
+        // The generic path recomputes it and takes the exception:
+        if unlikely (state.reg.rdflags & FLAG_INV) goto dispatch_generic;
+
+        if likely (alu.som) {
+          current_uop_in_macro_op = 0;
+          bytes_in_current_insn = alu.bytes;
+          fetch_user_insns_fetched++;
+          rvp.update(ctx, alu.bytes);
+          if unlikely (warmmachine && (rvp.mfnlo != RIPVirtPhys::INVALID)) {
+            warmmachine->warm_insn_fetch(ctx, rip, (((W64)rvp.mfnlo) << 12) | lowbits(rip, 12));
+          }
+          saved_flags = arf[REG_flags];
+        }
+
+        if unlikely (smc_isdirty(rvp.mfnlo) | smc_isdirty(rvp.mfnhi)) goto self_modifying_code;
+
+        fetch_uops_fetched++;
+        commit_result(alu, state);
+        commit_counts(alu);
+        uopindex++;
+        current_uop_in_macro_op++;
+        stats.decoder.fusion.threaded++;
+
+        //
+        // The store is in the same insn as the ALU uop, which wrote its
+        // data straight into the register file above.
+        //
+        SFR sfr;
+        PTEUpdate pteupdate = 0;
+        Waddr origvirt = 0;
+
+        // The ALU uop is committed: the generic path takes any fault from here
+        int status = issuestore(st, sfr, origvirt, arf[archreg_remap_table[st.ra]],
+                                (st.rb == REG_imm) ? st.rbimm : arf[archreg_remap_table[st.rb]],
+                                arf[archreg_remap_table[st.rc]], pteupdate);
+        if unlikely (status != ISSUE_COMPLETED) goto dispatch_generic;
+
+        fetch_uops_fetched++;
+        if likely (sfr.bytemask) {
+          if unlikely (cmtrec) {
+            transactmem.store(sfr.physaddr << 3, sfr.data, sfr.bytemask);
+          } else {
+            storemask(sfr.physaddr << 3, sfr.data, sfr.bytemask);
+          }
+          smc_setdirty((sfr.physaddr << 3) >> 12);
+        }
+        if unlikely (pteupdate && (!cmtrec)) ctx.update_pte_acc_dirty(origvirt, pteupdate);
+
+        if likely (st.eom) arf[REG_rip] = rip + bytes_in_current_insn;
+        commit_counts(st);
+        user_insns += st.eom;
+        uopindex++;
+        current_uop_in_macro_op++;
+
+        barrier = 0;
+        stats.decoder.fusion.threaded++;
+        stats.decoder.fusion.fused++;
+
+        if unlikely ((uopindex >= bb->count) | (W64(user_insns) >= insnlimit)) continue;
+        goto *threaded_dispatch[bb->transops[uopindex].dispatch];
+      }
+
+    dispatch_alu: {
+        const TransOp& uop = bb->transops[uopindex];
+        Waddr rip = arf[REG_rip];
+
+        if unlikely (uop.som & ((rip == config.stop_at_rip) | (rip == config.start_log_at_rip))) goto dispatch_generic;
+
+        IssueState state;
+        state.reg.rdflags = 0;
+        issue_synthop(bb->synthops[uopindex], uop, state);
+
+        // The generic path recomputes it and takes the exception:
+        if unlikely (state.reg.rdflags & FLAG_INV) goto dispatch_generic;
+
+        if likely (uop.som) {
+          current_uop_in_macro_op = 0;
+          bytes_in_current_insn = uop.bytes;
+          fetch_user_insns_fetched++;
+          rvp.update(ctx, uop.bytes);
+          if unlikely (warmmachine && (rvp.mfnlo != RIPVirtPhys::INVALID)) {
+            warmmachine->warm_insn_fetch(ctx, rip, (((W64)rvp.mfnlo) << 12) | lowbits(rip, 12));
+          }
+          saved_flags = arf[REG_flags];
+        }
+
+        if unlikely (smc_isdirty(rvp.mfnlo) | smc_isdirty(rvp.mfnhi)) goto self_modifying_code;
+
+        fetch_uops_fetched++;
+        commit_result(uop, state);
+        if likely (uop.eom) arf[REG_rip] = (uop.rd == REG_rip) ? state.reg.rddata : (rip + bytes_in_current_insn);
+        commit_counts(uop);
+        user_insns += uop.eom;
+        uopindex++;
+        current_uop_in_macro_op++;
+
+        barrier = 0;
+        stats.decoder.fusion.threaded++;
+
+        if unlikely ((uopindex >= bb->count) | (W64(user_insns) >= insnlimit)) continue;
+        goto *threaded_dispatch[bb->transops[uopindex].dispatch];
+      }
+
+    dispatch_generic:
       TransOp uop;
       uopimpl_func_t synthop = null;
 
@@ -1156,13 +2157,16 @@ struct SequentialCore {
         split_unaligned(uop, unaligned_ldst_buf);
         assert(unaligned_ldst_buf.get(uop, synthop));
       }
-  
+
       if likely (uop.som) {
         current_uop_in_macro_op = 0;
         bytes_in_current_insn = uop.bytes;
         fetch_user_insns_fetched++;
         // Update the span of bytes to watch for SMC:
         rvp.update(ctx, uop.bytes);
+        if unlikely (warmmachine && (rvp.mfnlo != RIPVirtPhys::INVALID)) {
+          warmmachine->warm_insn_fetch(ctx, arf[REG_rip], (((W64)rvp.mfnlo) << 12) | lowbits(arf[REG_rip], 12));
+        }
         //
         // Save the flags at the start of this x86 insn in
         // case an ALU uop inside the macro-op updates the
@@ -1180,12 +2184,7 @@ struct SequentialCore {
       // store to overwrite its own instruction bytes, but this update only
       // becomes visible after the store has committed.
       //
-      if unlikely (smc_isdirty(rvp.mfnlo) | (smc_isdirty(rvp.mfnhi))) {
-        logfile << "Self-modifying code at rip ", rvp, " detected: mfn was dirty (invalidate and retry)", endl;
-        bbcache.invalidate_page(rvp.mfnlo, INVALIDATE_REASON_SMC);
-        if (rvp.mfnlo != rvp.mfnhi) bbcache.invalidate_page(rvp.mfnhi, INVALIDATE_REASON_SMC);
-        return SEQEXEC_SMC;
-      }
+      if unlikely (smc_isdirty(rvp.mfnlo) | (smc_isdirty(rvp.mfnhi))) goto self_modifying_code;
 
       fetch_uops_fetched++;
 
@@ -1281,6 +2280,8 @@ struct SequentialCore {
           event->issue.state = state;
         }
 
+        if unlikely (warmmachine) warmmachine->warm_branch(ctx, uop, rip + bytes_in_current_insn, state.reg.rddata);
+
         bb->predcount += (uop.opcode == OP_jmp) ? (state.reg.rddata == bb->lasttarget) : (state.reg.rddata == uop.riptaken);
         bb->lasttarget = state.reg.rddata;
       } else {
@@ -1319,9 +2320,6 @@ struct SequentialCore {
       // Commit
       //
 
-      total_uops_committed++;
-      seq_total_uops_committed++;
-
       assert(!ctx.exception);
 
       if unlikely (uop.opcode == OP_st) {
@@ -1335,15 +2333,8 @@ struct SequentialCore {
           Waddr mfn = (sfr.physaddr << 3) >> 12;
           smc_setdirty(mfn); // why is this being passed zero?
         }
-      } else if likely (uop.rd != REG_zero) {
-        arf[uop.rd] = state.reg.rddata;
-        arflags[uop.rd] = state.reg.rdflags;
-        
-        if (!uop.nouserflags) {
-          W64 flagmask = setflags_to_x86_flags[uop.setflags];
-          arf[REG_flags] = (arf[REG_flags] & ~flagmask) | (state.reg.rdflags & flagmask);
-          arflags[REG_flags] = arf[REG_flags];
-        }
+      } else {
+        commit_result(uop, state);
       }
 
       if unlikely (pteupdate) {
@@ -1393,13 +2384,9 @@ struct SequentialCore {
         }
       }
 
-      seq_total_user_insns_committed += uop.eom;
-      total_user_insns_committed += uop.eom && (!suppress_total_user_insn_count_updates_in_seqcore);
+      commit_counts(uop);
       user_insns += uop.eom;
-      stats.summary.insns += uop.eom;
-      stats.summary.uops++;
 
-      current_uuid++;
       // Don't advance on cracked loads/stores:
       uopindex += unaligned_ldst_buf.empty();
       current_uop_in_macro_op++;
@@ -1416,16 +2403,35 @@ struct SequentialCore {
     if (barrier) return SEQEXEC_BARRIER;
 
     return (insnlimit < bb->user_insn_count) ? SEQEXEC_EARLY_EXIT : SEQEXEC_OK;
+
+  self_modifying_code:
+    logfile << "Self-modifying code at rip ", rvp, " detected: mfn was dirty (invalidate and retry)", endl;
+    bbcache.invalidate_page(rvp.mfnlo, INVALIDATE_REASON_SMC);
+    if (rvp.mfnlo != rvp.mfnhi) bbcache.invalidate_page(rvp.mfnhi, INVALIDATE_REASON_SMC);
+    return SEQEXEC_SMC;
   }
 
   int execute() {
     Waddr rip = arf[REG_rip];
     
-    current_basic_block = fetch_or_translate_basic_block(rip);
+    current_basic_block = fetch_chained_basic_block(rip);
 
     bool exiting = 0;
 
+    W64 user_insns_before = total_user_insns_committed;
+    W64 epoch_before = bbcache.link_epoch;
+    // Self modifying code can free the block during execute():
+    W64 bbrip = current_basic_block->rip;
+
     int result = execute(current_basic_block, (config.stop_at_user_insns - total_user_insns_committed));
+
+    // Only chain from blocks that ran to their normal exit
+    if likely (result == SEQEXEC_OK) {
+      chain_from = current_basic_block;
+      chain_from_epoch = epoch_before;
+    }
+
+    if unlikely (bbvcollector.enabled()) bbvcollector.add(bbrip, total_user_insns_committed - user_insns_before);
     
     switch (result) {
     case SEQEXEC_OK:
@@ -1495,6 +2501,7 @@ struct SequentialCore {
       insncount -= delta_insns;
       
       if (trans.bb.synthops) delete[] trans.bb.synthops;
+      if (trans.bb.fusedops) delete[] trans.bb.fusedops;
       
       if unlikely (config.event_log_enabled) {
         if unlikely (config.flush_event_log_every_cycle) {
@@ -1548,6 +2555,71 @@ struct SequentialCore {
 #endif
 };
 
+#ifdef __x86_64__
+//
+// Called from JIT compiled code to issue and commit a load, store or
+// fence, exactly as the interpreter would. Returns 0 if the uop
+// committed, or the SEQJIT_xxx reason for leaving the compiled code.
+//
+static int seqjit_memory_uop(SequentialCore* core, int uopindex, W64 ra, W64 rb, W64 rc) {
+  Context& ctx = core->ctx;
+  BasicBlock* bb = core->jit_bb;
+  const TransOp& uop = bb->transops[uopindex];
+
+  SFR sfr;
+  PTEUpdate pteupdate = 0;
+  Waddr origvirt = 0;
+  int status;
+
+  if likely (isload(uop.opcode)) {
+    status = core->issueload(uop, sfr, origvirt, ra, rb, rc, pteupdate);
+  } else if unlikely (uop.opcode == OP_mf) {
+    status = SequentialCore::ISSUE_COMPLETED;
+    sfr.data = 0;
+  } else {
+    status = core->issuestore(uop, sfr, origvirt, ra, rb, rc, pteupdate);
+  }
+
+  if unlikely (status == SequentialCore::ISSUE_EXCEPTION) {
+    ctx.exception = LO32(sfr.data);
+    ctx.error_code = HI32(sfr.data);
+#ifdef PTLSIM_HYPERVISOR
+    ctx.cr2 = origvirt;
+#endif
+    return SEQJIT_MEM_EXCEPTION;
+  } else if unlikely (status == SequentialCore::ISSUE_REFETCH) {
+    // Split it next time around; this block is no longer compilable
+    bb->transops[uopindex].unaligned = 1;
+    bb->jitcode = null;
+    return SEQJIT_RESTART;
+  }
+
+  bool smc = 0;
+
+  if unlikely (uop.opcode == OP_st) {
+    if (sfr.bytemask) {
+      storemask(sfr.physaddr << 3, sfr.data, sfr.bytemask);
+      Waddr mfn = (sfr.physaddr << 3) >> 12;
+      smc_setdirty(mfn);
+      smc = smc_isdirty(core->jit_mfnlo) | smc_isdirty(core->jit_mfnhi);
+    }
+  } else if likely (uop.rd != REG_zero) {
+    core->arf[uop.rd] = sfr.data;
+    core->arflags[uop.rd] = 0;
+
+    if (!uop.nouserflags) {
+      W64 flagmask = setflags_to_x86_flags[uop.setflags];
+      core->arf[REG_flags] = (core->arf[REG_flags] & ~flagmask);
+      core->arflags[REG_flags] = core->arf[REG_flags];
+    }
+  }
+
+  if unlikely (pteupdate) ctx.update_pte_acc_dirty(origvirt, pteupdate);
+
+  return (smc) ? SEQJIT_SMC : 0;
+}
+#endif
+
 struct SequentialMachine: public PTLsimMachine {
   SequentialCore* cores[MAX_CONTEXTS];
   bool init_done;
@@ -1588,11 +2660,35 @@ struct SequentialMachine: public PTLsimMachine {
   virtual int run(PTLsimConfig& config) {
     logfile << "Starting sequential core toplevel loop at ", sim_cycle, " cycles and ", total_user_insns_committed, " commits", endl, flush;
 
+    if unlikely (config.bbv_filename.set() && (!bbvcollector.enabled())) {
+      if (bbvcollector.open(config.bbv_filename, config.bbv_interval_insns)) {
+        logfile << "Collecting basic block vectors every ", config.bbv_interval_insns, " instructions into ", config.bbv_filename, endl;
+      } else {
+        logfile << "Warning: cannot open basic block vector file ", config.bbv_filename, endl;
+      }
+    }
+
     if unlikely (config.event_log_enabled && (!eventlog.start)) {
       eventlog.init(config.event_log_ring_buffer_size);
       eventlog.logfile = &logfile;
     }
 
+    warmmachine = null;
+
+    if unlikely (config.functional_warming) {
+      PTLsimMachine* machine = PTLsimMachine::getmachine("ooo");
+      if (machine && (!machine->initialized)) {
+        machine->initialized = machine->init(config);
+      }
+
+      if (machine && machine->initialized) {
+        logfile << "Functionally warming the out of order core's caches and branch predictors", endl;
+        warmmachine = machine;
+      } else {
+        logfile << "Warning: cannot initialize the out of order core for functional warming", endl;
+      }
+    }
+
     foreach (i, contextcount) {
       SequentialCore& core =* cores[i];
       Context& ctx = contextof(i);
@@ -1653,6 +2749,9 @@ struct SequentialMachine: public PTLsimMachine {
       if unlikely (exiting) break;
     }
 
+    // Never warm from execute_sequential() calls made by other cores
+    warmmachine = null;
+
     logfile << "Exiting sequential mode at ", total_user_insns_committed, " commits, ", total_uops_committed, " uops and ", iterations, " iterations (cycles)", endl;
 
     if (logable(1)) {
@@ -1696,6 +2795,25 @@ struct SequentialMachine: public PTLsimMachine {
     // (nop)
   }
 
+  //
+  // Mappings that change while warming must also be
+  // dropped from the warmed TLBs.
+  //
+  virtual void flush_tlb(Context& ctx) {
+#ifdef PTLSIM_HYPERVISOR
+    // Chained blocks skip the virtual to physical check
+    bbcache.link_epoch++;
+#endif
+    if unlikely (warmmachine) warmmachine->flush_tlb(ctx);
+  }
+
+  virtual void flush_tlb_virt(Context& ctx, Waddr virtaddr) {
+#ifdef PTLSIM_HYPERVISOR
+    bbcache.link_epoch++;
+#endif
+    if unlikely (warmmachine) warmmachine->flush_tlb_virt(ctx, virtaddr);
+  }
+
 };
 
 SequentialMachine seqmodel("seq");
@@ -100,6 +100,28 @@ struct PTLsimStats { // rootnode:
         double user_commits_per_sec;
       } rate;
     } performance;
+
+    // Host time per pipeline stage, in the cycles sampled with -host-profile <n>
+    struct host_profile {
+      W64 interval;
+      W64 samples;
+      W64 host_cycles;
+      double host_cycles_per_sample;
+      struct stages { // node: summable
+        W64 fetch;
+        W64 decode;
+        W64 rename;
+        W64 frontend;
+        W64 dispatch;
+        W64 issue;
+        W64 issueload;
+        W64 issuestore;
+        W64 complete;
+        W64 transfer;
+        W64 writeback;
+        W64 commit;
+      } stages;
+    } host_profile;
   } simulator;
 
   //
@@ -131,8 +153,32 @@ struct PTLsimStats { // rootnode:
       W64 count;
       W64 inserts;
       W64 invalidates[INVALIDATE_REASON_COUNT]; // label: invalidate_reason_names
+      W64 chained;
+      // Fetch path lookups that missed the per-thread lookaside
+      W64 hits;
+      W64 misses;
+      W64 probes;
+      struct lookaside { // node: summable
+        W64 hits;
+        W64 misses;
+      } lookaside;
     } bbcache;
 
+    // Threaded dispatch in the sequential core (see fuse_uops_for_bb())
+    struct fusion {
+      W64 blocks;
+      W64 pairs;
+      W64 threaded;
+      W64 fused;
+    } fusion;
+
+    // Persistent basic block store (-bbstore)
+    struct bbstore {
+      W64 hits;
+      W64 misses;
+      W64 writes;
+    } bbstore;
+
     // Page cache
     struct pagecache {
       W64 count;
@@ -143,6 +189,24 @@ struct PTLsimStats { // rootnode:
     W64 reclaim_rounds;
   } decoder;
 
+  //
+  // Sampled simulation (-core sample)
+  //
+  struct sampling {
+    W64 samples;
+    struct insns { // node: summable
+      W64 fastforward;
+      W64 warmup;
+      W64 measure;
+    } insns;
+    W64 cycles;
+    struct ipc {
+      double mean;
+      double stddev;
+      double ci95;
+    } ipc;
+  } sampling;
+
   OutOfOrderCoreStats ooocore;
   DataCacheStats dcache;
 
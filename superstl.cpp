@@ -869,6 +869,69 @@ namespace superstl {
 
   double CycleTimer::hz = 0;
 
+  static inline byte delta_rle_byte(const byte* p, int i, int recsize) {
+    return (i >= recsize) ? (p[i] ^ p[i - recsize]) : p[i];
+  }
+
+  int delta_rle_compress(byte* out, const void* records, int recsize, int count) {
+    const byte* p = (const byte*)records;
+    int n = recsize * count;
+    byte* o = out;
+    int i = 0;
+
+    while (i < n) {
+      int z = 0;
+      while (((i + z) < n) && (z < 128) && (!delta_rle_byte(p, i + z, recsize))) z++;
+
+      // Lone zeros are cheaper inside a literal run:
+      if ((z >= 2) || ((z == 1) && ((i + 1) == n))) {
+        *o++ = 0x80 + (z - 1);
+        i += z;
+        continue;
+      }
+
+      byte* token = o++;
+      int l = 0;
+      while ((i < n) && (l < 128)) {
+        byte d = delta_rle_byte(p, i, recsize);
+        if ((!d) && ((i + 1) < n) && (!delta_rle_byte(p, i + 1, recsize))) break;
+        *o++ = d;
+        i++;
+        l++;
+      }
+      *token = l - 1;
+    }
+
+    return o - out;
+  }
+
+  bool delta_rle_decompress(void* records, int recsize, int count, const byte* in, int inbytes) {
+    byte* p = (byte*)records;
+    int n = recsize * count;
+    int i = 0;
+    const byte* end = in + inbytes;
+
+    while (in < end) {
+      byte c = *in++;
+      int l = (c & 0x7f) + 1;
+      if unlikely ((i + l) > n) return false;
+      if (c & 0x80) {
+        memset(p + i, 0, l);
+      } else {
+        if unlikely ((in + l) > end) return false;
+        memcpy(p + i, in, l);
+        in += l;
+      }
+      i += l;
+    }
+
+    if unlikely (i != n) return false;
+
+    for (i = recsize; i < n; i++) p[i] ^= p[i - recsize];
+
+    return true;
+  }
+
   ostream& operator <<(ostream& os, const CycleTimer& ct) {
     double seconds = ((double)ct.total / ct.gethz());
     os << "CycleTimer ", padstring(ct.title, -16), " ", intstring(ct.total, 16), " cycles, ", 
@@ -1720,3 +1783,51 @@ const W64 expand_8bit_to_64bit_lut[256] alignto(8) = {
   0xffffffffff000000ULL,   0xffffffffff0000ffULL,   0xffffffffff00ff00ULL,   0xffffffffff00ffffULL,
   0xffffffffffff0000ULL,   0xffffffffffff00ffULL,   0xffffffffffffff00ULL,   0xffffffffffffffffULL,
 };
+
+HostCPUFeatures host_cpu;
+
+void detect_host_cpu_features() {
+  setzero(host_cpu);
+
+  W32 eax, ebx, ecx, edx;
+
+  cpuid(0, eax, ebx, ecx, edx);
+  W32 maxfunc = eax;
+  if (maxfunc < 1) return;
+
+  // "AuthenticAMD" or "HygonGenuine":
+  bool amd = ((ebx == 0x68747541) && (edx == 0x69746e65) && (ecx == 0x444d4163)) ||
+    ((ebx == 0x6f677948) && (edx == 0x6e65476e) && (ecx == 0x656e6975));
+
+  cpuid(0x80000000, eax, ebx, ecx, edx);
+  if (eax >= 0x80000001) {
+    cpuid(0x80000001, eax, ebx, ecx, edx);
+    host_cpu.lzcnt = bit(ecx, 5);
+  }
+
+  cpuid(1, eax, ebx, ecx, edx);
+  host_cpu.popcnt = bit(ecx, 23);
+  W32 family = bits(eax, 8, 4);
+  if (family == 0xf) family += bits(eax, 20, 8);
+
+  if (maxfunc < 7) return;
+
+  W32 ecx1 = ecx;
+  asm("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "0" (7), "2" (0));
+  W32 ebx7 = ebx;
+  host_cpu.bmi1 = bit(ebx7, 3);
+  host_cpu.bmi2 = bit(ebx7, 8);
+  // Zen 1 and 2 (family 0x17, and Hygon's 0x18) run PEXT in microcode, far slower than shifts:
+  host_cpu.fastpext = host_cpu.bmi2 & (!(amd & (family < 0x19)));
+
+  // The OS must have enabled AVX state saving (OSXSAVE) for us to use ymm/zmm at all:
+  if (!(bit(ecx1, 27) & bit(ecx1, 28))) return;
+
+  W32 xcr0lo, xcr0hi;
+  asm volatile("xgetbv" : "=a" (xcr0lo), "=d" (xcr0hi) : "c" (0));
+  bool ymm_state = ((xcr0lo & 0x06) == 0x06);
+  bool zmm_state = ((xcr0lo & 0xe6) == 0xe6);
+
+  host_cpu.avx2 = ymm_state & bit(ebx7, 5);
+  host_cpu.avx512bw = zmm_state & bit(ebx7, 16) & bit(ebx7, 30);
+}
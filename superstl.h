@@ -3597,6 +3597,20 @@ namespace superstl {
     return f;
   }
 
+  //
+  // Codec for arrays of fixed size records: each record is XORed
+  // against the one before it, and the resulting mostly zero bytes
+  // are run length encoded. Token byte c < 0x80 is followed by c+1
+  // literal bytes; c >= 0x80 stands for (c - 0x80)+1 zero bytes.
+  // The output never exceeds delta_rle_max_bytes(recsize * count).
+  //
+  static inline int delta_rle_max_bytes(int rawbytes) {
+    return rawbytes + (rawbytes / 128) + 1;
+  }
+
+  int delta_rle_compress(byte* out, const void* records, int recsize, int count);
+  bool delta_rle_decompress(void* records, int recsize, int count, const byte* in, int inbytes);
+
   class CycleTimer {
   public:
     CycleTimer() { total = 0; tstart = 0; iterations = 0; title = "(generic)"; running = 0; }
@@ -60,6 +60,7 @@ declare_syscall2(__NR_rename, int, sys_rename, const char*, oldpath, const char*
 declare_syscall1(__NR_exit, void, sys_exit, int, code);
 declare_syscall1(__NR_brk, void*, sys_brk, void*, p);
 declare_syscall0(__NR_fork, pid_t, sys_fork);
+declare_syscall1(__NR_pipe, int, sys_pipe, int*, filedes);
 declare_syscall3(__NR_execve, int, sys_execve, const char*, filename, const char**, argv, const char**, envp);
 
 declare_syscall0(__NR_getpid, pid_t, sys_getpid);
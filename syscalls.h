@@ -32,6 +32,7 @@ extern "C" {
   int sys_munlockall(void);
   
   pid_t sys_fork();
+  int sys_pipe(int* filedes);
   int sys_execve(const char* filename, const char** argv, const char** envp);
   
   pid_t sys_gettid();
@@ -7,6 +7,7 @@
 
 #include <globals.h>
 #include <ptlsim.h>
+#include <stats.h>
 
 
 // No operation
@@ -922,6 +923,51 @@ inline void uop_impl_alu_and_condbranch(IssueState& state, W64 ra, W64 rb, W64 r
 make_condop_all_conds_any(OP_br_and, make_alu_and_branchop_all_sizes_all_excepts, [4][2], br_and, and_flag_gen_op);
 make_condop_all_conds_any(OP_br_sub, make_alu_and_branchop_all_sizes_all_excepts, [4][2], br_sub, sub_flag_gen_op);
 
+//
+// Superinstructions for the sequential core (see fuse_uops_for_bb()):
+// a flag setting ALU uop and the conditional branch after it, which
+// tests the flags the ALU uop generated. Each result is left in its
+// own IssueState so the core commits both uops as usual.
+//
+template <int ptlopcode, template<typename, int> class func, typename T, int genflags, int evaltype>
+void uop_impl_fused_alu_br(IssueState& state, IssueState& brstate, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags) {
+  W64 riptaken = brstate.brreg.riptaken;
+  W64 ripseq = brstate.brreg.ripseq;
+  aluop<ptlopcode, func, T, genflags>(state, ra, rb, rc, raflags, rbflags, rcflags);
+  W16 flags = state.reg.rdflags;
+  bool taken = evaluate_cond<evaltype>(flags, flags);
+  brstate.reg.rddata = (taken) ? riptaken : ripseq;
+  brstate.reg.rdflags = (taken) ? FLAG_BR_TK : 0;
+}
+
+#define make_fused_alu_br_all_sizes(ptlopcode, func, genflags, cond) \
+  {&uop_impl_fused_alu_br<ptlopcode, func, W8, genflags, cond>, &uop_impl_fused_alu_br<ptlopcode, func, W16, genflags, cond>, \
+   &uop_impl_fused_alu_br<ptlopcode, func, W32, genflags, cond>, &uop_impl_fused_alu_br<ptlopcode, func, W64, genflags, cond>}
+
+#define make_fused_alu_br_all_conds_all_sizes(mapname, ptlopcode, func, genflags) \
+fusedimpl_func_t implmap_fused_ ## mapname [16][4] = { \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 0), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 1), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 2), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 3), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 4), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 5), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 6), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 7), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 8), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 9), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 10), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 11), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 12), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 13), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 14), \
+  make_fused_alu_br_all_sizes(ptlopcode, func, genflags, 15) \
+}
+
+make_fused_alu_br_all_conds_all_sizes(add_br, OP_add, x86_op_add, ZAPS|CF|OF);
+make_fused_alu_br_all_conds_all_sizes(sub_br, OP_sub, x86_op_sub, ZAPS|CF|OF);
+make_fused_alu_br_all_conds_all_sizes(and_br, OP_and, exp_op_and, ZAPS);
+
 void uop_impl_jmp(IssueState& state, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W16 rcflags) {
   W64 riptaken = state.brreg.riptaken;
   bool taken = (riptaken == ra);
@@ -1790,6 +1836,100 @@ uopimpl_func_t get_synthcode_for_uop(int op, int size, bool setflags, int cond,
   return func;
 }
 
+//
+// Threaded dispatch for the sequential core
+//
+// Pick the handler each uop of the block is executed by, and fuse
+// each flag setting add, sub or and (e.g. from cmp or test) with a
+// conditional branch right after it that tests those flags, so the
+// pair runs as one combined function in bb.fusedops. Within one x86
+// insn, a load feeding an ALU uop and an ALU uop feeding a store are
+// also fused; the core does the memory access itself and calls the
+// ALU synthop straight after it. The out of order core never calls
+// this.
+//
+static inline bool is_flag_reg(int reg) {
+  return ((reg == REG_zf) | (reg == REG_cf) | (reg == REG_of) | (reg == REG_zero));
+}
+
+static int seq_dispatch_of(const TransOp& uop, uopimpl_func_t synthop) {
+  if unlikely ((!synthop) | uop.unaligned | isclass(uop.opcode, OPCLASS_MEM|OPCLASS_BRANCH|OPCLASS_CHECK|OPCLASS_BARRIER)) return SEQ_DISPATCH_GENERIC;
+#ifdef PTLSIM_HYPERVISOR
+  // These may take a device not available fault
+  if unlikely (uop.is_sse | uop.is_x87) return SEQ_DISPATCH_GENERIC;
+#endif
+  return SEQ_DISPATCH_ALU;
+}
+
+static inline bool reads_reg(const TransOp& uop, int reg) {
+  return ((uop.ra == reg) | (uop.rb == reg) | (uop.rc == reg));
+}
+
+static inline bool fusable_ldst(const TransOp& uop) {
+  if unlikely (uop.unaligned | uop.locked) return false;
+#ifdef PTLSIM_HYPERVISOR
+  // These may take a device not available fault
+  if unlikely (uop.is_sse | uop.is_x87) return false;
+#endif
+  return true;
+}
+
+static bool fusable_load_alu(const TransOp& ld, const TransOp& alu) {
+  if ((ld.opcode != OP_ld) && (ld.opcode != OP_ldx)) return false;
+  if ((!fusable_ldst(ld)) || (ld.rd == REG_zero) || (ld.rd == REG_rip)) return false;
+  return (!alu.som) && (alu.rd != REG_rip) && reads_reg(alu, ld.rd);
+}
+
+static bool fusable_alu_store(const TransOp& alu, const TransOp& st) {
+  if ((st.opcode != OP_st) || (!fusable_ldst(st)) || st.som) return false;
+  return (alu.rd != REG_zero) && (alu.rd != REG_rip) && (st.rc == alu.rd);
+}
+
+static fusedimpl_func_t get_fused_alu_br(const TransOp& first, const TransOp& br) {
+  if ((br.opcode != OP_br) || (!is_flag_reg(br.ra)) || (!is_flag_reg(br.rb))) return null;
+  // The branch must see all of the flags it can test come from the ALU uop:
+  if ((first.setflags != (SETFLAG_ZF|SETFLAG_CF|SETFLAG_OF)) || first.nouserflags || (first.rd == REG_rip)) return null;
+
+  switch (first.opcode) {
+  case OP_add:
+    return implmap_fused_add_br[br.cond][first.size];
+  case OP_sub:
+    return implmap_fused_sub_br[br.cond][first.size];
+  case OP_and:
+    return implmap_fused_and_br[br.cond][first.size];
+  }
+
+  return null;
+}
+
+void fuse_uops_for_bb(BasicBlock& bb) {
+  bb.fusedops = new fusedimpl_func_t[bb.count];
+
+  foreach (i, bb.count) {
+    TransOp& uop = bb.transops[i];
+    uop.dispatch = seq_dispatch_of(uop, bb.synthops[i]);
+    bb.fusedops[i] = null;
+
+    if ((i+1) >= bb.count) continue;
+    const TransOp& next = bb.transops[i+1];
+
+    if (uop.dispatch == SEQ_DISPATCH_ALU) {
+      bb.fusedops[i] = get_fused_alu_br(uop, next);
+      if (bb.fusedops[i]) {
+        uop.dispatch = SEQ_DISPATCH_ALU_BRANCH;
+      } else if (fusable_alu_store(uop, next)) {
+        uop.dispatch = SEQ_DISPATCH_ALU_STORE;
+      }
+    } else if (fusable_load_alu(uop, next) && (seq_dispatch_of(next, bb.synthops[i+1]) == SEQ_DISPATCH_ALU)) {
+      uop.dispatch = SEQ_DISPATCH_LOAD_ALU;
+    }
+
+    stats.decoder.fusion.pairs += (uop.dispatch >= SEQ_DISPATCH_ALU_BRANCH);
+  }
+
+  stats.decoder.fusion.blocks++;
+}
+
 void synth_uops_for_bb(BasicBlock& bb) {
   bb.synthops = new uopimpl_func_t[bb.count];
   foreach (i, bb.count) {